@@ -64,6 +64,8 @@ function(caffe_generate_export_configs)
 
   if(BLAS STREQUAL "MKL" OR BLAS STREQUAL "mkl")
     list(APPEND Caffe_DEFINITIONS -DUSE_MKL)
+  elseif(BLAS STREQUAL "Open" OR BLAS STREQUAL "open")
+    list(APPEND Caffe_DEFINITIONS -DUSE_OPENBLAS)
   endif()
 
   configure_file("cmake/Templates/CaffeConfig.cmake.in" "${PROJECT_BINARY_DIR}/CaffeConfig.cmake" @ONLY)
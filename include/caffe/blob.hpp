@@ -1,6 +1,8 @@
 #ifndef CAFFE_BLOB_HPP_
 #define CAFFE_BLOB_HPP_
 
+#include <stdint.h>
+
 #include <algorithm>
 #include <string>
 #include <vector>
@@ -9,6 +11,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse.hpp"
 
 const int kMaxBlobAxes = 32;
 
@@ -25,7 +28,9 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), half_data_(), half_format_(FP16), data_offset_(0),
+       diff_offset_(0), count_(0), capacity_(0), channel_block_(1),
+       version_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -52,6 +57,36 @@ class Blob {
   void Reshape(const vector<int>& shape);
   void Reshape(const BlobShape& shape);
   void ReshapeLike(const Blob& other);
+  /**
+   * @brief Allocate memory for a blob of the given shape, without changing
+   *        the dimensions, so that later reshapes up to that size do not
+   *        reallocate.
+   *
+   * Does nothing if the capacity is already large enough. Otherwise the
+   * values are lost, as when Reshape grows the blob.
+   */
+  void Reserve(const vector<int>& shape);
+  /**
+   * @brief Returns a number that changes whenever the shape, the layout or
+   *        the storage of the data or diff of the blob change.
+   *
+   * Layer%s compare it to skip reshaping when their blobs did not change,
+   * see Layer::ReshapeIfChanged.
+   */
+  inline unsigned int version() const { return version_; }
+  /**
+   * @brief Returns a number that changes whenever version() does, or the data
+   *        may have been written, through this Blob or any other sharing its
+   *        SyncedMemory (see SyncedMemory::writes).
+   *
+   * Layer%s key what they derive from their parameters on it, such as
+   * quantized weights, so that e.g. a test net sharing the weights of a
+   * training net sees them change.
+   */
+  inline uint64_t data_version() const {
+    return (static_cast<uint64_t>(version_) << 32) |
+        (data_ ? data_->writes() : 0);
+  }
   inline string shape_string() const {
     ostringstream stream;
     for (int i = 0; i < shape_.size(); ++i) {
@@ -151,6 +186,32 @@ class Blob {
     return shape(index);
   }
 
+  /**
+   * @brief Returns the number of channels interleaved in the memory layout of
+   *        a 4-axis blob.
+   *
+   * 1 is the plain NCHW layout. A block b > 1 is the NCHW[b]c layout, where
+   * the channels are split into channels() / b blocks and each block is
+   * stored as height x width x b: element (n, c, h, w) lives at
+   * (((n * channels() / b + c / b) * height() + h) * width() + w) * b + c % b.
+   * The shape is unchanged, and so is offset(n) of each item, but the other
+   * offsets (and data_at) assume NCHW. The layout is set by the layer that
+   * produces the blob.
+   */
+  inline int channel_block() const { return channel_block_; }
+  inline void set_channel_block(const int block) {
+    CHECK_GE(block, 1);
+    if (block > 1) {
+      CHECK_EQ(num_axes(), 4) << "Blocked layouts need 4 axes.";
+      CHECK_EQ(channels() % block, 0)
+          << "The channel block must divide the channels.";
+    }
+    if (block != channel_block_) {
+      ++version_;
+    }
+    channel_block_ = block;
+  }
+
   inline int offset(const int n, const int c = 0, const int h = 0,
       const int w = 0) const {
     CHECK_GE(n, 0);
@@ -207,6 +268,10 @@ class Blob {
     return cpu_diff()[offset(index)];
   }
 
+  /**
+   * @brief Returns the memory holding the data, whose values are only valid
+   *        if the blob is not compacted (see CompactToHalf).
+   */
   inline const shared_ptr<SyncedMemory>& data() const {
     CHECK(data_);
     return data_;
@@ -221,6 +286,7 @@ class Blob {
   void set_cpu_data(Dtype* data);
   const Dtype* gpu_data() const;
   const Dtype* cpu_diff() const;
+  void set_cpu_diff(Dtype* diff);
   const Dtype* gpu_diff() const;
   Dtype* mutable_cpu_data();
   Dtype* mutable_gpu_data();
@@ -230,6 +296,61 @@ class Blob {
   void FromProto(const BlobProto& proto, bool reshape = true);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
 
+  /**
+   * @brief Convert the data to 16-bit floating point and release the full
+   *        precision copy, halving the memory held by the data.
+   *
+   * Layers that support it (convolution and inner product) read a compacted
+   * blob through cpu_half_data(). The full precision data of a compacted blob
+   * can only be read after Expand(), or copied with ExpandData(), as the
+   * const accessors do not modify the blob; writing to it (or Update)
+   * expands it and discards the 16-bit copy. Blobs loaded with FromProto from
+   * a proto holding half_data start out compacted, and so do blobs sharing
+   * the data of a compacted blob.
+   */
+  void CompactToHalf(HalfFormat format);
+  /// @brief Whether the data is only held in 16-bit form.
+  inline bool is_half() const {
+    return half_data_ && data_->head() == SyncedMemory::UNINITIALIZED;
+  }
+  const uint16_t* cpu_half_data() const;
+  inline HalfFormat half_format() const { return half_format_; }
+
+  /**
+   * @brief Convert the data to compressed sparse row form, viewing the blob
+   *        as a shape(0) x count(1) matrix, and release the dense copy.
+   *
+   * This saves memory for pruned weights, and convolution and inner product
+   * layers multiply by them through cpu_sparse_data() in time proportional to
+   * the number of nonzeros. As for CompactToHalf, other accesses need the
+   * data expanded; blobs loaded from a sparse BlobProto start out compacted.
+   */
+  void CompactToSparse();
+  /// @brief Whether the data is only held in sparse form.
+  inline bool is_sparse() const {
+    return sparse_data_ && data_->head() == SyncedMemory::UNINITIALIZED;
+  }
+  const SparseMatrix<Dtype>& cpu_sparse_data() const;
+
+  /**
+   * @brief Restore the full precision data of a blob compacted by
+   *        CompactToHalf or CompactToSparse, keeping the compacted copy.
+   *
+   * Does nothing if the blob is not compacted.
+   */
+  void Expand();
+  /**
+   * @brief Write the count() values of the data, in full precision, to data,
+   *        decoding the compacted copy if the blob is compacted.
+   */
+  void ExpandData(Dtype* data) const;
+
+  /**
+   * @brief Release the memory held by the data, whose values are undefined
+   *        until it is next written.
+   */
+  void ReleaseData();
+
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
   Dtype asum_data() const;
   /// @brief Compute the sum of absolute values (L1 norm) of the diff.
@@ -262,15 +383,60 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Exchange the data of this Blob and Blob other, of the same count,
+   *        without copying it: Blob%s sharing the data of either see the
+   *        values of the other.
+   */
+  void SwapData(Blob* other);
+  /**
+   * @brief Make this Blob's data a view of the count() values of Blob other
+   *        starting at offset, so that writing to either is seen by both.
+   *
+   * Layers such as ConcatLayer use it to have their inputs written directly
+   * in place in their output. The view lasts until this Blob is reshaped to a
+   * larger count, or its data is otherwise reallocated.
+   */
+  void ShareDataView(const Blob& other, int offset);
+  /// @brief Same as ShareDataView, for the diff.
+  void ShareDiffView(const Blob& other, int offset);
+  /// @brief Whether the data is the view of Blob other at offset.
+  bool IsDataViewOf(const Blob& other, int offset) const;
+  /// @brief Whether the diff is the view of Blob other at offset.
+  bool IsDiffViewOf(const Blob& other, int offset) const;
 
   bool ShapeEquals(const BlobProto& other);
 
  protected:
+  // The full precision data of a compacted blob is not valid.
+  inline void CheckExpanded() const {
+    CHECK(!is_half() && !is_sparse())
+        << "The blob is compacted: Expand() it to read the data.";
+  }
+  // Drop the 16-bit and sparse copies, before the data is written to. The
+  // 16-bit storage is kept for the next CompactToHalf.
+  inline void DiscardCompact() {
+    if (half_data_) { spare_half_data_ = half_data_; }
+    half_data_.reset();
+    sparse_data_.reset();
+  }
+  // Write the values of the 16-bit or sparse copy to data.
+  void DecodeCompact(Dtype* data) const;
+
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
+  shared_ptr<SyncedMemory> half_data_;
+  shared_ptr<SyncedMemory> spare_half_data_;
+  HalfFormat half_format_;
+  shared_ptr<SparseMatrix<Dtype> > sparse_data_;
+  // Offsets, in values, of this Blob in data_ and diff_, non zero for views.
+  int data_offset_;
+  int diff_offset_;
   vector<int> shape_;
   int count_;
   int capacity_;
+  int channel_block_;
+  unsigned int version_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
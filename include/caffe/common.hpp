@@ -93,6 +93,8 @@ using std::vector;
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
 
+class SyncedMemory;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -149,11 +151,24 @@ class Caffe {
   static void SetDevice(const int device_id);
   // Prints the current GPU status.
   static void DeviceQuery();
+  // Returns a buffer of at least size bytes in host (or device) memory, for
+  // the temporary values of one call to a layer's Forward or Backward. It is
+  // shared by all the layers running on the thread, so it only holds its
+  // contents until the next layer asks for it.
+  static void* cpu_workspace(size_t size);
+  static void* gpu_workspace(size_t size);
   // Parallel training info
   inline static int solver_count() { return Get().solver_count_; }
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // Rank of this process and number of processes for distributed training.
+  inline static int process_rank() { return Get().process_rank_; }
+  inline static int process_count() { return Get().process_count_; }
+  inline static void set_process_group(int rank, int count) {
+    Get().process_rank_ = rank;
+    Get().process_count_ = count;
+  }
 
  protected:
 #ifndef CPU_ONLY
@@ -161,10 +176,14 @@ class Caffe {
   curandGenerator_t curand_generator_;
 #endif
   shared_ptr<RNG> random_generator_;
+  shared_ptr<SyncedMemory> cpu_workspace_;
+  shared_ptr<SyncedMemory> gpu_workspace_;
 
   Brew mode_;
   int solver_count_;
   bool root_solver_;
+  int process_rank_;
+  int process_count_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
@@ -1,6 +1,7 @@
 #ifndef CAFFE_COMMON_LAYERS_HPP_
 #define CAFFE_COMMON_LAYERS_HPP_
 
+#include <stdint.h>
 #include <string>
 #include <utility>
 #include <vector>
@@ -12,6 +13,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -137,6 +139,11 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Makes the bottom blobs views of their part of the top blob, see
+  ///        ConcatParameter::view_bottoms.
+  void ViewBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   int count_;
   int num_concats_;
   int concat_input_size_;
@@ -313,7 +320,7 @@ class FlattenLayer : public Layer<Dtype> {
    *      the outputs -- i.e., the (virtually) copied, flattened inputs
    */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
+      const vector<Blob<Dtype>*>& top) {}
 
   /**
    * @brief Computes the error gradient w.r.t. the concatenate inputs.
@@ -325,7 +332,7 @@ class FlattenLayer : public Layer<Dtype> {
    *        gradient is (virtually) copied
    */
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
 };
 
 /**
@@ -343,8 +350,12 @@ class InnerProductLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void ShareParamCaches(const Layer<Dtype>& other);
 
   virtual inline const char* type() const { return "InnerProduct"; }
+  virtual inline bool ReadsCompactParam(int param_id) const {
+    return param_id == 0;
+  }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
@@ -363,6 +374,14 @@ class InnerProductLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+
+  // INT8 inference state, used if quantization_param.precision is INT8. The
+  // weights are quantized again whenever they change.
+  bool quantized_;
+  shared_ptr<QuantizedWeights<Dtype> > quantized_weights_;
+  Dtype input_scale_;
+  vector<int8_t> bottom_int8_;
+  vector<int32_t> top_int32_;
 };
 
 /**
@@ -392,13 +411,44 @@ class MVNLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
-  Blob<Dtype> mean_, variance_, temp_;
+  Blob<Dtype> mean_, variance_;
 
   /// sum_multiplier is used to carry out sum using BLAS
   Blob<Dtype> sum_multiplier_;
   Dtype eps_;
 };
 
+/**
+ * @brief Copies a 4-axis input Blob into the channel-blocked layout given by
+ *        reorder_param.channel_block (see Blob::channel_block), or back to
+ *        NCHW for a channel_block of 1. The values and shape are unchanged.
+ *
+ * Net inserts these layers automatically at the boundaries between layers
+ * that run in a blocked layout and layers that need NCHW.
+ */
+template <typename Dtype>
+class ReorderLayer : public Layer<Dtype> {
+ public:
+  explicit ReorderLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Reorder"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  int channel_block_;
+};
+
 /*
  * @brief Reshapes the input Blob into an arbitrary-sized output Blob.
  *
@@ -543,8 +593,16 @@ class SoftmaxLayer : public Layer<Dtype> {
   int softmax_axis_;
   /// sum_multiplier is used to carry out sum using BLAS
   Blob<Dtype> sum_multiplier_;
-  /// scale is an intermediate Blob to hold temporary results.
-  Blob<Dtype> scale_;
+  /// The intermediate maxima, sums and dot products are held in the
+  /// workspace of the thread (see Caffe::cpu_workspace).
+  inline Dtype* cpu_scale() {
+    return static_cast<Dtype*>(
+        Caffe::cpu_workspace(inner_num_ * sizeof(Dtype)));
+  }
+  inline Dtype* gpu_scale() {
+    return static_cast<Dtype*>(
+        Caffe::gpu_workspace(outer_num_ * inner_num_ * sizeof(Dtype)));
+  }
 };
 
 #ifdef USE_CUDNN
@@ -595,10 +653,11 @@ class SplitLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
+  // The tops share the data of the bottom from Reshape on.
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
+      const vector<Blob<Dtype>*>& top) {}
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
+      const vector<Blob<Dtype>*>& top) {}
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,8 +16,8 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/ring_queue.hpp"
 
 namespace caffe {
 
@@ -83,8 +84,10 @@ class BasePrefetchingDataLayer :
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
   Batch<Dtype> prefetch_[PREFETCH_COUNT];
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // Only the prefetch thread pops free batches and pushes full ones, and
+  // only the thread running the net does the reverse.
+  RingQueue<Batch<Dtype>*> prefetch_free_;
+  RingQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
 };
@@ -130,6 +133,13 @@ class DummyDataLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "DummyData"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline bool ConstantTop(const int top_index) const {
+    return !refill_[refill_.size() > 1 ? top_index : 0];
+  }
+  // All fillers but the constant one are random.
+  virtual inline bool DrawsRandom() const {
+    return std::find(refill_.begin(), refill_.end(), true) != refill_.end();
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -209,6 +219,7 @@ class HDF5OutputLayer : public Layer<Dtype> {
   // TODO: no limit on the number of blobs
   virtual inline int ExactNumBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 0; }
+  virtual inline bool AllowRecompute() const { return false; }
 
   inline std::string file_name() const { return file_name_; }
 
@@ -9,6 +9,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/ring_queue.hpp"
 
 namespace caffe {
 
@@ -18,29 +19,32 @@ namespace caffe {
  * are running in parallel, e.g. for multi-GPU training. This makes sure
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
- * way to keep parallel training deterministic.
+ * way to keep parallel training deterministic. With several training
+ * processes, see Caffe::process_count, each one reads a disjoint shard.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  inline RingQueue<Datum*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline RingQueue<Datum*>& full() const {
     return queue_pair_->full_;
   }
 
  protected:
-  // Queue pairs are shared between a body and its readers
+  // Queue pairs are shared between a body and its readers. Only the body
+  // pops free datums and pushes full ones, and only the prefetch thread of
+  // the reader's data layer does the reverse.
   class QueuePair {
    public:
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    RingQueue<Datum*> free_;
+    RingQueue<Datum*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
@@ -54,9 +58,15 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Moves to the first record of the shard of this process.
+    void seek_shard(db::Cursor* cursor);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    // Records to advance after each read, to skip other processes' shards,
+    // and the first record of this process' shard.
+    int stride_;
+    int offset_;
 
     friend class DataReader;
 
@@ -43,7 +43,7 @@ class InternalThread {
 
  private:
   void entry(int device, Caffe::Brew mode, int rand_seed, int solver_count,
-      bool root_solver);
+      bool root_solver, int process_rank, int process_count);
 
   shared_ptr<boost::thread> thread_;
 };
@@ -69,7 +69,7 @@ class Layer {
     InitMutex();
     CheckBlobCounts(bottom, top);
     LayerSetUp(bottom, top);
-    Reshape(bottom, top);
+    ReshapeIfChanged(bottom, top);
     SetLossWeights(top);
   }
 
@@ -131,6 +131,30 @@ class Layer {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) = 0;
 
+  /**
+   * @brief Call Reshape, unless the shapes and storage of the bottom and top
+   *        blobs did not change since the last call to this method.
+   *
+   * @return whether Reshape was called
+   *
+   * SetUp and Net::Reshape reshape through this method, which records the
+   * blob versions (see Blob::version). Forward only compares them, as it may
+   * run concurrently with other uses of the layer, and reshapes without
+   * recording: after reshaping the inputs of a net, call Net::Reshape so
+   * that its forward passes only cost a comparison.
+   */
+  bool ReshapeIfChanged(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Whether Reshape is needed, see ReshapeIfChanged.
+  bool BlobsChanged(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
+
+  /**
+   * @brief Return whether Reshape has to be called before every Forward,
+   *        e.g. because it depends on more than the bottom shapes.
+   */
+  virtual inline bool AlwaysReshape() const { return false; }
+
   /**
    * @brief Given the bottom blobs, compute the top blobs and the loss.
    *
@@ -294,6 +318,53 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether running Forward again on the same bottoms
+   *        reproduces the tops, without other side effects.
+   *
+   * Layers for which this returns false, e.g. because they draw random
+   * numbers or write to files, are never recomputed by the Net (see
+   * LayerParameter::recompute).
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
+  /**
+   * @brief Return whether Forward draws from the random number generator of
+   *        the thread running it (see Caffe::rng_stream).
+   *
+   * When running branches concurrently (see NetParameter::branch_threads),
+   * the Net runs these layers one after the other, in order, on the thread
+   * running it, so that they draw the same numbers as in a serial run.
+   */
+  virtual inline bool DrawsRandom() const { return false; }
+
+  /**
+   * @brief Return whether Forward reads the param_id-th parameter blob in
+   *        its compacted form if it is compacted (see Blob::CompactToHalf).
+   *
+   * When loading the parameters of a TEST phase Net on the CPU, the Net keeps
+   * these compacted, and expands the others.
+   */
+  virtual inline bool ReadsCompactParam(int param_id) const { return false; }
+
+  /**
+   * @brief Share the values computed from the parameter blobs (e.g. quantized
+   *        weights) with another instance of this layer holding the same
+   *        blobs, see Net::NewContext.
+   *
+   * These values must be replaced rather than updated when the blobs change.
+   */
+  virtual void ShareParamCaches(const Layer& other) {}
+
+  /**
+   * @brief For layers without bottoms, return whether the top blob at
+   *        top_index holds the same values after every Forward.
+   *
+   * The Net runs the layers computing only from such blobs once, see
+   * NetParameter::fold_constants.
+   */
+  virtual inline bool ConstantTop(const int top_index) const { return false; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -431,6 +502,10 @@ class Layer {
   /** Whether this layer is actually shared by other nets*/
   bool is_shared_;
 
+  /** The bottom and top blobs, and their versions, at the last reshape */
+  vector<const Blob<Dtype>*> reshaped_blobs_;
+  vector<unsigned int> reshaped_versions_;
+
   /** The mutex for sequential forward if this layer is shared */
   shared_ptr<boost::mutex> forward_mutex_;
 
@@ -453,7 +528,9 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   // Lock during forward to ensure sequential forward
   Lock();
   Dtype loss = 0;
-  Reshape(bottom, top);
+  if (BlobsChanged(bottom, top)) {
+    Reshape(bottom, top);
+  }
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
@@ -1,6 +1,7 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
@@ -11,6 +12,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
@@ -63,6 +65,11 @@ class Net {
    *        Should be run before Backward.
    */
   void ClearParamDiffs();
+  /**
+   * @brief Scales the diffs of all learnable params down so that their
+   *        global L2 norm is at most max_norm. Returns the norm before.
+   */
+  Dtype ClipParamDiffs(Dtype max_norm);
 
   /**
    * The network backward should take no input and output, since it solely
@@ -75,12 +82,22 @@ class Net {
   void BackwardTo(int end);
 
   /**
-   * @brief Reshape all layers from bottom to top.
+   * @brief Reshape the layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. Only the layers
+   * whose blobs changed, i.e. those downstream of reshaped inputs, are
+   * reshaped (see Layer::ReshapeIfChanged).
    */
   void Reshape();
+  /**
+   * @brief Allocate the blobs of the net, including the internal buffers of
+   *        the layers, for inputs up to the given shapes, so that inputs of
+   *        any smaller shape do not cause reallocations.
+   *
+   * The inputs keep their shapes, but their values may be lost.
+   */
+  void Reserve(const vector<vector<int> >& max_input_shapes);
 
   Dtype ForwardBackward(const vector<Blob<Dtype>* > & bottom) {
     Dtype loss;
@@ -104,6 +121,24 @@ class Net {
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief Create a net with the same layers as this one, sharing its
+   *        learnable parameters (see ShareTrainedLayersWith), to run Forward
+   *        on another thread.
+   *
+   * Each context only holds its own activations and layer buffers, so that
+   * many threads can run inference with one copy of the weights: its layers
+   * hold the very parameter blobs of this net, which are neither allocated
+   * nor filled again, and the values computed from them so far (see
+   * Layer::ShareParamCaches). The contexts must be created in the mode they
+   * run in, and must not update the weights, nor outlive this net.
+   */
+  shared_ptr<Net<Dtype> > NewContext() const;
+  /**
+   * @brief For an already initialized net, copies the pre-trained layers from
+   *        another Net into its own blobs.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -158,6 +193,11 @@ class Net {
   inline const vector<bool>& layer_need_backward() const {
     return layer_need_backward_;
   }
+  /// @brief Whether each layer is only run when the net is set up, see
+  ///        NetParameter::fold_constants.
+  inline const vector<bool>& layer_folded() const {
+    return layer_folded_;
+  }
   /// @brief returns the parameters
   inline const vector<shared_ptr<Blob<Dtype> > >& params() const {
     return params_;
@@ -165,6 +205,21 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /**
+   * @brief A blob whose data and diff hold those of all learnable_params(),
+   *        in order and back to back, or NULL.
+   *
+   * Allocated when the NetParameter sets contiguous_params and the net is
+   * created in CPU mode. The parameters must then keep their memory: they
+   * are not to be reshaped to a larger size or compacted.
+   */
+  inline const shared_ptr<Blob<Dtype> >& param_arena() const {
+    return param_arena_;
+  }
+  /// @brief Whether operations over all params can work on param_arena().
+  inline bool use_param_arena() const {
+    return param_arena_ && Caffe::mode() == Caffe::CPU;
+  }
   /// @brief returns the learnable parameter learning rate multipliers
   inline const vector<float>& params_lr() const { return params_lr_; }
   inline const vector<bool>& has_params_lr() const { return has_params_lr_; }
@@ -179,6 +234,14 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief returns, for each param, the index of its learnable param
+  inline const vector<int>& learnable_param_ids() const {
+    return learnable_param_ids_;
+  }
+  /// @brief returns, for each param, its layer and index in the layer
+  inline const vector<pair<int, int> >& param_layer_indices() const {
+    return param_layer_indices_;
+  }
   /// @brief Input and output blob numbers
   inline int num_inputs() const { return net_input_blobs_.size(); }
   inline int num_outputs() const { return net_output_blobs_.size(); }
@@ -201,6 +264,46 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief Hold the activations in 16-bit between their uses, in CPU mode.
+   *
+   * After the forward pass of its last consumer, each blob is compacted with
+   * Blob::CompactToHalf, so that only the 16-bit copy is held until the
+   * backward pass reads it back; after the backward pass of the first layer
+   * using it, the full precision copy is released again. Net inputs and
+   * outputs, and blobs sharing their data (e.g. through Split or Reshape
+   * layers), are left in full precision. The diffs computed by the backward
+   * pass are rounded to the format, as 16-bit gradients would be.
+   */
+  void set_half_activations(bool value, HalfFormat format = BF16);
+  inline bool half_activations() const { return half_activations_; }
+  /**
+   * @brief Scale the gradients of the backward pass by scale, so that small
+   *        values survive rounding them to 16-bit (see set_half_activations).
+   *
+   * The diffs of the loss tops, which seed the backward pass with the loss
+   * weights (see Layer::SetLossWeights), are set to the loss weights times
+   * scale. The losses returned by the forward pass are not scaled.
+   */
+  void set_loss_scale(Dtype scale);
+  inline Dtype loss_scale() const { return loss_scale_; }
+
+  // Invoked by BackwardFromTo after each layer, from the last to the first,
+  // whether or not the layer needed backward. Once run(i) is called, the
+  // diffs of the learnable params owned by layers i and above are final for
+  // this pass, as sharing layers always come after the owner.
+  class Callback {
+   protected:
+    virtual void run(int layer) = 0;
+
+    template <typename T>
+    friend class Net;
+  };
+  const vector<Callback*>& after_backward() const { return after_backward_; }
+  void add_after_backward(Callback* value) {
+    after_backward_.push_back(value);
+  }
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -208,6 +311,11 @@ class Net {
    */
   static void FilterNet(const NetParameter& param,
       NetParameter* param_filtered);
+  /**
+   * @brief Remove the layers not contributing to the blobs listed in
+   *        param.output(), if any.
+   */
+  static void PruneNet(const NetParameter& param, NetParameter* param_pruned);
   /// @brief return whether NetState state meets NetStateRule rule
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
@@ -225,6 +333,31 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief Move the data and diffs of the learnable params into param_arena_.
+  void AllocateParamArena();
+  /// @brief Check that the learnable params still lie in param_arena_, in
+  ///        order, i.e. were not reshaped or given other storage since.
+  void CheckParamArena() const;
+  /// @brief Group the layers into the segments to recompute, see
+  ///        LayerParameter::recompute.
+  void SetUpRecompute(const NetParameter& param);
+  /// @brief Run the layers computing constants, and mark them as folded, see
+  ///        NetParameter::fold_constants.
+  void FoldConstants();
+  /// @brief Compute the order the layers have to keep when run concurrently,
+  ///        see NetParameter::branch_threads.
+  void SetUpBranches();
+  /// @brief Run the forward or backward pass of layers start to end on the
+  ///        branch threads, returning the loss.
+  Dtype RunBranches(int start, int end, bool backward);
+  /// @brief Give a task of RunBranches to the branch threads, or to the
+  ///        thread running the net if the layer draws random numbers.
+  void PushBranchTask(int task, std::deque<int>* own_tasks);
+  /// @brief Run the forward pass of layer task, or the backward pass of layer
+  ///        ~task, on a branch thread.
+  void RunBranchTask(int task);
+  /// @brief Create a context of params_net, see NewContext.
+  Net(const NetParameter& param, const Net* root_net, const Net* params_net);
 
   /// @brief Helper for displaying debug info in Forward about input Blobs.
   void InputDebugInfo(const int layer_id);
@@ -234,7 +367,22 @@ class Net {
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Compact the given blobs, see set_half_activations.
+  void CompactActivations(const vector<int>& blob_ids);
+  /// @brief Round the bottom diffs computed by the backward pass of a layer
+  ///        to 16-bit, see set_half_activations.
+  void RoundDiffs(int layer_id);
+  /// @brief Expand the compacted blobs among the given ones, before a layer
+  ///        reads them.
+  void ExpandActivations(const vector<Blob<Dtype>*>& blobs);
+  /// @brief Expand the compacted parameters that the layers do not read in
+  ///        compacted form, see Layer::ReadsCompactParam.
+  void ExpandCompactParams();
+  /// @brief Release the data of the given blobs, see SetUpRecompute.
+  void ReleaseActivations(const vector<int>& blob_ids);
 
+  /// @brief The parameters the net was initialized with, without the blobs
+  NetParameter param_;
   /// @brief The network name
   string name_;
   /// @brief The phase: TRAIN or TEST
@@ -288,12 +436,48 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// the data and diffs of learnable_params_, if allocated contiguously
+  shared_ptr<Blob<Dtype> > param_arena_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether to hold the activations in 16-bit, and the ids of the blobs to
+  /// compact after the forward and after the backward pass of each layer.
+  bool half_activations_;
+  HalfFormat half_activations_format_;
+  Dtype loss_scale_;
+  vector<vector<int> > compact_after_forward_;
+  vector<vector<int> > compact_after_backward_;
+  /// Whether each layer is skipped in the forward pass, its tops being
+  /// constant.
+  vector<bool> layer_folded_;
+  /// For each layer, the first layer of the segment recomputed with it, or
+  /// -1, and the ids of the blobs to release after its forward and after its
+  /// backward pass.
+  vector<int> recompute_segment_;
+  vector<vector<int> > release_after_forward_;
+  vector<vector<int> > release_after_backward_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// The net holding the learnable parameters of this one, if a context of
+  /// it (see NewContext)
+  const Net* const params_net_;
+  vector<Callback*> after_backward_;
+  /// For each layer, the layers that have to run after it in the forward and
+  /// in the backward pass when branches run concurrently, the tasks given to
+  /// the branch threads and done by them (see RunBranchTask), the loss of
+  /// each layer, the threads, and the number of threads of the BLAS routines
+  /// each of them calls.
+  class BranchThread;
+  friend class BranchThread;
+  vector<vector<int> > forward_successors_;
+  vector<vector<int> > backward_successors_;
+  BlockingQueue<int> branch_tasks_;
+  BlockingQueue<int> branch_done_;
+  vector<Dtype> layer_losses_;
+  vector<shared_ptr<BranchThread> > branch_threads_;
+  int branch_blas_threads_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
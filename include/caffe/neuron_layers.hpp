@@ -167,6 +167,9 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  /// The mask is drawn anew at each forward pass.
+  virtual inline bool AllowRecompute() const { return false; }
+  virtual inline bool DrawsRandom() const { return this->phase_ == TRAIN; }
 
  protected:
   /**
@@ -3,6 +3,7 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -13,6 +14,8 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/transport.hpp"
 
 namespace caffe {
 
@@ -59,6 +62,34 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory, in Net::param_arena if the net has one.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUParams();
+
+  void configure(Solver<Dtype>* solver) const;
+
+ protected:
+  // The arena holding the buffers, if any.
+  shared_ptr<Blob<Dtype> > arena_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+// Splits the gradients of net, laid out as in Params, into buckets of about
+// bucket_size values that become final together during the backward pass:
+// bucket i is the range [(*buckets)[i].first, (*buckets)[i].second), and is
+// complete once Net::Callback::run(layer) was called for the layer l with
+// (*layer_buckets)[l] == i (-1 for the other layers). Buckets are numbered in
+// the order they complete, from the end of the buffer to its beginning.
+template<typename Dtype>
+void ComputeGradientBuckets(const Net<Dtype>& net, size_t bucket_size,
+    vector<int>* layer_buckets, vector<pair<size_t, size_t> >* buckets);
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
@@ -80,10 +111,12 @@ class DevicePair {
   int device_;
 };
 
-// Synchronous data parallelism using map-reduce between local GPUs.
+// Synchronous data parallelism using map-reduce between local GPUs. With
+// reduce_bucket_size set, the reduction runs on a separate thread and stream,
+// a bucket of layers at a time as soon as their backward is done.
 template<typename Dtype>
 class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
-    public InternalThread {
+    public Net<Dtype>::Callback, public InternalThread {
  public:
   explicit P2PSync(shared_ptr<Solver<Dtype> > root_solver,
                    P2PSync<Dtype>* parent, const SolverParameter& param);
@@ -98,8 +131,14 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
  protected:
   void on_start();
   void on_gradients_ready();
+  void run(int layer);
 
   void InternalThreadEntry();
+  // Reduces the buckets pushed to reduce_queue_ until it gets -1.
+  void ReduceThreadEntry(int solver_count);
+  // Adds the children's gradients in bucket to ours, then sends the sum to
+  // the parent or, at the root, scales it.
+  void ReduceBucket(int bucket);
 
   P2PSync<Dtype>* parent_;
   vector<P2PSync<Dtype>*> children_;
@@ -108,11 +147,135 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   Dtype* parent_grads_;
   shared_ptr<Solver<Dtype> > solver_;
 
+  // Overlapped reduction state, see ComputeGradientBuckets.
+  vector<int> layer_buckets_;
+  vector<pair<size_t, size_t> > buckets_;
+  // Number of backward passes so far, to only reduce after the last one of
+  // each iteration when accumulating gradients over iter_size passes.
+  int backward_passes_;
+  // Buckets to reduce, buckets reduced, and buckets sent to the parent.
+  BlockingQueue<int> reduce_queue_;
+  BlockingQueue<int> reduced_queue_;
+  BlockingQueue<int> sent_queue_;
+  shared_ptr<boost::thread> reduce_thread_;
+#ifndef CPU_ONLY
+  vector<cudaEvent_t> bucket_events_;
+  cudaStream_t reduce_stream_;
+#endif
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+// Synchronous data parallelism between processes, possibly on different
+// machines. Each process trains its own solver on its shard of the data, see
+// DataReader, and the gradients are averaged with a ring all-reduce before
+// every update, which keeps the weights identical. With FP16 or BF16
+// gradient_compression, the ring carries 16-bit values, and with the other
+// compressions the processes gather each other's encoded gradients. With
+// reduce_bucket_size set, in CPU mode, the reduction runs on a separate
+// thread, a bucket of layers at a time as soon as their backward is done.
+template<typename Dtype>
+class DistSync : public CPUParams<Dtype>, public Solver<Dtype>::Callback,
+    public Net<Dtype>::Callback {
+ public:
+  DistSync(shared_ptr<Solver<Dtype> > solver,
+           shared_ptr<Transport> transport);
+  virtual ~DistSync();
+
+  // Trains until the solver is done. A process stopping early aborts the
+  // transport, so that the others fail instead of waiting for it.
+  void run();
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+  void run(int layer);
+
+  // Reduces the buckets pushed to reduce_queue_ until it gets -1.
+  void ReduceThreadEntry();
+  // Averages bucket over the processes.
+  void ReduceBucket(int bucket);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  shared_ptr<Transport> transport_;
+  // The encoder of each bucket, unless the gradients are not compressed or
+  // are reduced in a 16-bit format.
+  vector<shared_ptr<GradientCompressor<Dtype> > > compressors_;
+  bool initialized_;
+
+  // The buckets, see ComputeGradientBuckets, a single one covering all the
+  // gradients when they are reduced after the backward pass.
+  vector<int> layer_buckets_;
+  vector<pair<size_t, size_t> > buckets_;
+  // Number of backward passes so far, to only reduce after the last one of
+  // each iteration when accumulating gradients over iter_size passes.
+  int backward_passes_;
+  // Buckets to reduce, and buckets reduced.
+  BlockingQueue<int> reduce_queue_;
+  BlockingQueue<int> reduced_queue_;
+  shared_ptr<boost::thread> reduce_thread_;
+
   using Params<Dtype>::size_;
   using Params<Dtype>::data_;
   using Params<Dtype>::diff_;
 };
 
+// Assigns each of params to one of num_shards shards, balancing their
+// counts: (*shards)[s] lists the indices of the params of shard s.
+template<typename Dtype>
+void ComputeParamShards(const vector<Blob<Dtype>*>& params, int num_shards,
+    vector<vector<int> >* shards);
+
+// Asynchronous data parallelism with parameter servers. In a group of
+// processes, the first num_servers ranks are servers: each one holds a shard
+// of the learnable params, see ComputeParamShards, and applies the solver's
+// update to it for every gradient a worker pushes. The other ranks are
+// workers, running a WorkerSolver on their shard of the data: after each
+// backward pass, they push the gradients to the servers and pull the latest
+// weights. A worker only waits for the others when it gets more than
+// staleness iterations ahead of the slowest one. The gradients are pushed
+// encoded as set by gradient_compression.
+template<typename Dtype>
+class ParamServerSync : public Solver<Dtype>::Callback {
+ public:
+  // param gives the snapshot settings, as the solvers of workers cannot
+  // snapshot themselves.
+  ParamServerSync(shared_ptr<Solver<Dtype> > solver,
+                  shared_ptr<Transport> transport, int num_servers,
+                  int staleness, const SolverParameter& param);
+
+  inline bool is_server() const {
+    return transport_->rank() < num_servers_;
+  }
+  // Serves the params until all the workers are done, or trains.
+  void run();
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+
+  void Serve();
+  // Copies the data or diffs of the params of shard to or from buffer_.
+  void GatherShard(int shard, bool diff);
+  void ScatterShard(int shard, bool diff);
+  void SnapshotWeights(int iter);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  shared_ptr<Transport> transport_;
+  const int num_servers_;
+  const int staleness_;
+  const SolverParameter param_;
+  vector<vector<int> > shards_;
+  vector<size_t> shard_counts_;
+  // Encoder (workers) or decoder (servers) of the gradients of each shard.
+  vector<shared_ptr<GradientCompressor<Dtype> > > compressors_;
+  vector<char> message_;
+  vector<Dtype> buffer_;
+  bool initialized_;
+};
+
 }  // namespace caffe
 
 #endif
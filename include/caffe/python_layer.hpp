@@ -10,23 +10,50 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+// Holds the GIL while in scope. The pycaffe bindings release it while nets
+// and solvers compute, see _caffe.cpp, and nets may run layers on threads of
+// their own, so Python layers take it back to call into Python.
+class PyGILAcquire {
+ public:
+  PyGILAcquire() : state_(PyGILState_Ensure()) {}
+  ~PyGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+
+  DISABLE_COPY_AND_ASSIGN(PyGILAcquire);
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
   PythonLayer(PyObject* self, const LayerParameter& param)
       : Layer<Dtype>(param), self_(bp::handle<>(bp::borrowed(self))) { }
+  // The net may be destroyed on a thread not holding the GIL, which releasing
+  // the Python object needs.
+  virtual ~PythonLayer() {
+    PyGILAcquire gil;
+    self_ = bp::object();
+  }
 
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("param_str") = bp::str(
         this->layer_param_.python_param().param_str());
     self_.attr("setup")(bottom, top);
   }
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("reshape")(bottom, top);
   }
 
+  // The reshape method may depend on anything, so it is not skipped.
+  virtual inline bool AlwaysReshape() const { return true; }
+  // Nor is the forward method known to be free of side effects.
+  virtual inline bool AllowRecompute() const { return false; }
+
   virtual inline bool ShareInParallel() const {
     return this->layer_param_.python_param().share_in_parallel();
   }
@@ -36,10 +63,12 @@ class PythonLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("forward")(bottom, top);
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    PyGILAcquire gil;
     self_.attr("backward")(top, propagate_down, bottom);
   }
 
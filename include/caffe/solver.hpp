@@ -4,7 +4,10 @@
 #include <string>
 #include <vector>
 
+#include "caffe/internal_thread.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/fused_update.hpp"
 
 namespace caffe {
 
@@ -30,6 +33,31 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+/**
+ * @brief Runs a task of a Solver, e.g. the update, on a thread of its own so
+ *        that it overlaps with the rest of the training loop.
+ */
+class SolverThread : public InternalThread {
+ public:
+  explicit SolverThread(const boost::function<void()>& task);
+  virtual ~SolverThread();
+
+  // Starts running the task. The previous run must be done.
+  void Run();
+  // Waits for the task started, if any, to be done.
+  void Wait();
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  boost::function<void()> task_;
+  BlockingQueue<int> start_;
+  BlockingQueue<int> done_;
+  bool running_;
+
+  DISABLE_COPY_AND_ASSIGN(SolverThread);
+};
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -67,6 +95,7 @@ class Solver {
     return test_nets_;
   }
   int iter() { return iter_; }
+  void set_iter(int value) { iter_ = value; }
 
   // Invoked at specific points during an iteration
   class Callback {
@@ -83,6 +112,9 @@ class Solver {
   }
 
  protected:
+  // Called once the callbacks have started an iteration, right before its
+  // forward and backward passes.
+  virtual void PrepareIteration() {}
   // Make and apply the update value for the current iteration.
   virtual void ApplyUpdate() = 0;
   // The Solver::Snapshot function implements the basic snapshotting utility
@@ -93,8 +125,11 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
-  // The test routine
+  // The test routine. With test_async, TestAll hands the tests over to
+  // test_thread_ and returns; WaitForTests waits for them to end.
   void TestAll();
+  void WaitForTests();
+  void RunTests();
   void Test(const int test_net_id = 0);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
@@ -119,6 +154,13 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // The iteration whose weights are being tested.
+  int test_iter_;
+  // The threads for pipelined and test_async, declared last so that they are
+  // stopped first.
+  shared_ptr<SolverThread> update_thread_;
+  shared_ptr<SolverThread> test_thread_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -159,14 +201,33 @@ class SGDSolver : public Solver<Dtype> {
       : Solver<Dtype>(param_file) { PreSolve(); }
 
   const vector<shared_ptr<Blob<Dtype> > >& history() { return history_; }
+  // The current loss scale of mixed precision training.
+  inline Dtype loss_scale() const { return loss_scale_; }
+  // Updates only the given learnable params from their diffs, e.g. on a
+  // parameter server holding a shard of them. The diffs are not clipped, as
+  // clipping needs the norm over all the params: ParamServerSync clips them
+  // on the workers before pushing them.
+  void UpdateParams(const vector<int>& param_ids);
 
  protected:
   void PreSolve();
   Dtype GetLearningRate();
+  // Under mixed_precision, swap the learnable params of the net, the master
+  // copies, with their values rounded to 16-bit for the forward and backward
+  // passes, and seed the backward pass with the loss scale.
+  virtual void PrepareIteration();
   virtual void ApplyUpdate();
+  // Under mixed_precision, swap the master params back, round the gradients
+  // to 16-bit and unscale them, adjusting the loss scale. Returns false if
+  // they overflowed, in which case the update is skipped.
+  bool RestoreMasterParams();
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  // Single pass equivalent of Normalize, Regularize, ComputeUpdateValue and
+  // the parameter's Update, used on the CPU when fused_update is set.
+  virtual void FusedUpdate(int param_id, Dtype rate);
+  GradientTerms<Dtype> FusedGradientTerms(int param_id);
   virtual void ClipGradients();
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
@@ -178,6 +239,13 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // half_params holds the learnable params rounded to 16-bit under
+  // mixed_precision, and the master copies during the forward and backward
+  // passes, see PrepareIteration.
+  vector<shared_ptr<Blob<Dtype> > > half_params_;
+  Dtype loss_scale_;
+  // The number of updates since the loss scale last changed.
+  int loss_scale_iter_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -192,6 +260,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -206,6 +275,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -225,6 +295,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -248,6 +319,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -271,10 +343,60 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
 
+/**
+ * @brief LARSSolver, SGD with momentum where the learning rate of each
+ *        parameter blob is scaled by its trust ratio
+ *        lars_eta * ||w|| / ||gradient||, for large batch training.
+ *        Described in [1].
+ *
+ * [1] Y. You, I. Gitman and B. Ginsburg, "Large Batch Training of
+ *     Convolutional Networks." arXiv preprint arXiv:1708.03888 (2017).
+ */
+template <typename Dtype>
+class LARSSolver : public SGDSolver<Dtype> {
+ public:
+  explicit LARSSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param) {}
+  explicit LARSSolver(const string& param_file)
+      : SGDSolver<Dtype>(param_file) {}
+
+ protected:
+  virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
+
+  DISABLE_COPY_AND_ASSIGN(LARSSolver);
+};
+
+/**
+ * @brief LAMBSolver, Adam with decoupled weight decay where the update of
+ *        each parameter blob is scaled by the trust ratio ||w|| / ||update||.
+ *        Described in [1].
+ *
+ * [1] Y. You et al., "Large Batch Optimization for Deep Learning: Training
+ *     BERT in 76 minutes." arXiv preprint arXiv:1904.00962 (2019).
+ */
+template <typename Dtype>
+class LAMBSolver : public AdamSolver<Dtype> {
+ public:
+  explicit LAMBSolver(const SolverParameter& param)
+      : AdamSolver<Dtype>(param) {}
+  explicit LAMBSolver(const string& param_file)
+      : AdamSolver<Dtype>(param_file) {}
+
+ protected:
+  // The weight decay is part of the update rather than of the gradient.
+  virtual void Regularize(int param_id) {}
+  virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate);
+
+  DISABLE_COPY_AND_ASSIGN(LAMBSolver);
+};
+
 template <typename Dtype>
 Solver<Dtype>* GetSolver(const SolverParameter& param) {
   SolverParameter_SolverType type = param.solver_type();
@@ -292,6 +414,10 @@ Solver<Dtype>* GetSolver(const SolverParameter& param) {
       return new AdaDeltaSolver<Dtype>(param);
   case SolverParameter_SolverType_ADAM:
       return new AdamSolver<Dtype>(param);
+  case SolverParameter_SolverType_LARS:
+      return new LARSSolver<Dtype>(param);
+  case SolverParameter_SolverType_LAMB:
+      return new LAMBSolver<Dtype>(param);
   default:
       LOG(FATAL) << "Unknown SolverType: " << type;
   }
@@ -4,6 +4,7 @@
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -13,6 +14,8 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Otherwise it comes from the caching allocator of host_allocator.hpp,
+// aligned for vector loads and reused across reshapes.
 inline void CaffeMallocHost(void** ptr, size_t size) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -20,8 +23,7 @@ inline void CaffeMallocHost(void** ptr, size_t size) {
     return;
   }
 #endif
-  *ptr = malloc(size);
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
+  *ptr = HostAllocate(size);
 }
 
 inline void CaffeFreeHost(void* ptr) {
@@ -31,7 +33,7 @@ inline void CaffeFreeHost(void* ptr) {
     return;
   }
 #endif
-  free(ptr);
+  HostFree(ptr);
 }
 
 
@@ -45,10 +47,12 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false), own_gpu_data_(false), gpu_device_(-1) {}
+        own_cpu_data_(false), own_gpu_data_(false), gpu_device_(-1),
+        writes_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false), own_gpu_data_(false), gpu_device_(-1) {}
+        own_cpu_data_(false), own_gpu_data_(false), gpu_device_(-1),
+        writes_(0) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -59,6 +63,17 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  // Whether the memory was set by set_cpu_data or set_gpu_data, and so
+  // belongs to a buffer managed elsewhere.
+  bool borrowed() const {
+    return (cpu_ptr_ && !own_cpu_data_) || (gpu_ptr_ && !own_gpu_data_);
+  }
+  // Exchange the memory held by this and other, of the same size, so that
+  // everything sharing either object sees the values of the other.
+  void swap(SyncedMemory* other);
+  // The number of times the memory may have been written: on mutable access,
+  // when it is set, or swapped. Every Blob sharing this object sees it.
+  unsigned int writes() const { return writes_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -74,6 +89,7 @@ class SyncedMemory {
   bool own_cpu_data_;
   bool own_gpu_data_;
   int gpu_device_;
+  unsigned int writes_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,18 @@
+#ifndef CAFFE_UTIL_FOLD_LAYERS_HPP_
+#define CAFFE_UTIL_FOLD_LAYERS_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters, whose layers hold their trained blobs, removing the
+// layers that are identities or elementwise affine maps at inference:
+// Dropout layers, and Power layers of power 1 following Convolution,
+// Deconvolution or InnerProduct layers, whose weights and bias absorb their
+// scale and shift. Layers are only removed when their input is used by
+// nothing else.
+void FoldAffineLayers(const NetParameter& param, NetParameter* param_folded);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FOLD_LAYERS_HPP_
@@ -0,0 +1,109 @@
+#ifndef CAFFE_UTIL_FUSED_UPDATE_H_
+#define CAFFE_UTIL_FUSED_UPDATE_H_
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// How the fused updates get the gradient from a parameter's diff and data:
+// scale * diff (normalizing accumulated gradients), plus decay * data for L2
+// regularization or decay * sign(data) for L1.
+template <typename Dtype>
+struct GradientTerms {
+  GradientTerms() : scale(1), decay(0), l1(false) {}
+  inline Dtype operator()(const Dtype diff, const Dtype data) const {
+    if (l1) {
+      return scale * diff + decay * ((Dtype(0) < data) - (data < Dtype(0)));
+    }
+    return scale * diff + decay * data;
+  }
+
+  Dtype scale;
+  Dtype decay;
+  bool l1;
+};
+
+// Single pass counterparts of the Normalize, Regularize, ComputeUpdateValue
+// and Update steps of the solvers, for N parameters: each computes the
+// gradient g as above, updates the history, stores the update in diff and
+// subtracts it from data. rate is the local learning rate.
+
+// history = momentum * history + rate * g; update = history.
+template <typename Dtype>
+void caffe_cpu_sgd_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history);
+
+// As SGD, but the update steps back then over-steps:
+// update = (1 + momentum) * history - momentum * previous history.
+template <typename Dtype>
+void caffe_cpu_nesterov_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history);
+
+// history += g^2; update = rate * g / (sqrt(history) + delta).
+template <typename Dtype>
+void caffe_cpu_adagrad_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype delta, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history);
+
+// history = rms_decay * history + (1 - rms_decay) * g^2;
+// update = rate * g / (sqrt(history) + delta).
+template <typename Dtype>
+void caffe_cpu_rmsprop_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype rms_decay, const Dtype delta, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* history);
+
+// history = momentum * history + (1 - momentum) * g^2;
+// u = g * sqrt((update_history + delta) / (history + delta));
+// update_history = momentum * update_history + (1 - momentum) * u^2;
+// update = rate * u.
+template <typename Dtype>
+void caffe_cpu_adadelta_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype delta, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* history, Dtype* update_history);
+
+// m = beta1 * m + (1 - beta1) * g; v = beta2 * v + (1 - beta2) * g^2;
+// update = rate * m / (sqrt(v) + eps_hat), where rate includes the bias
+// correction.
+template <typename Dtype>
+void caffe_cpu_adam_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype beta1, const Dtype beta2, const Dtype eps_hat, const Dtype rate,
+    Dtype* data, Dtype* diff, Dtype* m, Dtype* v);
+
+// The layer-wise trust ratio of LARS and LAMB: coefficient * data_norm /
+// update_norm, or 1 when either norm is zero (e.g. zero-initialized biases).
+template <typename Dtype>
+inline Dtype caffe_trust_ratio(const Dtype coefficient, const Dtype data_norm,
+    const Dtype update_norm) {
+  if (data_norm > Dtype(0) && update_norm > Dtype(0)) {
+    return coefficient * data_norm / update_norm;
+  }
+  return Dtype(1);
+}
+
+// The layer-wise updates need the norms of the whole blob before updating it,
+// so they take two passes: the first computes g, or the direction r, in diff
+// along with the norms, the second applies the trust ratio.
+
+// history = momentum * history + rate * trust * g, with
+// trust = caffe_trust_ratio(eta, ||data||, ||g||); update = history.
+template <typename Dtype>
+void caffe_cpu_lars_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype eta, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* history);
+
+// As Adam on the gradient g without regularization, with the bias corrected
+// moments m / bias1 and v / bias2, then the regularization is decoupled:
+// r = (m / bias1) / (sqrt(v / bias2) + eps) + terms(0, data);
+// update = rate * trust * r, with
+// trust = caffe_trust_ratio(1, ||data||, ||r||).
+template <typename Dtype>
+void caffe_cpu_lamb_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype beta1, const Dtype beta2, const Dtype bias1, const Dtype bias2,
+    const Dtype eps, const Dtype rate, Dtype* data, Dtype* diff, Dtype* m,
+    Dtype* v);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSED_UPDATE_H_
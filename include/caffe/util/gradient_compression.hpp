@@ -0,0 +1,47 @@
+#ifndef CAFFE_UTIL_GRADIENT_COMPRESSION_H_
+#define CAFFE_UTIL_GRADIENT_COMPRESSION_H_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Encodes gradient buffers of count values into smaller messages for the
+// exchanges between training processes, see
+// SolverParameter::gradient_compression. For TOP_K and ONE_BIT, what the
+// encoding loses is kept in a residual and added to the next gradients, so
+// that it is only delayed (error feedback).
+template <typename Dtype>
+class GradientCompressor {
+ public:
+  GradientCompressor(SolverParameter::GradientCompression type, int count,
+      float top_k_ratio);
+
+  // Encodes diff, plus the residual, into message.
+  void Compress(const Dtype* diff, vector<char>* message);
+  // Decodes message, and adds it to diff.
+  void DecompressAdd(const vector<char>& message, Dtype* diff) const;
+
+  inline SolverParameter::GradientCompression type() const { return type_; }
+  inline const vector<Dtype>& residual() const { return residual_; }
+
+ protected:
+  const SolverParameter::GradientCompression type_;
+  const int count_;
+  const int top_k_;
+  vector<Dtype> residual_;
+
+  DISABLE_COPY_AND_ASSIGN(GradientCompressor);
+};
+
+// Whether type encodes each value in a 16-bit format, in which case the
+// values can be summed along a ring (see caffe_ring_allreduce_half), and in
+// which format.
+bool IsHalfCompression(SolverParameter::GradientCompression type,
+    HalfFormat* format);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GRADIENT_COMPRESSION_H_
@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_HALF_H_
+#define CAFFE_UTIL_HALF_H_
+
+#include <stdint.h>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// Scalar conversions between float and the 16-bit formats. Narrowing rounds
+// to nearest even; NaN and infinity are preserved, and values beyond the
+// fp16 range become infinity.
+uint16_t float_to_fp16(float x);
+float fp16_to_float(uint16_t x);
+uint16_t float_to_bf16(float x);
+float bf16_to_float(uint16_t x);
+
+// y = x converted to (caffe_cpu_to_half) or from (caffe_cpu_from_half) the
+// 16-bit format.
+template <typename Dtype>
+void caffe_cpu_to_half(const int N, const Dtype* x, const HalfFormat format,
+    uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int N, const uint16_t* x,
+    const HalfFormat format, Dtype* y);
+
+// y = x rounded to the 16-bit format after scaling it by scale, then scaled
+// back, as the loss scaled gradients of mixed precision training are. Also
+// scans for overflow: returns false if any scaled value is infinite or NaN.
+template <typename Dtype>
+bool caffe_cpu_round_half(const int N, const Dtype scale, const Dtype* x,
+    const HalfFormat format, Dtype* y);
+
+// caffe_cpu_gemm with a 16-bit left operand: C = alpha * A * op(B) + beta * C
+// where A is an M x K matrix. A is expanded into a small buffer a panel of
+// rows at a time right before it is multiplied, so it is never held in full
+// precision.
+template <typename Dtype>
+void caffe_cpu_gemm_half_a(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype alpha, const uint16_t* A,
+    const HalfFormat format, const Dtype* B, const Dtype beta, Dtype* C);
+
+// caffe_cpu_gemm with a 16-bit, transposed right operand:
+// C = alpha * A * B^T + beta * C where B is an N x K matrix, expanded a panel
+// of rows (i.e. columns of C) at a time.
+template <typename Dtype>
+void caffe_cpu_gemm_half_bt(const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const uint16_t* B,
+    const HalfFormat format, const Dtype beta, Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_H_
@@ -0,0 +1,60 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <cstddef>
+
+namespace caffe {
+
+/**
+ * @brief A caching allocator for host memory, used by CaffeMallocHost in CPU
+ *        mode.
+ *
+ * Blocks are aligned to kHostAlignment bytes for vector loads, and their
+ * sizes are rounded up to one of four size classes per power of two. Freed
+ * blocks are kept for reuse, first in a cache of the freeing thread, which
+ * needs no locking, then in a pool shared by the threads of the NUMA node the
+ * block was allocated from, so reshapes and nets created per request stop
+ * going back to the system. A thread only caches the blocks of its own node.
+ * Blocks of at least kHugePageSize bytes are aligned to it and advised to be
+ * backed by transparent huge pages, to save TLB misses on large activations.
+ */
+const size_t kHostAlignment = 64;
+const size_t kHugePageSize = 2 << 20;
+
+struct HostAllocatorStats {
+  // Bytes asked by the live blocks, and the largest it has been.
+  size_t bytes_in_use;
+  size_t peak_bytes_in_use;
+  // Bytes held from the system, by the live blocks and the cached ones.
+  size_t bytes_reserved;
+  // Bytes of the freed blocks kept for reuse.
+  size_t bytes_cached;
+  // The share of the reserved bytes not in use, lost to rounding to size
+  // classes and to caching.
+  double fragmentation() const {
+    return bytes_reserved == 0 ? 0 :
+        1 - static_cast<double>(bytes_in_use) / bytes_reserved;
+  }
+};
+
+void* HostAllocate(size_t size);
+void HostFree(void* ptr);
+
+HostAllocatorStats GetHostAllocatorStats();
+// Returns the blocks cached by the pool and by the calling thread to the
+// system. The other threads return theirs when they exit.
+void ReleaseHostCache();
+
+// Whether freed blocks are kept for reuse (the default). Without pooling,
+// each block is allocated from and returned to the system, at its exact size,
+// as malloc would, e.g. to check memory accesses with valgrind.
+void SetHostPooling(bool pooling);
+// Whether large blocks ask for huge pages (the default).
+void SetHostHugePages(bool huge_pages);
+// The most bytes the shared pool caches, beyond which freed blocks go back to
+// the system. 1 GB by default.
+void SetHostCacheLimit(size_t bytes);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
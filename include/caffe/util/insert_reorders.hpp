@@ -0,0 +1,28 @@
+#ifndef CAFFE_UTIL_INSERT_REORDERS_HPP_
+#define CAFFE_UTIL_INSERT_REORDERS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters, running the layers that support it in the
+// NCHW[channel_block]c layout given by param.channel_block(), with
+// ReorderLayers added in front of the layers that need NCHW inputs, at the
+// outputs of the net and for the blobs named in param.output(). The blocked
+// blobs are renamed by BlockedBlobName. A copy is returned unchanged if
+// channel_block <= 1.
+void InsertReorders(const NetParameter& param, NetParameter* param_reorder);
+
+void ConfigureReorderLayer(const string& layer_name, const string& bottom_name,
+    const string& top_name, const int channel_block,
+    LayerParameter* reorder_layer_param);
+
+string ReorderBlobName(const string& blob_name, const int reorder_idx);
+
+string BlockedBlobName(const string& blob_name);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INSERT_REORDERS_HPP_
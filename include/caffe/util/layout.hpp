@@ -0,0 +1,35 @@
+#ifndef CAFFE_UTIL_LAYOUT_H_
+#define CAFFE_UTIL_LAYOUT_H_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// Offset of channel c at spatial position s within one item stored in the
+// NCHW[block]c layout (see Blob::channel_block); block 1 is plain NCHW.
+inline int channel_block_offset(const int spatial_dim, const int block,
+    const int c, const int s) {
+  return ((c / block) * spatial_dim + s) * block + c % block;
+}
+
+// Convolution weights rearranged for a blocked layout, with the
+// Blob::data_version() of the weights they were computed from. They are not
+// modified once computed.
+template <typename Dtype>
+struct BlockedWeights {
+  uint64_t version;
+  vector<Dtype> values;
+};
+
+// Copies x, a num x channels x spatial_dim array in the NCHW[from_block]c
+// layout, to y in the NCHW[to_block]c layout. x and y may not overlap.
+template <typename Dtype>
+void caffe_cpu_change_channel_block(const int num, const int channels,
+    const int spatial_dim, const int from_block, const int to_block,
+    const Dtype* x, Dtype* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LAYOUT_H_
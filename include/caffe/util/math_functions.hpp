@@ -69,6 +69,11 @@ void caffe_powx(const int n, const Dtype* a, const Dtype b, Dtype* y);
 
 unsigned int caffe_rng_rand();
 
+// The number of threads the BLAS library runs its routines on, which is only
+// known, and can only be set, with MKL and OpenBLAS (1 and ignored otherwise).
+int caffe_cpu_blas_threads();
+void caffe_set_cpu_blas_threads(const int num_threads);
+
 template <typename Dtype>
 Dtype caffe_nextafter(const Dtype b);
 
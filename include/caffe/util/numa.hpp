@@ -0,0 +1,34 @@
+#ifndef CAFFE_UTIL_NUMA_HPP_
+#define CAFFE_UTIL_NUMA_HPP_
+
+#include <string>
+#include <vector>
+
+namespace caffe {
+
+/**
+ * NUMA topology and thread placement, read from /sys/devices/system/node.
+ *
+ * Linux places a page on the node of the thread touching it first, and
+ * SyncedMemory clears its host memory when allocating it, so binding the
+ * threads of a net to a node is enough to keep its blobs there too. Threads
+ * inherit the binding of the thread starting them, so binding the main thread
+ * early binds the prefetch and branch threads as well. A machine without NUMA
+ * is seen as a single node holding all the CPUs.
+ */
+int NumaNodeCount();
+// The CPUs of node, in increasing order.
+const std::vector<int>& NumaNodeCpus(int node);
+// The node of the CPU the calling thread runs on.
+int CurrentNumaNode();
+
+// Restricts the calling thread, and the threads it starts afterwards, to cpus.
+void BindThreadToCpus(const std::vector<int>& cpus);
+void BindThreadToNumaNode(int node);
+
+// Parses a Linux CPU list such as "0-3,8,10-11".
+std::vector<int> ParseCpuList(const std::string& list);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NUMA_HPP_
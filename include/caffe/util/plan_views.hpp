@@ -0,0 +1,15 @@
+#ifndef CAFFE_UTIL_PLAN_VIEWS_HPP_
+#define CAFFE_UTIL_PLAN_VIEWS_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Sets ConcatParameter::view_bottoms and SliceParameter::view_tops on the
+// layers of param, as ran after InsertSplits, for which sharing storage is
+// safe: none of the blobs made to share storage is modified in place later.
+void PlanConcatSliceViews(NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PLAN_VIEWS_HPP_
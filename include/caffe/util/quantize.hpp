@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_QUANTIZE_H_
+#define CAFFE_UTIL_QUANTIZE_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// Quantized values live on the symmetric grid [-kInt8Max, kInt8Max] so that
+// negation never overflows and zero is represented exactly.
+const int kInt8Max = 127;
+
+// Weights quantized by caffe_cpu_quantize_rows for INT8 inference, with the
+// scales that dequantize their products and the Blob::data_version() of the
+// weights they were computed from. They are not modified once computed.
+template <typename Dtype>
+struct QuantizedWeights {
+  uint64_t version;
+  vector<int8_t> values;
+  vector<Dtype> scales;
+};
+
+// Quantizes the weights of a layer, as a rows x (count / rows) matrix, into
+// *quantized with input_scale folded into the scales so that products are
+// dequantized in one pass, unless *quantized was computed from the current
+// weights. It is replaced rather than modified, as it may be shared with
+// other instances of the layer (see Layer::ShareParamCaches).
+template <typename Dtype>
+void QuantizeWeights(const Blob<Dtype>& weight, const int rows,
+    const bool per_row, const Dtype input_scale,
+    shared_ptr<QuantizedWeights<Dtype> >* quantized);
+
+// Returns max_i |x_i|.
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int N, const Dtype* x);
+
+// y = saturate(round(x / scale)) on the int8 grid.
+template <typename Dtype>
+void caffe_cpu_quantize(const int N, const Dtype* x, const Dtype scale,
+    int8_t* y);
+
+// Quantizes a rows x cols matrix with one scale per row (or a single scale
+// for the whole matrix if !per_row), chosen so that the largest magnitude of
+// each row maps to kInt8Max. The scales are written to scales[0..rows).
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* x,
+    const bool per_row, Dtype* scales, int8_t* y);
+
+// y = x * scales, broadcasting scales along the rows of the M x N matrix x
+// (one scale per row) if scale_rows, and along its columns otherwise.
+template <typename Dtype>
+void caffe_cpu_dequantize(const int M, const int N, const int32_t* x,
+    const Dtype* scales, const bool scale_rows, Dtype* y);
+
+// Integer gemm with 32-bit accumulation: C = A * op(B), where A is M x K and
+// op(B) is K x N. Unlike caffe_cpu_gemm there is no alpha or beta, as the
+// scaling is applied when the result is dequantized.
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransB, const int M, const int N,
+    const int K, const int8_t* A, const int8_t* B, int32_t* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_H_
@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_RING_QUEUE_HPP_
+#define CAFFE_UTIL_RING_QUEUE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded queue on a lock-free ring buffer, for hot paths where a
+ *        fixed number of objects cycles between threads, such as the datums
+ *        of DataReader and the batches of the prefetching data layers. See
+ *        tools/queue_benchmark to compare it with BlockingQueue.
+ *
+ * Any number of threads may push and pop, each with a compare-and-swap. A
+ * queue created for a single producer and a single consumer, which must then
+ * be the only threads pushing and popping, takes plain loads and stores
+ * instead. A thread finding the queue empty (or full, when pushing) retries
+ * for a while before sleeping, so the mutex and condition variable of
+ * BlockingQueue are only used when a thread has to wait. Sleeping is an
+ * interruption point, which lets InternalThread stop threads blocked on the
+ * queue.
+ */
+template<typename T>
+class RingQueue {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit RingQueue(size_t capacity, bool single_producer_consumer = false);
+
+  // Waits for room if the queue is full.
+  void push(const T& t);
+  bool try_push(const T& t);
+
+  bool try_pop(T* t);
+  // This logs a message if the threads needs to be blocked
+  // useful for detecting e.g. when data feeding is too slow
+  T pop(const string& log_on_wait = "");
+
+  // Peeking is only safe with a single consumer, which is the thread peeking.
+  bool try_peek(T* t);
+  // Return element without removing it
+  T peek();
+
+  size_t size() const;
+  size_t capacity() const;
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX. Also fails on
+   Linux CUDA 7.0.18.
+   */
+  class sync;
+
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(RingQueue);
+};
+
+}  // namespace caffe
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_SPARSE_H_
+#define CAFFE_UTIL_SPARSE_H_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// A rows x cols matrix in compressed sparse row (CSR) form: the nonzeros of
+// row i are values[k], in columns col_idx[k], for
+// row_ptr[i] <= k < row_ptr[i + 1].
+template <typename Dtype>
+struct SparseMatrix {
+  SparseMatrix() : rows(0), cols(0), row_ptr(1, 0) {}
+  inline int nnz() const { return values.size(); }
+
+  int rows;
+  int cols;
+  vector<int> row_ptr;
+  vector<int> col_idx;
+  vector<Dtype> values;
+};
+
+// Returns the fraction of the N values of x that are zero.
+template <typename Dtype>
+double caffe_cpu_sparsity(const int N, const Dtype* x);
+
+// Converts the dense row-major rows x cols matrix x to CSR form, and back.
+template <typename Dtype>
+void caffe_cpu_dense_to_csr(const int rows, const int cols, const Dtype* x,
+    SparseMatrix<Dtype>* y);
+
+template <typename Dtype>
+void caffe_cpu_csr_to_dense(const SparseMatrix<Dtype>& x, Dtype* y);
+
+// caffe_cpu_gemm with a sparse left operand:
+// C = alpha * A[row_begin:row_begin + M, :] * B + beta * C, where B is a
+// dense A.cols x N matrix. The work is proportional to the nonzeros of the
+// M rows of A used.
+template <typename Dtype>
+void caffe_cpu_csrmm(const int row_begin, const int M, const int N,
+    const Dtype alpha, const SparseMatrix<Dtype>& A, const Dtype* B,
+    const Dtype beta, Dtype* C);
+
+// caffe_cpu_gemm with a sparse, transposed right operand:
+// C = alpha * A * B^T + beta * C, where A is a dense M x B.cols matrix and C
+// is M x B.rows.
+template <typename Dtype>
+void caffe_cpu_gemm_csr_bt(const int M, const Dtype alpha, const Dtype* A,
+    const SparseMatrix<Dtype>& B, const Dtype beta, Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_H_
@@ -0,0 +1,105 @@
+#ifndef CAFFE_UTIL_TRANSPORT_HPP_
+#define CAFFE_UTIL_TRANSPORT_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Reliable, ordered byte streams between the processes of a training group,
+// numbered from 0 to size - 1.
+class Transport {
+ public:
+  Transport(int rank, int size) : rank_(rank), size_(size), timeout_(0) { }
+  virtual ~Transport() { }
+
+  inline int rank() const { return rank_; }
+  inline int size() const { return size_; }
+
+  // Fails if no data moves to or from the peers waited on for that many
+  // seconds, e.g. when one of them hangs. 0, the default, waits forever.
+  inline void set_timeout(int seconds) { timeout_ = seconds; }
+  inline int timeout() const { return timeout_; }
+
+  // Sends send_size bytes to send_peer while receiving recv_size bytes from
+  // recv_peer, so that processes can exchange data around a ring without
+  // all blocking on full buffers. A peer of -1 skips that direction.
+  virtual void SendRecv(int send_peer, const void* send_data,
+      size_t send_size, int recv_peer, void* recv_data, size_t recv_size) = 0;
+
+  inline void Send(int peer, const void* data, size_t size) {
+    SendRecv(peer, data, size, -1, NULL, 0);
+  }
+  inline void Recv(int peer, void* data, size_t size) {
+    SendRecv(-1, NULL, 0, peer, data, size);
+  }
+  // Waits until one of peers has sent data, and returns it.
+  virtual int Poll(const vector<int>& peers) = 0;
+  // Closes the connections to all the peers, so that the ones waiting on this
+  // process, or next exchanging with it, fail rather than wait forever. For a
+  // process leaving the group early.
+  virtual void Abort() = 0;
+
+ protected:
+  const int rank_;
+  const int size_;
+  int timeout_;
+
+  DISABLE_COPY_AND_ASSIGN(Transport);
+};
+
+// Stream sockets between every pair of processes. The uri lists where each
+// rank listens, either "tcp://host0:port0,host1:port1,..." across machines,
+// or "unix:///path/prefix" for processes sharing a machine, rank r then
+// listening on the local socket /path/prefix.r. The constructor returns once
+// all the processes of the group are connected.
+class SocketTransport : public Transport {
+ public:
+  SocketTransport(const string& uri, int rank, int size);
+  virtual ~SocketTransport();
+
+  virtual void SendRecv(int send_peer, const void* send_data,
+      size_t send_size, int recv_peer, void* recv_data, size_t recv_size);
+  virtual int Poll(const vector<int>& peers);
+  virtual void Abort();
+
+ protected:
+  // Connected socket per peer, -1 for this process.
+  vector<int> sockets_;
+  // Where Poll starts looking for a ready peer, so that it serves them fairly.
+  int poll_start_;
+};
+
+// Creates the transport for uri, chosen by its scheme.
+Transport* GetTransport(const string& uri, int rank, int size);
+
+// Sums data over all the processes, leaving the result in each one. Uses a
+// ring all-reduce, so each process sends and receives about 2 * count
+// values whatever the number of processes.
+template <typename Dtype>
+void caffe_ring_allreduce(Transport* transport, const int count, Dtype* data);
+
+// Like caffe_ring_allreduce, but exchanging the values in the 16-bit format,
+// so that each process sends and receives about 2 * count 16-bit values.
+// Each hop decodes the partial sum it receives, adds its own values in full
+// precision, and encodes the result for the next one. The final sums are
+// rounded to the format in every process, so that they are identical.
+template <typename Dtype>
+void caffe_ring_allreduce_half(Transport* transport, const int count,
+    const HalfFormat format, Dtype* data);
+
+// Gathers the message of every process, of any size, in each one:
+// (*messages)[r] is the one of rank r.
+void caffe_ring_allgather(Transport* transport, const vector<char>& message,
+    vector<vector<char> >* messages);
+
+// Copies data from rank 0 to all the other processes, along the ring.
+template <typename Dtype>
+void caffe_ring_broadcast(Transport* transport, const int count, Dtype* data);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRANSPORT_HPP_
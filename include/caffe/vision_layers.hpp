@@ -1,6 +1,7 @@
 #ifndef CAFFE_VISION_LAYERS_HPP_
 #define CAFFE_VISION_LAYERS_HPP_
 
+#include <stdint.h>
 #include <string>
 #include <utility>
 #include <vector>
@@ -13,6 +14,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/layout.hpp"
 
 namespace caffe {
 
@@ -29,6 +31,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void ShareParamCaches(const Layer<Dtype>& other);
 
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
@@ -46,6 +49,19 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Quantizes the weights for forward_cpu_gemm_int8, unless they were
+  // already quantized since they last changed.
+  void quantize_weights();
+  // INT8 counterpart of forward_cpu_gemm: quantizes the input, multiplies it
+  // by the weights quantized by quantize_weights and dequantizes the integer
+  // result into output.
+  void forward_cpu_gemm_int8(const Dtype* input, Dtype* output);
+  // Counterpart of forward_cpu_gemm for weights held in 16-bit form.
+  void forward_cpu_gemm_half(const Dtype* input, const uint16_t* weights,
+      HalfFormat format, Dtype* output);
+  // Counterpart of forward_cpu_gemm for weights held in sparse form.
+  void forward_cpu_gemm_sparse(const Dtype* input,
+      const SparseMatrix<Dtype>& weights, Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -75,6 +91,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int height_out_, width_out_;
   bool bias_term_;
   bool is_1x1_;
+  // Whether the forward pass runs in INT8, as set by quantization_param.
+  bool quantized_;
+  // The channel block of the output layout (see Blob::channel_block).
+  int channel_block_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -107,8 +127,24 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int col_offset_;
   int output_offset_;
 
-  Blob<Dtype> col_buffer_;
+  // The im2col result of one image is held in the workspace of the thread
+  // (see Caffe::cpu_workspace), shared with the other layers.
+  inline Dtype* cpu_col_buffer() {
+    return static_cast<Dtype*>(
+        Caffe::cpu_workspace(col_buffer_count_ * sizeof(Dtype)));
+  }
+  inline Dtype* gpu_col_buffer() {
+    return static_cast<Dtype*>(
+        Caffe::gpu_workspace(col_buffer_count_ * sizeof(Dtype)));
+  }
+  int col_buffer_count_;
   Blob<Dtype> bias_multiplier_;
+
+  // INT8 inference state.
+  shared_ptr<QuantizedWeights<Dtype> > quantized_weights_;
+  Dtype input_scale_;
+  vector<int8_t> col_int8_;
+  vector<int32_t> output_int32_;
 };
 
 /**
@@ -160,8 +196,12 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
+  virtual void ShareParamCaches(const Layer<Dtype>& other);
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual inline bool ReadsCompactParam(int param_id) const {
+    return param_id == 0;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -174,6 +214,20 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+ private:
+  // Direct convolution of one item for blocked layouts: reads input in the
+  // NCHW[input_block]c layout and writes output in the NCHW[channel_block_]c
+  // layout, using the weights rearranged by block_weights.
+  void forward_cpu_blocked(const Dtype* input, const int input_block,
+      const Dtype* bias, Dtype* output);
+  // Rearranges the weights into blocked_weights_ as
+  // (num_output / channel_block_) x channels x kernel_h x kernel_w x
+  // channel_block_, so that the weights of one output block are contiguous,
+  // unless they are already rearranged from the current weights.
+  void block_weights();
+
+  shared_ptr<BlockedWeights<Dtype> > blocked_weights_;
 };
 
 /**
@@ -398,6 +452,13 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  /// Stochastic pooling draws the pooled locations anew at each training
+  /// pass.
+  virtual inline bool AllowRecompute() const {
+    return this->phase_ != TRAIN ||
+        this->layer_param_.pooling_param().pool() !=
+        PoolingParameter_PoolMethod_STOCHASTIC;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -408,6 +469,10 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // MAX or AVE pooling of a bottom in a blocked layout (see
+  // Blob::channel_block), vectorized over each block of channels.
+  void forward_cpu_blocked(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
@@ -36,6 +36,20 @@ const int NPY_DTYPE = NPY_FLOAT32;
 void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
 
+// Releases the GIL while in scope, so that other Python threads run while
+// nets and solvers compute, e.g. to preprocess the next inputs or to run other
+// nets. Python layers take it back, see PyGILAcquire.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+
+  DISABLE_COPY_AND_ASSIGN(ScopedGILRelease);
+};
+
 // For convenience, check that input files can be opened, and raise an
 // exception that boost will send to Python if not (caffe could still crash
 // later if the input files are disturbed before they are actually used, but
@@ -131,6 +145,31 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
       PyArray_DIMS(data_arr)[0]);
 }
 
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  net->BackwardFromTo(start, end);
+}
+
+void Net_Reshape(Net<Dtype>* net) {
+  ScopedGILRelease release;
+  net->Reshape();
+}
+
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  ScopedGILRelease release;
+  solver->Step(iters);
+}
+
+void Solver_Solve(Solver<Dtype>* solver, const char* resume_file = NULL) {
+  ScopedGILRelease release;
+  solver->Solve(resume_file);
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadProtoFromTextFileOrDie(filename, &param);
@@ -205,7 +244,7 @@ bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
+BOOST_PYTHON_FUNCTION_OVERLOADS(SolveOverloads, Solver_Solve, 1, 2);
 
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
@@ -221,9 +260,9 @@ BOOST_PYTHON_MODULE(_caffe) {
     bp::no_init)
     .def("__init__", bp::make_constructor(&Net_Init))
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
-    .def("reshape", &Net<Dtype>::Reshape)
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
+    .def("reshape", &Net_Reshape)
     // The cast is to select a particular overload.
     .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
         &Net<Dtype>::CopyTrainedLayersFrom))
@@ -283,9 +322,8 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("test_nets", bp::make_function(&Solver<Dtype>::test_nets,
           bp::return_internal_reference<>()))
     .add_property("iter", &Solver<Dtype>::iter)
-    .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
-          &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
+    .def("solve", &Solver_Solve, SolveOverloads())
+    .def("step", &Solver_Step)
     .def("restore", &Solver<Dtype>::Restore);
 
   bp::class_<SGDSolver<Dtype>, bp::bases<Solver<Dtype> >,
@@ -329,6 +367,9 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::class_<vector<bool> >("BoolVec")
     .def(bp::vector_indexing_suite<vector<bool> >());
 
+  // Python layers may take the GIL from threads started by nets.
+  PyEval_InitThreads();
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
@@ -1,6 +1,7 @@
 import unittest
 import tempfile
 import os
+import threading
 import six
 
 import caffe
@@ -105,6 +106,29 @@ class TestPythonLayer(unittest.TestCase):
             for d in blob.data.shape:
                 self.assertEqual(s, d)
 
+    def test_threads(self):
+        # The GIL is released while the nets run, and taken back by their
+        # Python layers.
+        net_file = python_net_file()
+        nets = [caffe.Net(net_file, caffe.TRAIN) for _ in range(3)]
+        os.remove(net_file)
+
+        def run(net, x):
+            net.blobs['data'].data[...] = x
+            for _ in range(10):
+                net.forward()
+                net.backward()
+
+        threads = [threading.Thread(target=run, args=(net, x))
+                   for x, net in enumerate(nets)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        for x, net in enumerate(nets):
+            for y in net.blobs['three'].data.flat:
+                self.assertEqual(y, 10**3 * x)
+
     def test_exception(self):
         net_file = exception_net_file()
         self.assertRaises(RuntimeError, caffe.Net, net_file, caffe.TEST)
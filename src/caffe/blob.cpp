@@ -4,6 +4,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -22,6 +23,9 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  if (shape != shape_) {
+    ++version_;
+  }
   count_ = 1;
   shape_.resize(shape.size());
   for (int i = 0; i < shape.size(); ++i) {
@@ -30,10 +34,46 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     count_ *= shape[i];
     shape_[i] = shape[i];
   }
+  if (half_data_ && half_data_->size() != count_ * sizeof(uint16_t)) {
+    half_data_.reset();
+  }
+  if (sparse_data_ && sparse_data_->rows * sparse_data_->cols != count_) {
+    sparse_data_.reset();
+  }
+  // The data of a blocked blob are not reordered, so it can only be reshaped
+  // to shapes the layout still applies to.
+  if (channel_block_ > 1) {
+    CHECK(shape_.size() == 4 && shape_[1] % channel_block_ == 0)
+        << "Reshaping a blob in a blocked layout to " << shape_string()
+        << ": set_channel_block(1) first.";
+  }
   if (count_ > capacity_) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_offset_ = 0;
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    diff_offset_ = 0;
+    ++version_;
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Reserve(const vector<int>& shape) {
+  CHECK_LE(shape.size(), kMaxBlobAxes);
+  int count = 1;
+  for (int i = 0; i < shape.size(); ++i) {
+    CHECK_GE(shape[i], 0);
+    CHECK_LE(shape[i], INT_MAX / count) << "blob size exceeds INT_MAX";
+    count *= shape[i];
+  }
+  if (count > capacity_) {
+    capacity_ = count;
+    DiscardCompact();
+    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_offset_ = 0;
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    diff_offset_ = 0;
+    ++version_;
   }
 }
 
@@ -56,81 +96,279 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : half_format_(FP16), data_offset_(0), diff_offset_(0), capacity_(0),
+    channel_block_(1), version_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : half_format_(FP16), data_offset_(0), diff_offset_(0), capacity_(0),
+    channel_block_(1), version_(0) {
   Reshape(shape);
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->cpu_data();
+  CheckExpanded();
+  return (const Dtype*)data_->cpu_data() + data_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  DiscardCompact();
+  if (data_offset_ != 0 || data_->size() != capacity_ * sizeof(Dtype)) {
+    // A view cannot point elsewhere without leaving the Blob it is part of.
+    caffe_copy(count_, data, mutable_cpu_data());
+    return;
+  }
   data_->set_cpu_data(data);
+  ++version_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_diff(Dtype* diff) {
+  CHECK(diff);
+  if (diff_offset_ != 0 || diff_->size() != capacity_ * sizeof(Dtype)) {
+    caffe_copy(count_, diff, mutable_cpu_diff());
+    return;
+  }
+  diff_->set_cpu_data(diff);
+  ++version_;
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->gpu_data();
+  CheckExpanded();
+  return (const Dtype*)data_->gpu_data() + data_offset_;
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->cpu_data();
+  return (const Dtype*)diff_->cpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->gpu_data();
+  return (const Dtype*)diff_->gpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_cpu_data());
+  Expand();
+  DiscardCompact();
+  return static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_gpu_data());
+  Expand();
+  DiscardCompact();
+  return static_cast<Dtype*>(data_->mutable_gpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_cpu_data());
+  return static_cast<Dtype*>(diff_->mutable_cpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_gpu_data());
+  return static_cast<Dtype*>(diff_->mutable_gpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  if (data_ != other.data_ || data_offset_ != other.data_offset_) {
+    ++version_;
+  }
   data_ = other.data();
+  data_offset_ = other.data_offset_;
+  // Share the compacted copies too, so that a compacted blob stays so.
+  half_data_ = other.half_data_;
+  half_format_ = other.half_format_;
+  sparse_data_ = other.sparse_data_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  if (diff_ != other.diff_ || diff_offset_ != other.diff_offset_) {
+    ++version_;
+  }
   diff_ = other.diff();
+  diff_offset_ = other.diff_offset_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::SwapData(Blob* other) {
+  CHECK_EQ(count_, other->count_);
+  CHECK(data_offset_ == 0 && other->data_offset_ == 0)
+      << "Cannot swap the data of views.";
+  CheckExpanded();
+  other->CheckExpanded();
+  data_->swap(other->data_.get());
+  ++version_;
+  ++other->version_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataView(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  if (!IsDataViewOf(other, offset)) {
+    ++version_;
+  }
+  data_ = other.data();
+  data_offset_ = other.data_offset_ + offset;
+  capacity_ = count_;
+  DiscardCompact();
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffView(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  if (!IsDiffViewOf(other, offset)) {
+    ++version_;
+  }
+  diff_ = other.diff();
+  diff_offset_ = other.diff_offset_ + offset;
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::IsDataViewOf(const Blob& other, int offset) const {
+  return data_ == other.data_ && data_offset_ == other.data_offset_ + offset;
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::IsDiffViewOf(const Blob& other, int offset) const {
+  return diff_ == other.diff_ && diff_offset_ == other.diff_offset_ + offset;
+}
+
+template <> void Blob<unsigned int>::DecodeCompact(unsigned int* data) const {
+  NOT_IMPLEMENTED;
+}
+
+template <> void Blob<int>::DecodeCompact(int* data) const {
+  NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::DecodeCompact(Dtype* data) const {
+  if (half_data_) {
+    caffe_cpu_from_half(count_, cpu_half_data(), half_format_, data);
+  } else {
+    caffe_cpu_csr_to_dense(*sparse_data_, data);
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ExpandData(Dtype* data) const {
+  if (is_half() || is_sparse()) {
+    DecodeCompact(data);
+  } else {
+    caffe_copy(count_, cpu_data(), data);
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Expand() {
+  if (is_half() || is_sparse()) {
+    DecodeCompact(
+        static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_);
+  }
+}
+
+template <>
+void Blob<unsigned int>::CompactToHalf(HalfFormat format) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void Blob<int>::CompactToHalf(HalfFormat format) {
+  NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::CompactToHalf(HalfFormat format) {
+  CHECK(data_);
+  CHECK(data_.use_count() == 1 && !data_->borrowed())
+      << "Cannot compact a blob that shares its data.";
+  // A 16-bit copy left from an earlier compaction is still valid, as writes
+  // discard it, so only the full precision copy needs releasing.
+  if (!half_data_ || half_format_ != format) {
+    Expand();
+    half_data_.reset();
+    // Encode into the storage of the last compaction, as activations are
+    // compacted every iteration, unless another blob still shares it.
+    const size_t half_size = count_ * sizeof(uint16_t);
+    if (!spare_half_data_ || spare_half_data_.use_count() > 1 ||
+        spare_half_data_->size() != half_size) {
+      spare_half_data_.reset(new SyncedMemory(half_size));
+    }
+    caffe_cpu_to_half(count_, cpu_data(), format,
+        static_cast<uint16_t*>(spare_half_data_->mutable_cpu_data()));
+    half_data_ = spare_half_data_;
+    half_format_ = format;
+  }
+  sparse_data_.reset();
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  data_offset_ = 0;
+  ++version_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ReleaseData() {
+  CHECK(data_);
+  CHECK(data_.use_count() == 1 && !data_->borrowed())
+      << "Cannot release the data of a blob that shares it.";
+  DiscardCompact();
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  data_offset_ = 0;
+  ++version_;
+}
+
+template <typename Dtype>
+const uint16_t* Blob<Dtype>::cpu_half_data() const {
+  CHECK(half_data_);
+  return static_cast<const uint16_t*>(half_data_->cpu_data());
+}
+
+template <> void Blob<unsigned int>::CompactToSparse() { NOT_IMPLEMENTED; }
+template <> void Blob<int>::CompactToSparse() { NOT_IMPLEMENTED; }
+
+template <typename Dtype>
+void Blob<Dtype>::CompactToSparse() {
+  CHECK(data_);
+  CHECK_GE(num_axes(), 1);
+  CHECK(data_.use_count() == 1 && !data_->borrowed())
+      << "Cannot compact a blob that shares its data.";
+  Expand();
+  shared_ptr<SparseMatrix<Dtype> > sparse_data(new SparseMatrix<Dtype>());
+  caffe_cpu_dense_to_csr(shape(0), count(1), cpu_data(), sparse_data.get());
+  sparse_data_ = sparse_data;
+  half_data_.reset();
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  data_offset_ = 0;
+  ++version_;
+}
+
+template <typename Dtype>
+const SparseMatrix<Dtype>& Blob<Dtype>::cpu_sparse_data() const {
+  CHECK(sparse_data_);
+  return *sparse_data_;
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -141,21 +379,23 @@ template <> void Blob<int>::Update() { NOT_IMPLEMENTED; }
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  Expand();
+  DiscardCompact();
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
     caffe_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->cpu_data()),
-        static_cast<Dtype*>(data_->mutable_cpu_data()));
+        static_cast<const Dtype*>(diff_->cpu_data()) + diff_offset_,
+        static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_);
     break;
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
 #ifndef CPU_ONLY
     // perform computation on GPU
     caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->gpu_data()),
-        static_cast<Dtype*>(data_->mutable_gpu_data()));
+        static_cast<const Dtype*>(diff_->gpu_data()) + diff_offset_,
+        static_cast<Dtype*>(data_->mutable_gpu_data()) + data_offset_);
 #else
     NO_GPU;
 #endif
@@ -178,6 +418,11 @@ template <> int Blob<int>::asum_data() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
+  if (is_half() || is_sparse()) {
+    vector<Dtype> data(count_);
+    ExpandData(&data[0]);
+    return caffe_cpu_asum(count_, &data[0]);
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
@@ -250,6 +495,11 @@ Dtype Blob<Dtype>::sumsq_data() const {
   Dtype sumsq;
   const Dtype* data;
   if (!data_) { return 0; }
+  if (is_half() || is_sparse()) {
+    vector<Dtype> expanded(count_);
+    ExpandData(&expanded[0]);
+    return caffe_cpu_dot(count_, &expanded[0], &expanded[0]);
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
@@ -321,6 +571,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
+  Expand();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
@@ -407,23 +658,32 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       LOG(FATAL) << "Trying to copy blobs of different sizes.";
     }
   }
+  if (!copy_diff) {
+    DiscardCompact();
+    if (source.is_half() || source.is_sparse()) {
+      // The compacted copy is only held on the CPU.
+      source.ExpandData(
+          static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_);
+      return;
+    }
+  }
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
       caffe_copy(count_, source.gpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_gpu_data()));
+          static_cast<Dtype*>(diff_->mutable_gpu_data()) + diff_offset_);
     } else {
       caffe_copy(count_, source.gpu_data(),
-          static_cast<Dtype*>(data_->mutable_gpu_data()));
+          static_cast<Dtype*>(data_->mutable_gpu_data()) + data_offset_);
     }
     break;
   case Caffe::CPU:
     if (copy_diff) {
       caffe_copy(count_, source.cpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_cpu_data()));
+          static_cast<Dtype*>(diff_->mutable_cpu_data()) + diff_offset_);
     } else {
       caffe_copy(count_, source.cpu_data(),
-          static_cast<Dtype*>(data_->mutable_cpu_data()));
+          static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_);
     }
     break;
   default:
@@ -455,14 +715,83 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
   // copy data
-  Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  // The compact forms replace the full precision storage, unless other blobs
+  // share it or it is part of a buffer such as Net::param_arena, which would
+  // not see them: the data are then decoded into it.
+  const bool data_replaceable = data_.use_count() == 1 && !data_->borrowed();
+  if (proto.has_half_data()) {
+    CHECK_EQ(count_ * sizeof(uint16_t), proto.half_data().size());
+    // A sparse copy of the previous data would be decoded instead.
+    DiscardCompact();
+    half_data_.reset(new SyncedMemory(count_ * sizeof(uint16_t)));
+    half_format_ = proto.half_format();
+    uint16_t* half_vec = static_cast<uint16_t*>(half_data_->mutable_cpu_data());
+    const unsigned char* bytes =
+        reinterpret_cast<const unsigned char*>(proto.half_data().data());
+    for (int i = 0; i < count_; ++i) {
+      half_vec[i] = bytes[2 * i] | (bytes[2 * i + 1] << 8);
+    }
+    if (data_replaceable) {
+      // Release the full precision storage; it is restored on demand.
+      data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+      data_offset_ = 0;
+      ++version_;
+    } else {
+      DecodeCompact(
+          static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_);
+      half_data_.reset();
+    }
+  } else if (proto.sparse_row_size() > 0) {
+    CHECK_GE(num_axes(), 1);
+    CHECK_EQ(shape(0) + 1, proto.sparse_row_size());
+    const int nnz = proto.sparse_col_size();
+    // The rows must tile [0, nnz) in order.
+    CHECK_EQ(0, proto.sparse_row(0));
+    for (int i = 0; i < shape(0); ++i) {
+      CHECK_LE(proto.sparse_row(i), proto.sparse_row(i + 1))
+          << "Decreasing sparse_row at row " << i;
+    }
+    CHECK_EQ(nnz, proto.sparse_row(shape(0)));
+    shared_ptr<SparseMatrix<Dtype> > sparse_data(new SparseMatrix<Dtype>());
+    sparse_data->rows = shape(0);
+    sparse_data->cols = count(1);
+    sparse_data->row_ptr.assign(proto.sparse_row().begin(),
+        proto.sparse_row().end());
+    sparse_data->col_idx.assign(proto.sparse_col().begin(),
+        proto.sparse_col().end());
+    for (int i = 0; i < nnz; ++i) {
+      CHECK_GE(sparse_data->col_idx[i], 0);
+      CHECK_LT(sparse_data->col_idx[i], sparse_data->cols);
+    }
+    if (proto.double_sparse_data_size() > 0) {
+      CHECK_EQ(nnz, proto.double_sparse_data_size());
+      sparse_data->values.assign(proto.double_sparse_data().begin(),
+          proto.double_sparse_data().end());
+    } else {
+      CHECK_EQ(nnz, proto.sparse_data_size());
+      sparse_data->values.assign(proto.sparse_data().begin(),
+          proto.sparse_data().end());
+    }
+    sparse_data_ = sparse_data;
+    half_data_.reset();
+    if (data_replaceable) {
+      data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+      data_offset_ = 0;
+      ++version_;
+    } else {
+      DecodeCompact(
+          static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_);
+      sparse_data_.reset();
+    }
+  } else if (proto.double_data_size() > 0) {
+    Dtype* data_vec = mutable_cpu_data();
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
     }
   } else {
     CHECK_EQ(count_, proto.data_size());
+    Dtype* data_vec = mutable_cpu_data();
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.data(i);
     }
@@ -482,6 +811,37 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
 }
 
+// Pack the 16-bit copy of the data into proto as little-endian values.
+template <typename Dtype>
+static void WriteHalfData(const Blob<Dtype>& blob, BlobProto* proto) {
+  const uint16_t* half_vec = blob.cpu_half_data();
+  string bytes(blob.count() * sizeof(uint16_t), 0);
+  for (int i = 0; i < blob.count(); ++i) {
+    bytes[2 * i] = half_vec[i] & 0xff;
+    bytes[2 * i + 1] = half_vec[i] >> 8;
+  }
+  proto->set_half_data(bytes);
+  proto->set_half_format(blob.half_format());
+}
+
+// Write the sparse copy of the data into proto, with double or float values.
+template <typename Dtype>
+static void WriteSparseData(const Blob<Dtype>& blob, bool write_double,
+    BlobProto* proto) {
+  const SparseMatrix<Dtype>& sparse = blob.cpu_sparse_data();
+  for (int i = 0; i < sparse.row_ptr.size(); ++i) {
+    proto->add_sparse_row(sparse.row_ptr[i]);
+  }
+  for (int k = 0; k < sparse.nnz(); ++k) {
+    proto->add_sparse_col(sparse.col_idx[k]);
+    if (write_double) {
+      proto->add_double_sparse_data(sparse.values[k]);
+    } else {
+      proto->add_sparse_data(sparse.values[k]);
+    }
+  }
+}
+
 template <>
 void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   proto->clear_shape();
@@ -490,9 +850,20 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
-  const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
+  proto->clear_half_data();
+  proto->clear_sparse_data();
+  proto->clear_double_sparse_data();
+  proto->clear_sparse_col();
+  proto->clear_sparse_row();
+  if (is_half()) {
+    WriteHalfData(*this, proto);
+  } else if (is_sparse()) {
+    WriteSparseData(*this, true, proto);
+  } else {
+    const double* data_vec = cpu_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_double_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const double* diff_vec = cpu_diff();
@@ -510,9 +881,20 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
-  const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
+  proto->clear_half_data();
+  proto->clear_sparse_data();
+  proto->clear_double_sparse_data();
+  proto->clear_sparse_col();
+  proto->clear_sparse_row();
+  if (is_half()) {
+    WriteHalfData(*this, proto);
+  } else if (is_sparse()) {
+    WriteSparseData(*this, false, proto);
+  } else {
+    const float* data_vec = cpu_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const float* diff_vec = cpu_diff();
@@ -5,6 +5,7 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -19,6 +20,23 @@ Caffe& Caffe::Get() {
   return *(thread_instance_.get());
 }
 
+void* Caffe::cpu_workspace(size_t size) {
+  shared_ptr<SyncedMemory>& workspace = Get().cpu_workspace_;
+  if (!workspace || workspace->size() < size) {
+    // Grown to the largest size asked, as the contents need not be kept.
+    workspace.reset(new SyncedMemory(size));
+  }
+  return workspace->mutable_cpu_data();
+}
+
+void* Caffe::gpu_workspace(size_t size) {
+  shared_ptr<SyncedMemory>& workspace = Get().gpu_workspace_;
+  if (!workspace || workspace->size() < size) {
+    workspace.reset(new SyncedMemory(size));
+  }
+  return workspace->mutable_gpu_data();
+}
+
 // random seeding
 int64_t cluster_seedgen(void) {
   int64_t s, seed, pid;
@@ -53,7 +71,8 @@ void GlobalInit(int* pargc, char*** pargv) {
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), root_solver_(true) { }
+      solver_count_(1), root_solver_(true), process_rank_(0),
+      process_count_(1) { }
 
 Caffe::~Caffe() { }
 
@@ -97,7 +116,8 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU), solver_count_(1), root_solver_(true) {
+    mode_(Caffe::CPU), solver_count_(1), root_solver_(true), process_rank_(0),
+    process_count_(1) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
@@ -41,7 +41,8 @@ DataReader::~DataReader() {
 
 //
 
-DataReader::QueuePair::QueuePair(int size) {
+DataReader::QueuePair::QueuePair(int size)
+    : free_(size, true), full_(size, true) {
   // Initialize the free queue with requested number of datums
   for (int i = 0; i < size; ++i) {
     free_.push(new Datum());
@@ -62,7 +63,9 @@ DataReader::QueuePair::~QueuePair() {
 
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      stride_(1),
+      offset_(0) {
   StartInternalThread();
 }
 
@@ -77,6 +80,13 @@ void DataReader::Body::InternalThreadEntry() {
   vector<shared_ptr<QueuePair> > qps;
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
+    // In distributed training, each process reads its own shard: every
+    // process_count-th record, starting from its rank.
+    if (param_.phase() == TRAIN) {
+      stride_ = Caffe::process_count();
+      offset_ = Caffe::process_rank();
+    }
+    seek_shard(cursor.get());
 
     // To ensure deterministic runs, only start running once all solvers
     // are ready. But solvers need to peek on one item during initialization,
@@ -108,11 +118,25 @@ void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   datum->ParseFromString(cursor->value());
   qp->full_.push(datum);
 
-  // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+  // Go to the next record of the shard. At the end of the source, the shard
+  // restarts from its own first record rather than wrapping the stride
+  // around, which would make the shards overlap in the following passes
+  // when the number of records is not a multiple of the stride.
+  for (int i = 0; i < stride_; ++i) {
+    cursor->Next();
+    if (!cursor->valid()) {
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      seek_shard(cursor);
+      return;
+    }
+  }
+}
+
+void DataReader::Body::seek_shard(db::Cursor* cursor) {
+  cursor->SeekToFirst();
+  for (int i = 0; i < offset_; ++i) {
+    cursor->Next();
+    CHECK(cursor->valid()) << "The source has fewer records than processes";
   }
 }
 
@@ -29,17 +29,19 @@ void InternalThread::StartInternalThread() {
   int rand_seed = caffe_rng_rand();
   int solver_count = Caffe::solver_count();
   bool root_solver = Caffe::root_solver();
+  int process_rank = Caffe::process_rank();
+  int process_count = Caffe::process_count();
 
   try {
     thread_.reset(new boost::thread(&InternalThread::entry, this, device, mode,
-          rand_seed, solver_count, root_solver));
+          rand_seed, solver_count, root_solver, process_rank, process_count));
   } catch (std::exception& e) {
     LOG(FATAL) << "Thread exception: " << e.what();
   }
 }
 
 void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
-    int solver_count, bool root_solver) {
+    int solver_count, bool root_solver, int process_rank, int process_count) {
 #ifndef CPU_ONLY
   CUDA_CHECK(cudaSetDevice(device));
 #endif
@@ -47,6 +49,7 @@ void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
   Caffe::set_random_seed(rand_seed);
   Caffe::set_solver_count(solver_count);
   Caffe::set_root_solver(root_solver);
+  Caffe::set_process_group(process_rank, process_count);
 
   InternalThreadEntry();
 }
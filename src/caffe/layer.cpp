@@ -1,4 +1,6 @@
 #include <boost/thread.hpp>
+#include <vector>
+
 #include "caffe/layer.hpp"
 
 namespace caffe {
@@ -22,6 +24,39 @@ void Layer<Dtype>::Unlock() {
   }
 }
 
+template <typename Dtype>
+bool Layer<Dtype>::BlobsChanged(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  const int num_blobs = bottom.size() + top.size();
+  bool changed = AlwaysReshape() || reshaped_blobs_.size() != num_blobs;
+  for (int i = 0; i < num_blobs && !changed; ++i) {
+    const Blob<Dtype>* blob =
+        i < bottom.size() ? bottom[i] : top[i - bottom.size()];
+    changed = blob != reshaped_blobs_[i] ||
+        blob->version() != reshaped_versions_[i];
+  }
+  return changed;
+}
+
+template <typename Dtype>
+bool Layer<Dtype>::ReshapeIfChanged(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (!BlobsChanged(bottom, top)) {
+    return false;
+  }
+  Reshape(bottom, top);
+  const int num_blobs = bottom.size() + top.size();
+  // Record the versions after Reshape, which changes the tops.
+  reshaped_blobs_.resize(num_blobs);
+  reshaped_versions_.resize(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) {
+    reshaped_blobs_[i] =
+        i < bottom.size() ? bottom[i] : top[i - bottom.size()];
+    reshaped_versions_[i] = reshaped_blobs_[i]->version();
+  }
+  return true;
+}
+
 INSTANTIATE_CLASS(Layer);
 
 }  // namespace caffe
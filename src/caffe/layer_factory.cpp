@@ -27,6 +27,15 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
     engine = ConvolutionParameter_Engine_CUDNN;
 #endif
   }
+  if (param.quantization_param().precision() ==
+      QuantizationParameter_Precision_INT8) {
+    // INT8 inference is only implemented by the Caffe engine.
+    engine = ConvolutionParameter_Engine_CAFFE;
+  }
+  if (param.convolution_param().channel_block() > 1) {
+    // So are blocked layouts.
+    engine = ConvolutionParameter_Engine_CAFFE;
+  }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
@@ -165,7 +174,14 @@ REGISTER_LAYER_CREATOR(TanH, GetTanHLayer);
 #ifdef WITH_PYTHON_LAYER
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPythonLayer(const LayerParameter& param) {
-  Py_Initialize();
+  if (!Py_IsInitialized()) {
+    // Outside of pycaffe, e.g. in the caffe tool. The GIL is released for
+    // the layers to take it from any thread.
+    Py_Initialize();
+    PyEval_InitThreads();
+    PyEval_SaveThread();
+  }
+  PyGILAcquire gil;
   try {
     bp::object module = bp::import(param.python_param().module().c_str());
     bp::object layer = module.attr(param.python_param().layer().c_str())(param);
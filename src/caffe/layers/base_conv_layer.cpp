@@ -2,8 +2,10 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -98,6 +100,30 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // Configure INT8 inference.
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  quantized_ = quant_param.precision() == QuantizationParameter_Precision_INT8;
+  quantized_weights_.reset();
+  if (quantized_) {
+    CHECK(!reverse_dimensions())
+        << "INT8 inference is not implemented for deconvolution.";
+    CHECK_EQ(this->phase_, TEST)
+        << "INT8 inference is only supported in the TEST phase.";
+    CHECK_GT(quant_param.input_range(), 0)
+        << "INT8 inference needs a calibrated input_range.";
+    input_scale_ = quant_param.input_range() / kInt8Max;
+  }
+  // Configure the output layout.
+  channel_block_ = conv_param.channel_block();
+  if (channel_block_ > 1) {
+    CHECK(!reverse_dimensions())
+        << "Blocked layouts are not implemented for deconvolution.";
+    CHECK_EQ(group_, 1) << "Blocked layouts need group = 1.";
+    CHECK(!quantized_) << "Blocked layouts are not implemented for INT8.";
+    CHECK_EQ(num_output_ % channel_block_, 0)
+        << "The channel block must divide num_output.";
+  }
 }
 
 template <typename Dtype>
@@ -111,6 +137,12 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(bottom[0]->channels(), channels_) << "Input size incompatible with"
     " convolution kernel.";
   // TODO: generalize to handle inputs of different shapes.
+  for (int bottom_id = 0; bottom_id < bottom.size(); ++bottom_id) {
+    if (bottom[bottom_id]->channel_block() > 1) {
+      CHECK(!reverse_dimensions() && group_ == 1 && !quantized_)
+          << "Only ungrouped convolution takes inputs in blocked layouts.";
+    }
+  }
   for (int bottom_id = 1; bottom_id < bottom.size(); ++bottom_id) {
     CHECK_EQ(num_, bottom[bottom_id]->num()) << "Inputs must have same num.";
     CHECK_EQ(channels_, bottom[bottom_id]->channels())
@@ -124,6 +156,7 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   compute_output_shape();
   for (int top_id = 0; top_id < top.size(); ++top_id) {
     top[top_id]->Reshape(num_, num_output_, height_out_, width_out_);
+    top[top_id]->set_channel_block(channel_block_);
   }
   if (reverse_dimensions()) {
     conv_in_height_ = height_out_;
@@ -142,9 +175,9 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   // overly large memory usage. In the special case of 1x1 convolution
   // it goes lazily unused to save memory.
   if (reverse_dimensions()) {
-    col_buffer_.Reshape(1, kernel_dim_, height_, width_);
+    col_buffer_count_ = kernel_dim_ * height_ * width_;
   } else {
-    col_buffer_.Reshape(1, kernel_dim_, height_out_, width_out_);
+    col_buffer_count_ = kernel_dim_ * height_out_ * width_out_;
   }
   // Set up the all ones "bias multiplier" for adding biases by BLAS
   if (bias_term_) {
@@ -160,10 +193,11 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    Dtype* col_buffer = cpu_col_buffer();
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -173,6 +207,77 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::ShareParamCaches(const Layer<Dtype>& other) {
+  quantized_weights_ =
+      static_cast<const BaseConvolutionLayer&>(other).quantized_weights_;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::quantize_weights() {
+  QuantizeWeights(*this->blobs_[0], conv_out_channels_,
+      this->layer_param_.quantization_param().per_channel(), input_scale_,
+      &quantized_weights_);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_int8(const Dtype* input,
+    Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    Dtype* col_buffer = cpu_col_buffer();
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
+  }
+  col_int8_.resize(col_offset_ * group_);
+  output_int32_.resize(output_offset_ * group_);
+  caffe_cpu_quantize(col_offset_ * group_, col_buff, input_scale_,
+      &col_int8_[0]);
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_s8(CblasNoTrans, conv_out_channels_ / group_,
+        conv_out_spatial_dim_, kernel_dim_ / group_,
+        &quantized_weights_->values[0] + weight_offset_ * g,
+        &col_int8_[0] + col_offset_ * g,
+        &output_int32_[0] + output_offset_ * g);
+  }
+  caffe_cpu_dequantize(conv_out_channels_, conv_out_spatial_dim_,
+      &output_int32_[0], &quantized_weights_->scales[0], true, output);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_half(const Dtype* input,
+    const uint16_t* weights, HalfFormat format, Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    Dtype* col_buffer = cpu_col_buffer();
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_half_a<Dtype>(CblasNoTrans, conv_out_channels_ / group_,
+        conv_out_spatial_dim_, kernel_dim_ / group_, (Dtype)1.,
+        weights + weight_offset_ * g, format, col_buff + col_offset_ * g,
+        (Dtype)0., output + output_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_sparse(const Dtype* input,
+    const SparseMatrix<Dtype>& weights, Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    Dtype* col_buffer = cpu_col_buffer();
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
+  }
+  const int group_out_channels = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_csrmm<Dtype>(group_out_channels * g, group_out_channels,
+        conv_out_spatial_dim_, (Dtype)1., weights, col_buff + col_offset_ * g,
+        (Dtype)0., output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -184,9 +289,9 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    col_buff = cpu_col_buffer();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_ / group_,
@@ -204,8 +309,9 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    Dtype* col_buffer = cpu_col_buffer();
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -229,10 +335,11 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    Dtype* col_buffer = gpu_col_buffer();
     if (!skip_im2col) {
-      conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
+      conv_im2col_gpu(input, col_buffer);
     }
-    col_buff = col_buffer_.gpu_data();
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -253,9 +360,9 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_gpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    col_buff = gpu_col_buffer();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_ / group_,
@@ -273,8 +380,9 @@ void BaseConvolutionLayer<Dtype>::weight_gpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
-    col_buff = col_buffer_.gpu_data();
+    Dtype* col_buffer = gpu_col_buffer();
+    conv_im2col_gpu(input, col_buffer);
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
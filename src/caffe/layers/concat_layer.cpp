@@ -51,6 +51,60 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bottom.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else if (concat_param.view_bottoms() && num_concats_ == 1) {
+    ViewBottoms(bottom, top);
+  }
+}
+
+template <typename Dtype>
+void ConcatLayer<Dtype>::ViewBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  int offset = 0;
+  bool viewed = true;
+  for (int i = 0; i < bottom.size(); ++i) {
+    viewed = viewed && bottom[i]->IsDataViewOf(*top[0], offset) &&
+        bottom[i]->IsDiffViewOf(*top[0], offset);
+    offset += bottom[i]->count();
+  }
+  if (viewed) { return; }
+  // Some bottoms were reshaped, and the parts have moved: lay them out again
+  // in new storage. Bottoms sharing their storage with blobs outside of this
+  // layer are left alone.
+  vector<bool> owned(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    int data_users = 0;
+    int diff_users = 0;
+    for (int j = 0; j <= bottom.size(); ++j) {
+      const Blob<Dtype>* blob = j < bottom.size() ? bottom[j] : top[0];
+      data_users += blob->data() == bottom[i]->data();
+      diff_users += blob->diff() == bottom[i]->diff();
+    }
+    owned[i] = bottom[i]->data().use_count() == data_users &&
+        bottom[i]->diff().use_count() == diff_users;
+  }
+  Blob<Dtype> storage(top[0]->shape());
+  top[0]->ShareDataView(storage, 0);
+  top[0]->ShareDiffView(storage, 0);
+  offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    Blob<Dtype>* blob = bottom[i];
+    if (owned[i]) {
+      switch (Caffe::mode()) {
+      case Caffe::CPU:
+        caffe_copy(blob->count(), blob->cpu_data(),
+            top[0]->mutable_cpu_data() + offset);
+        break;
+      case Caffe::GPU:
+        caffe_copy(blob->count(), blob->gpu_data(),
+            top[0]->mutable_gpu_data() + offset);
+        break;
+      default:
+        LOG(FATAL) << "Unknown caffe mode.";
+      }
+      blob->ShareDataView(*top[0], offset);
+      blob->ShareDiffView(*top[0], offset);
+    }
+    offset += blob->count();
   }
 }
 
@@ -64,6 +118,11 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    if (bottom[i]->IsDataViewOf(*top[0],
+        offset_concat_axis * concat_input_size_)) {
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
     for (int n = 0; n < num_concats_; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
           bottom_data + n * bottom_concat_axis * concat_input_size_,
@@ -83,7 +142,8 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    if (propagate_down[i]) {
+    if (propagate_down[i] && !bottom[i]->IsDiffViewOf(*top[0],
+        offset_concat_axis * concat_input_size_)) {
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
       for (int n = 0; n < num_concats_; ++n) {
         caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
@@ -1,8 +1,10 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/layout.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
@@ -16,16 +18,135 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
       / this->stride_w_ + 1;
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ShareParamCaches(const Layer<Dtype>& other) {
+  BaseConvolutionLayer<Dtype>::ShareParamCaches(other);
+  blocked_weights_ =
+      static_cast<const ConvolutionLayer&>(other).blocked_weights_;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::block_weights() {
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  if (blocked_weights_ && blocked_weights_->version == weight.data_version()) {
+    return;
+  }
+  const int block = this->channel_block_;
+  const int kernel_dim = this->channels_ * this->kernel_h_ * this->kernel_w_;
+  // The blocked weights are replaced rather than updated, as they may be
+  // shared with other instances of the layer.
+  shared_ptr<BlockedWeights<Dtype> > blocked(new BlockedWeights<Dtype>());
+  blocked->version = weight.data_version();
+  blocked->values.resize(this->num_output_ * kernel_dim);
+  // The weights may be compacted.
+  vector<Dtype> weights(weight.count());
+  weight.ExpandData(&weights[0]);
+  for (int o = 0; o < this->num_output_; ++o) {
+    for (int k = 0; k < kernel_dim; ++k) {
+      blocked->values[((o / block) * kernel_dim + k) * block + o % block] =
+          weights[o * kernel_dim + k];
+    }
+  }
+  blocked_weights_ = blocked;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_blocked(const Dtype* input,
+    const int input_block, const Dtype* bias, Dtype* output) {
+  const int block = this->channel_block_;
+  const int height = this->height_;
+  const int width = this->width_;
+  const int height_out = this->height_out_;
+  const int width_out = this->width_out_;
+  const int stride_h = this->stride_h_;
+  const int stride_w = this->stride_w_;
+  const int pad_h = this->pad_h_;
+  const int pad_w = this->pad_w_;
+  const int out_spatial_dim = height_out * width_out;
+  const Dtype* weight = &blocked_weights_->values[0];
+  for (int ob = 0; ob < this->num_output_ / block; ++ob) {
+    Dtype* out = output + ob * out_spatial_dim * block;
+    if (bias) {
+      for (int p = 0; p < out_spatial_dim; ++p) {
+        caffe_copy(block, bias + ob * block, out + p * block);
+      }
+    } else {
+      caffe_set(out_spatial_dim * block, Dtype(0), out);
+    }
+    // Accumulate one input channel and kernel tap at a time into the whole
+    // output block, so that the innermost loop runs over the block of output
+    // channels, contiguous in both the weights and the output.
+    for (int c = 0; c < this->channels_; ++c) {
+      const Dtype* in = input +
+          channel_block_offset(height * width, input_block, c, 0);
+      for (int kh = 0; kh < this->kernel_h_; ++kh) {
+        for (int kw = 0; kw < this->kernel_w_; ++kw) {
+          const Dtype* w = weight +
+              (((ob * this->channels_ + c) * this->kernel_h_ + kh) *
+              this->kernel_w_ + kw) * block;
+          // Output columns whose input column falls inside the image.
+          const int ow_begin = kw >= pad_w ? 0 :
+              (pad_w - kw + stride_w - 1) / stride_w;
+          const int ow_end = width - 1 + pad_w - kw < 0 ? 0 :
+              std::min(width_out, (width - 1 + pad_w - kw) / stride_w + 1);
+          for (int oh = 0; oh < height_out; ++oh) {
+            const int ih = oh * stride_h - pad_h + kh;
+            if (ih < 0 || ih >= height) {
+              continue;
+            }
+            const Dtype* in_row = in + ih * width * input_block;
+            Dtype* out_row = out + oh * width_out * block;
+            for (int ow = ow_begin; ow < ow_end; ++ow) {
+              const Dtype x =
+                  in_row[(ow * stride_w - pad_w + kw) * input_block];
+              Dtype* o = out_row + ow * block;
+              for (int b = 0; b < block; ++b) {
+                o[b] += x * w[b];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  if (this->quantized_) {
+    this->quantize_weights();
+  }
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+    const int input_block = bottom[i]->channel_block();
+    if (this->channel_block_ > 1 || input_block > 1) {
+      block_weights();
+      const Dtype* bias =
+          this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+      for (int n = 0; n < this->num_; ++n) {
+        forward_cpu_blocked(bottom_data + bottom[i]->offset(n), input_block,
+            bias, top_data + top[i]->offset(n));
+      }
+      continue;
+    }
     for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + bottom[i]->offset(n), weight,
-          top_data + top[i]->offset(n));
+      if (this->quantized_) {
+        this->forward_cpu_gemm_int8(bottom_data + bottom[i]->offset(n),
+            top_data + top[i]->offset(n));
+      } else if (weight.is_half()) {
+        this->forward_cpu_gemm_half(bottom_data + bottom[i]->offset(n),
+            weight.cpu_half_data(), weight.half_format(),
+            top_data + top[i]->offset(n));
+      } else if (weight.is_sparse()) {
+        this->forward_cpu_gemm_sparse(bottom_data + bottom[i]->offset(n),
+            weight.cpu_sparse_data(), top_data + top[i]->offset(n));
+      } else {
+        this->forward_cpu_gemm(bottom_data + bottom[i]->offset(n),
+            weight.cpu_data(), top_data + top[i]->offset(n));
+      }
       if (this->bias_term_) {
         const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + top[i]->offset(n), bias);
@@ -40,6 +161,8 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
+    CHECK(top[i]->channel_block() == 1 && bottom[i]->channel_block() == 1)
+        << "Backward is not implemented for blocked layouts.";
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
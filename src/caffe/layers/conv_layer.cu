@@ -11,6 +11,14 @@ namespace caffe {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (this->quantized_ || this->channel_block_ > 1 ||
+      bottom[0]->channel_block() > 1) {
+    // INT8 inference and blocked layouts only have CPU implementations.
+    Forward_cpu(bottom, top);
+    return;
+  }
+  // The compacted forms of the weights are only read on the CPU.
+  this->blobs_[0]->Expand();
   const Dtype* weight = this->blobs_[0]->gpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->gpu_data();
@@ -33,8 +33,11 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   for (int i = 1; i < bottom.size(); ++i) {
     CHECK(bottom[i]->shape() == bottom[0]->shape());
+    CHECK_EQ(bottom[i]->channel_block(), bottom[0]->channel_block())
+        << "Inputs must have the same layout.";
   }
   top[0]->ReshapeLike(*bottom[0]);
+  top[0]->set_channel_block(bottom[0]->channel_block());
   // If max operation, we will initialize the vector index part.
   if (this->layer_param_.eltwise_param().operation() ==
       EltwiseParameter_EltwiseOp_MAX && top.size() == 1) {
@@ -4,7 +4,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -49,6 +51,18 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // Configure INT8 inference.
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  quantized_ = quant_param.precision() == QuantizationParameter_Precision_INT8;
+  quantized_weights_.reset();
+  if (quantized_) {
+    CHECK_EQ(this->phase_, TEST)
+        << "INT8 inference is only supported in the TEST phase.";
+    CHECK_GT(quant_param.input_range(), 0)
+        << "INT8 inference needs a calibrated input_range.";
+    input_scale_ = quant_param.input_range() / kInt8Max;
+  }
 }
 
 template <typename Dtype>
@@ -77,14 +91,39 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ShareParamCaches(const Layer<Dtype>& other) {
+  quantized_weights_ =
+      static_cast<const InnerProductLayer&>(other).quantized_weights_;
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  if (quantized_) {
+    QuantizeWeights(weight, N_,
+        this->layer_param_.quantization_param().per_channel(), input_scale_,
+        &quantized_weights_);
+    bottom_int8_.resize(M_ * K_);
+    top_int32_.resize(M_ * N_);
+    caffe_cpu_quantize(M_ * K_, bottom_data, input_scale_, &bottom_int8_[0]);
+    caffe_cpu_gemm_s8(CblasTrans, M_, N_, K_, &bottom_int8_[0],
+        &quantized_weights_->values[0], &top_int32_[0]);
+    caffe_cpu_dequantize(M_, N_, &top_int32_[0], &quantized_weights_->scales[0],
+        false, top_data);
+  } else if (weight.is_half()) {
+    caffe_cpu_gemm_half_bt<Dtype>(M_, N_, K_, (Dtype)1., bottom_data,
+        weight.cpu_half_data(), weight.half_format(), (Dtype)0., top_data);
+  } else if (weight.is_sparse()) {
+    caffe_cpu_gemm_csr_bt<Dtype>(M_, (Dtype)1., bottom_data,
+        weight.cpu_sparse_data(), (Dtype)0., top_data);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
+        bottom_data, weight.cpu_data(), (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
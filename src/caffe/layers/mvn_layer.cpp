@@ -16,8 +16,6 @@ void MVNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       1, 1);
   variance_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       1, 1);
-  temp_.Reshape(bottom[0]->num(), bottom[0]->channels(),
-      bottom[0]->height(), bottom[0]->width());
   if ( this->layer_param_.mvn_param().across_channels() ) {
     sum_multiplier_.Reshape(1, bottom[0]->channels(), bottom[0]->height(),
                             bottom[0]->width());
@@ -33,6 +31,9 @@ template <typename Dtype>
 void MVNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
+  // The temporaries are held in the workspace shared by the layers.
+  Dtype* temp_data = static_cast<Dtype*>(
+      Caffe::cpu_workspace(bottom[0]->count() * sizeof(Dtype)));
   Dtype* top_data = top[0]->mutable_cpu_data();
   int num;
   if (this->layer_param_.mvn_param().across_channels())
@@ -43,28 +44,28 @@ void MVNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int dim = bottom[0]->count() / num;
 
   if (this->layer_param_.mvn_param().normalize_variance()) {
-    // put the squares of bottom into temp_
+    // put the squares of bottom into temp_data
     caffe_powx(bottom[0]->count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
+        temp_data);
 
     // computes variance using var(X) = E(X^2) - (EX)^2
     caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
         sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_.cpu_data(),
+    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_data,
         sum_multiplier_.cpu_data(), 0.,
         variance_.mutable_cpu_data());  // E(X^2)
     caffe_powx(mean_.count(), mean_.cpu_data(), Dtype(2),
-        temp_.mutable_cpu_data());  // (EX)^2
-    caffe_sub(mean_.count(), variance_.cpu_data(), temp_.cpu_data(),
+        temp_data);  // (EX)^2
+    caffe_sub(mean_.count(), variance_.cpu_data(), temp_data,
         variance_.mutable_cpu_data());  // variance
 
     // do mean and variance normalization
     // subtract mean
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
             mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-            temp_.mutable_cpu_data());
+            temp_data);
 
-    caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);
+    caffe_add(bottom[0]->count(), bottom_data, temp_data, top_data);
 
     // normalize variance
     caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
@@ -74,9 +75,9 @@ void MVNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
           variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          temp_.mutable_cpu_data());
+          temp_data);
 
-    caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
+    caffe_div(bottom[0]->count(), top_data, temp_data, top_data);
   } else {
     caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
             sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
@@ -84,9 +85,9 @@ void MVNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     // subtract mean
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
             mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-            temp_.mutable_cpu_data());
+            temp_data);
 
-    caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);
+    caffe_add(bottom[0]->count(), bottom_data, temp_data, top_data);
   }
 }
 
@@ -97,6 +98,9 @@ void MVNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->cpu_diff();
   const Dtype* top_data = top[0]->cpu_data();
   const Dtype* bottom_data = bottom[0]->cpu_data();
+  // The temporaries are held in the workspace shared by the layers.
+  Dtype* temp_data = static_cast<Dtype*>(
+      Caffe::cpu_workspace(bottom[0]->count() * sizeof(Dtype)));
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
 
   int num;
@@ -108,13 +112,13 @@ void MVNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   int dim = bottom[0]->count() / num;
 
   if (this->layer_param_.mvn_param().normalize_variance()) {
-    caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
+    caffe_mul(bottom[0]->count(), top_data, top_diff, bottom_diff);
     caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., bottom_diff,
           sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
           mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
           bottom_diff);
-    caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
+    caffe_mul(bottom[0]->count(), top_data, bottom_diff, bottom_diff);
 
     caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., top_diff,
             sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
@@ -122,24 +126,24 @@ void MVNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
             mean_.cpu_data(), sum_multiplier_.cpu_data(), 1.,
             bottom_diff);
 
-    caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff, Dtype(-1. / dim),
+    caffe_cpu_axpby(bottom[0]->count(), Dtype(1), top_diff, Dtype(-1. / dim),
         bottom_diff);
 
-    // put the squares of bottom into temp_
-    caffe_powx(temp_.count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
+    // put the squares of bottom into temp_data
+    caffe_powx(bottom[0]->count(), bottom_data, Dtype(2),
+        temp_data);
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
         variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-        temp_.mutable_cpu_data());
+        temp_data);
 
-    caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
+    caffe_div(bottom[0]->count(), bottom_diff, temp_data, bottom_diff);
   } else {
     caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, top_diff,
       sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
       mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-      temp_.mutable_cpu_data());
-    caffe_add(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
+      temp_data);
+    caffe_add(bottom[0]->count(), top_diff, temp_data, bottom_diff);
   }
 }
 
@@ -11,6 +11,9 @@ template <typename Dtype>
 void MVNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->gpu_data();
+  // The temporaries are held in the workspace shared by the layers.
+  Dtype* temp_data = static_cast<Dtype*>(
+      Caffe::gpu_workspace(bottom[0]->count() * sizeof(Dtype)));
   Dtype* top_data = top[0]->mutable_gpu_data();
   int num;
   if (this->layer_param_.mvn_param().across_channels())
@@ -21,28 +24,28 @@ void MVNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   int dim = bottom[0]->count() / num;
 
   if (this->layer_param_.mvn_param().normalize_variance()) {
-    // put the squares of bottom into temp_
+    // put the squares of bottom into temp_data
     caffe_gpu_powx(bottom[0]->count(), bottom_data, Dtype(2),
-        temp_.mutable_gpu_data());
+        temp_data);
 
     // computes variance using var(X) = E(X^2) - (EX)^2
     caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
         sum_multiplier_.gpu_data(), 0., mean_.mutable_gpu_data());  // EX
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_.gpu_data(),
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_data,
         sum_multiplier_.gpu_data(), 0.,
         variance_.mutable_gpu_data());  // E(X^2)
     caffe_gpu_powx(mean_.count(), mean_.gpu_data(), Dtype(2),
-        temp_.mutable_gpu_data());  // (EX)^2
-    caffe_gpu_sub(mean_.count(), variance_.gpu_data(), temp_.gpu_data(),
+        temp_data);  // (EX)^2
+    caffe_gpu_sub(mean_.count(), variance_.gpu_data(), temp_data,
         variance_.mutable_gpu_data());  // variance
 
     // do mean and variance normalization
     // subtract mean
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
             mean_.gpu_data(), sum_multiplier_.gpu_data(), 0.,
-            temp_.mutable_gpu_data());
+            temp_data);
 
-    caffe_gpu_add(temp_.count(), bottom_data, temp_.gpu_data(), top_data);
+    caffe_gpu_add(bottom[0]->count(), bottom_data, temp_data, top_data);
 
     // normalize variance
     caffe_gpu_powx(variance_.count(), variance_.gpu_data(), Dtype(0.5),
@@ -52,9 +55,9 @@ void MVNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
           variance_.gpu_data(), sum_multiplier_.gpu_data(), 0.,
-          temp_.mutable_gpu_data());
+          temp_data);
 
-    caffe_gpu_div(temp_.count(), top_data, temp_.gpu_data(), top_data);
+    caffe_gpu_div(bottom[0]->count(), top_data, temp_data, top_data);
   } else {
     caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
             sum_multiplier_.gpu_data(), 0., mean_.mutable_gpu_data());  // EX
@@ -62,9 +65,9 @@ void MVNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     // subtract mean
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
             mean_.gpu_data(), sum_multiplier_.gpu_data(), 0.,
-            temp_.mutable_gpu_data());
+            temp_data);
 
-    caffe_gpu_add(temp_.count(), bottom_data, temp_.gpu_data(), top_data);
+    caffe_gpu_add(bottom[0]->count(), bottom_data, temp_data, top_data);
   }
 }
 
@@ -75,6 +78,9 @@ void MVNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->gpu_diff();
   const Dtype* top_data = top[0]->gpu_data();
   const Dtype* bottom_data = bottom[0]->gpu_data();
+  // The temporaries are held in the workspace shared by the layers.
+  Dtype* temp_data = static_cast<Dtype*>(
+      Caffe::gpu_workspace(bottom[0]->count() * sizeof(Dtype)));
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
 
   int num;
@@ -86,13 +92,13 @@ void MVNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   int dim = bottom[0]->count() / num;
 
   if (this->layer_param_.mvn_param().normalize_variance()) {
-    caffe_gpu_mul(temp_.count(), top_data, top_diff, bottom_diff);
+    caffe_gpu_mul(bottom[0]->count(), top_data, top_diff, bottom_diff);
     caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., bottom_diff,
           sum_multiplier_.gpu_data(), 0., mean_.mutable_gpu_data());
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
           mean_.gpu_data(), sum_multiplier_.gpu_data(), 0.,
           bottom_diff);
-    caffe_gpu_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
+    caffe_gpu_mul(bottom[0]->count(), top_data, bottom_diff, bottom_diff);
 
     caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., top_diff,
             sum_multiplier_.gpu_data(), 0., mean_.mutable_gpu_data());
@@ -100,25 +106,25 @@ void MVNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
             mean_.gpu_data(), sum_multiplier_.gpu_data(), 1.,
             bottom_diff);
 
-    caffe_gpu_axpby(temp_.count(), Dtype(1), top_diff, Dtype(-1. / dim),
+    caffe_gpu_axpby(bottom[0]->count(), Dtype(1), top_diff, Dtype(-1. / dim),
         bottom_diff);
 
-    // put the squares of bottom into temp_
-    caffe_gpu_powx(temp_.count(), bottom_data, Dtype(2),
-        temp_.mutable_gpu_data());
+    // put the squares of bottom into temp_data
+    caffe_gpu_powx(bottom[0]->count(), bottom_data, Dtype(2),
+        temp_data);
 
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
         variance_.gpu_data(), sum_multiplier_.gpu_data(), 0.,
-        temp_.mutable_gpu_data());
+        temp_data);
 
-    caffe_gpu_div(temp_.count(), bottom_diff, temp_.gpu_data(), bottom_diff);
+    caffe_gpu_div(bottom[0]->count(), bottom_diff, temp_data, bottom_diff);
   } else {
     caffe_gpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, top_diff,
             sum_multiplier_.gpu_data(), 0., mean_.mutable_gpu_data());
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
             mean_.gpu_data(), sum_multiplier_.gpu_data(), 0.,
-            temp_.mutable_gpu_data());
-    caffe_gpu_add(temp_.count(), top_diff, temp_.gpu_data(), bottom_diff);
+            temp_data);
+    caffe_gpu_add(bottom[0]->count(), top_diff, temp_data, bottom_diff);
   }
 }
 
@@ -9,6 +9,8 @@ template <typename Dtype>
 void NeuronLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   top[0]->ReshapeLike(*bottom[0]);
+  // Elementwise layers work in any layout.
+  top[0]->set_channel_block(bottom[0]->channel_block());
 }
 
 INSTANTIATE_CLASS(NeuronLayer);
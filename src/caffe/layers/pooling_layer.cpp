@@ -108,6 +108,13 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
+  if (bottom[0]->channel_block() > 1) {
+    CHECK(this->layer_param_.pooling_param().pool() !=
+        PoolingParameter_PoolMethod_STOCHASTIC && top.size() == 1)
+        << "Blocked layouts are only supported by MAX and AVE pooling "
+        << "without a mask.";
+  }
+  top[0]->set_channel_block(bottom[0]->channel_block());
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
@@ -130,6 +137,10 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (bottom[0]->channel_block() > 1) {
+    forward_cpu_blocked(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int top_count = top[0]->count();
@@ -229,12 +240,63 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_blocked(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int block = bottom[0]->channel_block();
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int num_blocks = bottom[0]->num() * channels_ / block;
+  for (int cb = 0; cb < num_blocks; ++cb) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        Dtype* out = top_data + (ph * pooled_width_ + pw) * block;
+        caffe_set(block, max_pool ? Dtype(-FLT_MAX) : Dtype(0), out);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype* in = bottom_data + (h * width_ + w) * block;
+            if (max_pool) {
+              for (int b = 0; b < block; ++b) {
+                out[b] = max(out[b], in[b]);
+              }
+            } else {
+              for (int b = 0; b < block; ++b) {
+                out[b] += in[b];
+              }
+            }
+          }
+        }
+        if (!max_pool) {
+          for (int b = 0; b < block; ++b) {
+            out[b] /= pool_size;
+          }
+        }
+      }
+    }
+    bottom_data += height_ * width_ * block;
+    top_data += pooled_height_ * pooled_width_ * block;
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) {
     return;
   }
+  CHECK_EQ(bottom[0]->channel_block(), 1)
+      << "Backward is not implemented for blocked layouts.";
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   // Different pooling methods. We explicitly do the switch outside the for
@@ -55,6 +55,8 @@ void PReLULayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom[0]->num_axes(), 2)
       << "Number of axes of bottom blob must be >=2.";
+  CHECK_EQ(bottom[0]->channel_block(), 1)
+      << "PReLU does not support blocked layouts.";
   top[0]->ReshapeLike(*bottom[0]);
   if (bottom[0] == top[0]) {
     // For in-place computation
@@ -0,0 +1,47 @@
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/layout.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  channel_block_ = this->layer_param_.reorder_param().channel_block();
+  CHECK_GE(channel_block_, 1);
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
+      << "corresponding to (num, channels, height, width)";
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  top[0]->ReshapeLike(*bottom[0]);
+  top[0]->set_channel_block(channel_block_);
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  caffe_cpu_change_channel_block(bottom[0]->num(), bottom[0]->channels(),
+      bottom[0]->count(2), bottom[0]->channel_block(), channel_block_,
+      bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  caffe_cpu_change_channel_block(bottom[0]->num(), bottom[0]->channels(),
+      bottom[0]->count(2), channel_block_, bottom[0]->channel_block(),
+      top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+}
+
+INSTANTIATE_CLASS(ReorderLayer);
+REGISTER_LAYER_CLASS(Reorder);
+
+}  // namespace caffe
@@ -70,6 +70,17 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else if (slice_param.view_tops() && num_slices_ == 1) {
+    int offset = 0;
+    for (int i = 0; i < top.size(); ++i) {
+      if (!top[i]->IsDataViewOf(*bottom[0], offset)) {
+        top[i]->ShareDataView(*bottom[0], offset);
+      }
+      if (!top[i]->IsDiffViewOf(*bottom[0], offset)) {
+        top[i]->ShareDiffView(*bottom[0], offset);
+      }
+      offset += top[i]->count();
+    }
   }
 }
 
@@ -81,8 +92,12 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (top[i]->IsDataViewOf(*bottom[0], offset_slice_axis * slice_size_)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
+    Dtype* top_data = top[i]->mutable_cpu_data();
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -102,8 +117,12 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (top[i]->IsDiffViewOf(*bottom[0], offset_slice_axis * slice_size_)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
+    const Dtype* top_diff = top[i]->cpu_diff();
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -6,14 +6,6 @@
 
 namespace caffe {
 
-template <typename Dtype>
-void SplitLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
-  for (int i = 0; i < top.size(); ++i) {
-    top[i]->ShareData(*bottom[0]);
-  }
-}
-
 template <typename Dtype>
 void SplitLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -33,6 +25,6 @@ void SplitLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
 }
 
 
-INSTANTIATE_LAYER_GPU_FUNCS(SplitLayer);
+INSTANTIATE_LAYER_GPU_BACKWARD(SplitLayer);
 
 }  // namespace caffe
@@ -1,4 +1,6 @@
+#include <boost/thread.hpp>
 #include <algorithm>
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
@@ -8,28 +10,68 @@
 #include "hdf5.h"
 
 #include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_reorders.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/plan_views.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
 
+// Runs the tasks the Net gives to its branch threads, see RunBranches.
+template <typename Dtype>
+class Net<Dtype>::BranchThread : public InternalThread {
+ public:
+  explicit BranchThread(Net* net) : net_(net) {
+    StartInternalThread();
+  }
+  virtual ~BranchThread() {
+    StopInternalThread();
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    // Branches only run concurrently in CPU mode.
+    Caffe::set_mode(Caffe::CPU);
+    try {
+      while (!must_stop()) {
+        const int task = net_->branch_tasks_.pop();
+        net_->RunBranchTask(task);
+        net_->branch_done_.push(task);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  Net* net_;
+};
+
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), params_net_(NULL) {
+  Init(param);
+}
+
+template <typename Dtype>
+Net<Dtype>::Net(const NetParameter& param, const Net* root_net,
+    const Net* params_net)
+    : root_net_(root_net), params_net_(params_net) {
   Init(param);
 }
 
 template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase, const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), params_net_(NULL) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   param.mutable_state()->set_phase(phase);
@@ -40,19 +82,41 @@ template <typename Dtype>
 void Net<Dtype>::Init(const NetParameter& in_param) {
   CHECK(Caffe::root_solver() || root_net_)
       << "root_net_ needs to be set for all non-root solvers";
+  param_.CopyFrom(in_param);
+  for (int i = 0; i < param_.layer_size(); ++i) {
+    param_.mutable_layer(i)->clear_blobs();
+  }
   // Set phase from the state.
   phase_ = in_param.state().phase();
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
+  if (filtered_param.output_size()) {
+    NetParameter pruned_param;
+    PruneNet(filtered_param, &pruned_param);
+    filtered_param.Swap(&pruned_param);
+  }
   if (Caffe::root_solver()) {
     LOG(INFO) << "Initializing net from parameters: " << std::endl
               << filtered_param.DebugString();
   }
-  // Create a copy of filtered_param with splits added where necessary.
+  // Blocked layouts are only implemented for the CPU forward pass.
+  NetParameter reordered_param;
+  if (phase_ == TEST && Caffe::mode() == Caffe::CPU &&
+      !filtered_param.force_backward()) {
+    InsertReorders(filtered_param, &reordered_param);
+  } else {
+    LOG_IF(INFO, filtered_param.channel_block() > 1)
+        << "Ignoring channel_block outside of CPU inference.";
+    reordered_param.CopyFrom(filtered_param);
+  }
+  // Create a copy of reordered_param with splits added where necessary.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  InsertSplits(reordered_param, &param);
+  if (param.zero_copy_concat_slice()) {
+    PlanConcatSliceViews(&param);
+  }
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -105,6 +169,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     }
+    if (params_net_) {
+      // Layers given their param blobs skip allocating and filling them.
+      CHECK_EQ(params_net_->layer_names_[layer_id], layer_param.name());
+      layers_[layer_id]->blobs() = params_net_->layers_[layer_id]->blobs();
+    }
     layer_names_.push_back(layer_param.name());
     if (Caffe::root_solver()) {
       LOG(INFO) << "Creating Layer " << layer_param.name();
@@ -151,6 +220,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
+    if (params_net_) {
+      layers_[layer_id]->ShareParamCaches(*params_net_->layers_[layer_id]);
+    }
     if (Caffe::root_solver()) {
       LOG(INFO) << "Setting up " << layer_names_[layer_id];
     }
@@ -292,7 +364,37 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  ExpandCompactParams();
+  // The params of a context are in the arena of its net already.
+  if (param.contiguous_params() && !params_net_) {
+    if (Caffe::mode() == Caffe::CPU) {
+      AllocateParamArena();
+    } else {
+      LOG(INFO) << "Ignoring contiguous_params, only supported in CPU mode.";
+    }
+  }
   debug_info_ = param.debug_info();
+  half_activations_ = false;
+  loss_scale_ = 1;
+  SetUpRecompute(param);
+  layer_folded_.assign(layers_.size(), false);
+  if (param.fold_constants() && phase_ == TEST) {
+    FoldConstants();
+  } else {
+    LOG_IF(INFO, param.fold_constants())
+        << "Ignoring fold_constants outside of the TEST phase.";
+  }
+  layer_losses_.assign(layers_.size(), Dtype(0));
+  branch_threads_.clear();
+  for (int i = 0; param.branch_threads() > 1 && i < param.branch_threads();
+       ++i) {
+    branch_threads_.push_back(
+        shared_ptr<BranchThread>(new BranchThread(this)));
+  }
+  branch_blas_threads_ = std::max<int>(1,
+      boost::thread::hardware_concurrency() /
+      std::max<int>(1, branch_threads_.size()));
+  SetUpBranches();
   if (Caffe::root_solver()) {
     LOG(INFO) << "Network initialization done.";
     LOG(INFO) << "Memory required for data: " << memory_used_ * sizeof(Dtype);
@@ -329,6 +431,40 @@ void Net<Dtype>::FilterNet(const NetParameter& param,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::PruneNet(const NetParameter& param,
+    NetParameter* param_pruned) {
+  set<string> needed(param.output().begin(), param.output().end());
+  set<string> produced(param.input().begin(), param.input().end());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    produced.insert(param.layer(i).top().begin(), param.layer(i).top().end());
+  }
+  for (set<string>::iterator it = needed.begin(); it != needed.end(); ++it) {
+    CHECK(produced.count(*it)) << "Unknown output " << *it;
+  }
+  // Walk back from the outputs, keeping the layers writing needed blobs.
+  vector<bool> keep(param.layer_size(), false);
+  for (int i = param.layer_size() - 1; i >= 0; --i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      keep[i] = keep[i] || needed.count(layer_param.top(j));
+    }
+    if (keep[i]) {
+      needed.insert(layer_param.bottom().begin(), layer_param.bottom().end());
+    }
+  }
+  param_pruned->CopyFrom(param);
+  param_pruned->clear_layer();
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (keep[i]) {
+      param_pruned->add_layer()->CopyFrom(param.layer(i));
+    } else if (Caffe::root_solver()) {
+      LOG(INFO) << "Pruning layer " << param.layer(i).name()
+                << ", not needed for the outputs.";
+    }
+  }
+}
+
 template <typename Dtype>
 bool Net<Dtype>::StateMeetsRule(const NetState& state,
     const NetStateRule& rule, const string& layer_name) {
@@ -584,6 +720,185 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::AllocateParamArena() {
+  int count = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    count += learnable_params_[i]->count();
+  }
+  param_arena_.reset(new Blob<Dtype>(vector<int>(1, count)));
+  Dtype* data = param_arena_->mutable_cpu_data();
+  Dtype* diff = param_arena_->mutable_cpu_diff();
+  caffe_set(count, Dtype(0), diff);
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* param = learnable_params_[i];
+    param->Expand();
+    caffe_copy(param->count(), param->cpu_data(), data);
+    // Params shared with this one hold the same SyncedMemory, so they follow.
+    param->set_cpu_data(data);
+    param->set_cpu_diff(diff);
+    data += param->count();
+    diff += param->count();
+  }
+  if (Caffe::root_solver()) {
+    LOG(INFO) << "Allocated " << count << " contiguous parameters.";
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CheckParamArena() const {
+  if (!param_arena_) { return; }
+  const Dtype* data = param_arena_->cpu_data();
+  const Dtype* diff = param_arena_->cpu_diff();
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    const Blob<Dtype>* param = learnable_params_[i];
+    CHECK(param->cpu_data() == data && param->cpu_diff() == diff)
+        << "Learnable param " << i << " (" << param->shape_string()
+        << ") left the contiguous params, e.g. by being reshaped.";
+    data += param->count();
+    diff += param->count();
+  }
+  CHECK(data == param_arena_->cpu_data() + param_arena_->count())
+      << "The learnable params changed size since they were allocated.";
+}
+
+// Whether the blobs given, read by a layer recomputed in a segment from layer
+// start, are not overwritten from start on unless produced there, i.e. hold
+// the same values when the segment is recomputed.
+static bool InputsKeptFrom(int start, const vector<int>& blob_ids,
+    const vector<int>& producer, const vector<int>& last_writer) {
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    if (producer[blob_ids[i]] < start && last_writer[blob_ids[i]] >= start) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::SetUpRecompute(const NetParameter& param) {
+  recompute_segment_.assign(layers_.size(), -1);
+  release_after_forward_.assign(layers_.size(), vector<int>());
+  release_after_backward_.assign(layers_.size(), vector<int>());
+  if (phase_ != TRAIN) { return; }
+  const int num_segments = param.checkpoint_segments();
+  CHECK_GE(num_segments, 0);
+  // The first and the last layer writing each blob, and the last one reading
+  // it in the forward pass.
+  vector<int> producer(blobs_.size(), -1);
+  vector<int> last_writer(blobs_.size(), -1);
+  vector<int> last_forward_use(blobs_.size(), -1);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (producer[blob_id] < 0) { producer[blob_id] = i; }
+      last_writer[blob_id] = i;
+    }
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      last_forward_use[bottom_id_vecs_[i][j]] = i;
+    }
+  }
+  int segment = -1;
+  int group = -1;
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (!(num_segments || layers_[i]->layer_param().recompute()) ||
+        bottom_vecs_[i].empty() || !layers_[i]->AllowRecompute()) {
+      segment = -1;
+      continue;
+    }
+    // Without explicit segments, consecutive layers form one.
+    const int layer_group = num_segments ? i * num_segments / layers_.size()
+        : 0;
+    if (layer_group != group) { segment = -1; }
+    group = layer_group;
+    if (segment < 0 ||
+        !InputsKeptFrom(segment, bottom_id_vecs_[i], producer, last_writer)) {
+      segment = InputsKeptFrom(i, bottom_id_vecs_[i], producer, last_writer) ?
+          i : -1;
+    }
+    recompute_segment_[i] = segment;
+  }
+  // The activations to release are those of the blobs a segment both
+  // produces and consumes entirely.
+  vector<bool> internal(blobs_.size(), false);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    internal[blob_id] = producer[blob_id] >= 0 &&
+        recompute_segment_[producer[blob_id]] >= 0;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    internal[net_output_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      if (internal[blob_id] && recompute_segment_[i] !=
+          recompute_segment_[producer[blob_id]]) {
+        internal[blob_id] = false;
+      }
+    }
+  }
+  int num_released = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (!internal[blob_id] || last_forward_use[blob_id] < 0) { continue; }
+    release_after_forward_[last_forward_use[blob_id]].push_back(blob_id);
+    release_after_backward_[producer[blob_id]].push_back(blob_id);
+    ++num_released;
+  }
+  if (num_released && Caffe::root_solver()) {
+    LOG(INFO) << "Recomputing " << num_released << " blobs in the backward "
+              << "pass.";
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::FoldConstants() {
+  // A layer is folded if all its bottoms are constant, and it has no
+  // parameters, loss or other effect. Blobs written in place by layers that
+  // are not folded are not constant, which may keep the layers writing them
+  // before from being folded, so this is repeated until nothing changes.
+  vector<bool> variable(blobs_.size(), false);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    vector<bool> constant(blobs_.size(), false);
+    for (int i = 0; i < layers_.size(); ++i) {
+      Layer<Dtype>& layer = *layers_[i];
+      bool folded = !bottom_vecs_[i].empty() && layer.blobs().empty() &&
+          layer.AllowRecompute();
+      for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+        folded = folded && constant[bottom_id_vecs_[i][j]];
+      }
+      for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+        folded = folded && !variable[top_id_vecs_[i][j]] &&
+            layer.loss(j) == 0;
+      }
+      layer_folded_[i] = folded;
+      for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+        const int blob_id = top_id_vecs_[i][j];
+        if (bottom_vecs_[i].empty()) {
+          constant[blob_id] = layer.ConstantTop(j) && !variable[blob_id];
+        } else if (!folded && constant[blob_id]) {
+          variable[blob_id] = true;
+          constant[blob_id] = false;
+          changed = true;
+        } else {
+          constant[blob_id] = folded;
+        }
+      }
+    }
+  }
+  int num_folded = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layer_folded_[i]) {
+      layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      ++num_folded;
+    }
+  }
+  if (num_folded && Caffe::root_solver()) {
+    LOG(INFO) << "Folded " << num_folded << " layers computing constants.";
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
@@ -594,13 +909,21 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
       InputDebugInfo(i);
     }
   }
+  if (branch_threads_.size() && Caffe::mode() == Caffe::CPU && start <= end) {
+    return RunBranches(start, end, false) / loss_scale_;
+  }
   for (int i = start; i <= end; ++i) {
+    if (layer_folded_[i]) { continue; }
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (half_activations_) { ExpandActivations(bottom_vecs_[i]); }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
+    if (half_activations_) { CompactActivations(compact_after_forward_[i]); }
+    ReleaseActivations(release_after_forward_[i]);
   }
-  return loss;
+  // The layers weigh their losses with the diffs of their tops.
+  return loss / loss_scale_;
 }
 
 template <typename Dtype>
@@ -658,12 +981,412 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (branch_threads_.size() && Caffe::mode() == Caffe::CPU && start >= end) {
+    // Recomputed segments are run in order.
+    bool recompute = false;
+    for (int i = start; i >= end; --i) {
+      recompute = recompute || recompute_segment_[i] >= 0;
+    }
+    if (!recompute) {
+      RunBranches(start, end, true);
+      return;
+    }
+  }
   for (int i = start; i >= end; --i) {
+    const int segment = recompute_segment_[i];
+    if (segment >= 0 && (i == start || recompute_segment_[i + 1] != segment)) {
+      // Entering a segment: recompute the activations it released.
+      for (int j = segment; j <= i; ++j) {
+        if (half_activations_) { ExpandActivations(bottom_vecs_[j]); }
+        layers_[j]->Forward(bottom_vecs_[j], top_vecs_[j]);
+      }
+    }
     if (layer_need_backward_[i]) {
+      if (half_activations_) {
+        ExpandActivations(bottom_vecs_[i]);
+        ExpandActivations(top_vecs_[i]);
+      }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (half_activations_) { RoundDiffs(i); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
+    for (int c = 0; c < after_backward_.size(); ++c) {
+      after_backward_[c]->run(i);
+    }
+    if (half_activations_) { CompactActivations(compact_after_backward_[i]); }
+    ReleaseActivations(release_after_backward_[i]);
+  }
+}
+
+// Returns the id of memory, numbering the memories in the order they are
+// seen.
+static int MemoryId(const SyncedMemory* memory,
+    map<const SyncedMemory*, int>* ids) {
+  map<const SyncedMemory*, int>::const_iterator it = ids->find(memory);
+  if (it != ids->end()) {
+    return it->second;
+  }
+  const int id = ids->size();
+  (*ids)[memory] = id;
+  return id;
+}
+
+// Adds to successors the dependencies making each layer run after the layers
+// before it in order that write memory it reads or writes, or read memory it
+// writes.
+static void AddDependencies(const vector<int>& order,
+    const vector<vector<int> >& reads, const vector<vector<int> >& writes,
+    int num_memories, vector<vector<int> >* successors) {
+  vector<int> last_writer(num_memories, -1);
+  vector<vector<int> > readers(num_memories);
+  for (int k = 0; k < order.size(); ++k) {
+    const int i = order[k];
+    set<int> predecessors;
+    for (int j = 0; j < reads[i].size(); ++j) {
+      predecessors.insert(last_writer[reads[i][j]]);
+    }
+    for (int j = 0; j < writes[i].size(); ++j) {
+      const int memory = writes[i][j];
+      predecessors.insert(last_writer[memory]);
+      predecessors.insert(readers[memory].begin(), readers[memory].end());
+    }
+    predecessors.erase(-1);
+    predecessors.erase(i);
+    for (set<int>::iterator it = predecessors.begin();
+         it != predecessors.end(); ++it) {
+      (*successors)[*it].push_back(i);
+    }
+    for (int j = 0; j < reads[i].size(); ++j) {
+      readers[reads[i][j]].push_back(i);
+    }
+    for (int j = 0; j < writes[i].size(); ++j) {
+      last_writer[writes[i][j]] = i;
+      readers[writes[i][j]].clear();
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::SetUpBranches() {
+  forward_successors_.assign(layers_.size(), vector<int>());
+  backward_successors_.assign(layers_.size(), vector<int>());
+  if (branch_threads_.empty()) { return; }
+  // The memory read and written by each layer in each pass. Blobs sharing
+  // their data or diff (e.g. through Split layers or Concat views) share the
+  // memory, and compacting or releasing a blob writes it, as does reading a
+  // blob that may be compacted. The random number generator is one more
+  // memory, written by the layers drawing from it, which keeps their order.
+  map<const SyncedMemory*, int> ids;
+  const int random = MemoryId(NULL, &ids);
+  set<int> compacted;
+  for (int i = 0; half_activations_ && i < layers_.size(); ++i) {
+    const vector<int>* lists[] = {&compact_after_forward_[i],
+        &compact_after_backward_[i]};
+    for (int l = 0; l < 2; ++l) {
+      for (int j = 0; j < lists[l]->size(); ++j) {
+        compacted.insert(
+            MemoryId(blobs_[(*lists[l])[j]]->data().get(), &ids));
+      }
+    }
+  }
+  vector<vector<int> > reads[2];
+  vector<vector<int> > writes[2];
+  for (int pass = 0; pass < 2; ++pass) {
+    reads[pass].resize(layers_.size());
+    writes[pass].resize(layers_.size());
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    vector<int>* forward_reads = &reads[0][i];
+    vector<int>* forward_writes = &writes[0][i];
+    vector<int>* backward_reads = &reads[1][i];
+    vector<int>* backward_writes = &writes[1][i];
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      const Blob<Dtype>& blob = *bottom_vecs_[i][j];
+      forward_reads->push_back(MemoryId(blob.data().get(), &ids));
+      backward_reads->push_back(MemoryId(blob.data().get(), &ids));
+      if (bottom_need_backward_[i][j]) {
+        backward_writes->push_back(MemoryId(blob.diff().get(), &ids));
+      }
+    }
+    if (layers_[i]->DrawsRandom()) {
+      forward_writes->push_back(random);
+    }
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      const Blob<Dtype>& blob = *top_vecs_[i][j];
+      forward_writes->push_back(MemoryId(blob.data().get(), &ids));
+      if (layers_[i]->loss(j)) {
+        forward_reads->push_back(MemoryId(blob.diff().get(), &ids));
+      }
+      backward_reads->push_back(MemoryId(blob.data().get(), &ids));
+      backward_reads->push_back(MemoryId(blob.diff().get(), &ids));
+    }
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      const Blob<Dtype>& blob = *layers_[i]->blobs()[j];
+      forward_reads->push_back(MemoryId(blob.data().get(), &ids));
+      backward_reads->push_back(MemoryId(blob.data().get(), &ids));
+      if (layer_need_backward_[i]) {
+        backward_writes->push_back(MemoryId(blob.diff().get(), &ids));
+      }
+    }
+    const vector<int>* forward_lists[] = {&release_after_forward_[i],
+        half_activations_ ? &compact_after_forward_[i] : NULL};
+    const vector<int>* backward_lists[] = {&release_after_backward_[i],
+        half_activations_ ? &compact_after_backward_[i] : NULL};
+    for (int l = 0; l < 2 && forward_lists[l]; ++l) {
+      for (int j = 0; j < forward_lists[l]->size(); ++j) {
+        forward_writes->push_back(
+            MemoryId(blobs_[(*forward_lists[l])[j]]->data().get(), &ids));
+      }
+      for (int j = 0; j < backward_lists[l]->size(); ++j) {
+        backward_writes->push_back(
+            MemoryId(blobs_[(*backward_lists[l])[j]]->data().get(), &ids));
+      }
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+      for (int j = 0; j < reads[pass][i].size(); ++j) {
+        if (compacted.count(reads[pass][i][j])) {
+          writes[pass][i].push_back(reads[pass][i][j]);
+        }
+      }
+    }
+  }
+  vector<int> order(layers_.size());
+  for (int i = 0; i < layers_.size(); ++i) {
+    order[i] = i;
+  }
+  AddDependencies(order, reads[0], writes[0], ids.size(),
+      &forward_successors_);
+  std::reverse(order.begin(), order.end());
+  AddDependencies(order, reads[1], writes[1], ids.size(),
+      &backward_successors_);
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::RunBranches(int start, int end, bool backward) {
+  const int first = std::min(start, end);
+  const int num_layers = std::max(start, end) - first + 1;
+  const vector<vector<int> >& successors =
+      backward ? backward_successors_ : forward_successors_;
+  // The branches share the cores with the threads of the BLAS routines.
+  const int blas_threads = caffe_cpu_blas_threads();
+  if (blas_threads > branch_blas_threads_) {
+    caffe_set_cpu_blas_threads(branch_blas_threads_);
+  }
+  vector<int> num_predecessors(num_layers, 0);
+  for (int i = first; i < first + num_layers; ++i) {
+    for (int j = 0; j < successors[i].size(); ++j) {
+      const int k = successors[i][j] - first;
+      if (k >= 0 && k < num_layers) { ++num_predecessors[k]; }
+    }
+  }
+  // The layers drawing random numbers run here, from the generator of this
+  // thread, in the order set by SetUpBranches.
+  std::deque<int> own_tasks;
+  for (int i = first; i < first + num_layers; ++i) {
+    if (num_predecessors[i - first] == 0) {
+      PushBranchTask(backward ? ~i : i, &own_tasks);
+    }
+  }
+  // The callbacks are run in order, once the layers up to theirs are done.
+  vector<bool> done(num_layers, false);
+  int next_callback = first + num_layers - 1;
+  for (int num_done = 0; num_done < num_layers; ++num_done) {
+    int task;
+    if (own_tasks.empty()) {
+      task = branch_done_.pop();
+    } else {
+      task = own_tasks.front();
+      own_tasks.pop_front();
+      RunBranchTask(task);
+    }
+    const int i = backward ? ~task : task;
+    if (debug_info_ && !backward && !layer_folded_[i]) {
+      ForwardDebugInfo(i);
+    }
+    if (debug_info_ && backward && layer_need_backward_[i]) {
+      BackwardDebugInfo(i);
+    }
+    done[i - first] = true;
+    for (int j = 0; j < successors[i].size(); ++j) {
+      const int k = successors[i][j] - first;
+      if (k >= 0 && k < num_layers && --num_predecessors[k] == 0) {
+        PushBranchTask(backward ? ~successors[i][j] : successors[i][j],
+            &own_tasks);
+      }
+    }
+    for (; backward && next_callback >= first && done[next_callback - first];
+         --next_callback) {
+      for (int c = 0; c < after_backward_.size(); ++c) {
+        after_backward_[c]->run(next_callback);
+      }
+    }
+  }
+  if (blas_threads > branch_blas_threads_) {
+    caffe_set_cpu_blas_threads(blas_threads);
+  }
+  Dtype loss = 0;
+  for (int i = first; !backward && i < first + num_layers; ++i) {
+    loss += layer_losses_[i];
+  }
+  return loss;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PushBranchTask(int task, std::deque<int>* own_tasks) {
+  if (task >= 0 && layers_[task]->DrawsRandom()) {
+    own_tasks->push_back(task);
+  } else {
+    branch_tasks_.push(task);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunBranchTask(int task) {
+  if (task >= 0) {
+    layer_losses_[task] = 0;
+    if (layer_folded_[task]) { return; }
+    if (half_activations_) { ExpandActivations(bottom_vecs_[task]); }
+    layer_losses_[task] =
+        layers_[task]->Forward(bottom_vecs_[task], top_vecs_[task]);
+    if (half_activations_) {
+      CompactActivations(compact_after_forward_[task]);
+    }
+    ReleaseActivations(release_after_forward_[task]);
+  } else {
+    const int i = ~task;
+    if (layer_need_backward_[i]) {
+      if (half_activations_) {
+        ExpandActivations(bottom_vecs_[i]);
+        ExpandActivations(top_vecs_[i]);
+      }
+      layers_[i]->Backward(
+          top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (half_activations_) { RoundDiffs(i); }
+    }
+    if (half_activations_) { CompactActivations(compact_after_backward_[i]); }
+    ReleaseActivations(release_after_backward_[i]);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_half_activations(bool value, HalfFormat format) {
+  half_activations_ = value;
+  half_activations_format_ = format;
+  compact_after_forward_.assign(layers_.size(), vector<int>());
+  compact_after_backward_.assign(layers_.size(), vector<int>());
+  if (!value) {
+    SetUpBranches();
+    return;
+  }
+  // The first layer using each blob, as top or bottom, and the last one
+  // reading it in the forward pass.
+  vector<int> first_use(blobs_.size(), -1);
+  vector<int> last_forward_use(blobs_.size(), -1);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (first_use[blob_id] < 0) { first_use[blob_id] = i; }
+    }
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      if (first_use[blob_id] < 0) { first_use[blob_id] = i; }
+      last_forward_use[blob_id] = i;
+    }
+  }
+  vector<bool> keep(blobs_.size(), false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    keep[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    keep[net_output_blob_indices_[i]] = true;
+  }
+  // Neither do folded constants, nor released blobs.
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; layer_folded_[i] && j < top_id_vecs_[i].size(); ++j) {
+      keep[top_id_vecs_[i][j]] = true;
+    }
+  }
+  for (int i = 0; i < release_after_forward_.size(); ++i) {
+    for (int j = 0; j < release_after_forward_[i].size(); ++j) {
+      keep[release_after_forward_[i][j]] = true;
+    }
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (keep[blob_id] || last_forward_use[blob_id] < 0) { continue; }
+    compact_after_forward_[last_forward_use[blob_id]].push_back(blob_id);
+    compact_after_backward_[first_use[blob_id]].push_back(blob_id);
+  }
+  SetUpBranches();
+}
+
+template <typename Dtype>
+void Net<Dtype>::CompactActivations(const vector<int>& blob_ids) {
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[blob_ids[i]].get();
+    if (blob->count() && !blob->is_half() &&
+        blob->data().use_count() == 1) {
+      blob->CompactToHalf(half_activations_format_);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::RoundDiffs(int layer_id) {
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  for (int i = 0; i < bottom_vecs_[layer_id].size(); ++i) {
+    if (!bottom_need_backward_[layer_id][i]) { continue; }
+    Blob<Dtype>* blob = bottom_vecs_[layer_id][i];
+    // Overflows turn into infinite gradients, which the solver detects.
+    caffe_cpu_round_half(blob->count(), Dtype(1), blob->cpu_diff(),
+        half_activations_format_, blob->mutable_cpu_diff());
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_loss_scale(Dtype scale) {
+  CHECK_GT(scale, 0);
+  loss_scale_ = scale;
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      const Dtype loss_weight = layers_[i]->loss(j);
+      if (loss_weight) {
+        caffe_set(top_vecs_[i][j]->count(), loss_weight * scale,
+            top_vecs_[i][j]->mutable_cpu_diff());
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ExpandActivations(const vector<Blob<Dtype>*>& blobs) {
+  for (int i = 0; i < blobs.size(); ++i) {
+    blobs[i]->Expand();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ExpandCompactParams() {
+  const bool keep = phase_ == TEST && Caffe::mode() == Caffe::CPU;
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      if (!keep || !layers_[i]->ReadsCompactParam(j)) {
+        layers_[i]->blobs()[j]->Expand();
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseActivations(const vector<int>& blob_ids) {
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[blob_ids[i]].get();
+    // Blobs viewing the data of others, e.g. through Reshape or Split
+    // layers, would not free it.
+    if (blob->data().use_count() == 1) {
+      blob->ReleaseData();
+    }
   }
 }
 
@@ -763,6 +1486,23 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
   }
 }
 
+template <typename Dtype>
+shared_ptr<Net<Dtype> > Net<Dtype>::NewContext() const {
+  // Bring the weights to the device now, as the contexts would otherwise do
+  // it concurrently on their first forward pass.
+  for (int i = 0; i < params_.size(); ++i) {
+    if (params_[i]->is_half() || params_[i]->is_sparse()) {
+      continue;
+    }
+    if (Caffe::mode() == Caffe::GPU) {
+      params_[i]->gpu_data();
+    } else {
+      params_[i]->cpu_data();
+    }
+  }
+  return shared_ptr<Net<Dtype> >(new Net<Dtype>(param_, root_net_, this));
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
   int num_source_layers = other->layers().size();
@@ -793,6 +1533,39 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       target_blobs[j]->ShareData(*source_blob);
     }
   }
+  ExpandCompactParams();
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  int num_source_layers = other->layers().size();
+  for (int i = 0; i < num_source_layers; ++i) {
+    Layer<Dtype>* source_layer = other->layers()[i].get();
+    const string& source_layer_name = other->layer_names()[i];
+    int target_layer_id = 0;
+    while (target_layer_id != layer_names_.size() &&
+        layer_names_[target_layer_id] != source_layer_name) {
+      ++target_layer_id;
+    }
+    if (target_layer_id == layer_names_.size()) {
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
+      CHECK(target_blobs[j]->shape() == source_blob->shape())
+          << "Cannot copy param " << j << " weights from layer '"
+          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << source_blob->shape_string() << "; target param shape is "
+          << target_blobs[j]->shape_string();
+      target_blobs[j]->CopyFrom(*source_blob);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -827,10 +1600,27 @@ void Net<Dtype>::Backward() {
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    layers_[i]->ReshapeIfChanged(bottom_vecs_[i], top_vecs_[i]);
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::Reserve(const vector<vector<int> >& max_input_shapes) {
+  CHECK_EQ(max_input_shapes.size(), net_input_blobs_.size());
+  // Blobs never shrink, so reshaping the net once for the largest inputs
+  // leaves every blob large enough.
+  vector<vector<int> > input_shapes(net_input_blobs_.size());
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    input_shapes[i] = net_input_blobs_[i]->shape();
+    net_input_blobs_[i]->Reshape(max_input_shapes[i]);
+  }
+  Reshape();
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    net_input_blobs_[i]->Reshape(input_shapes[i]);
+  }
+  Reshape();
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
   int num_source_layers = param.layer_size();
@@ -867,6 +1657,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  ExpandCompactParams();
+  CheckParamArena();
 }
 
 template <typename Dtype>
@@ -935,6 +1727,8 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   }
   H5Gclose(data_hid);
   H5Fclose(file_hid);
+  // The params take the shapes of the file.
+  CheckParamArena();
 }
 
 template <typename Dtype>
@@ -1011,13 +1805,48 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  if (use_param_arena()) {
+    CheckParamArena();
+    param_arena_->Update();
+    // The params only borrow the arena: mark their memory written, so that
+    // the caches derived from them, also in nets sharing them, are rebuilt.
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      learnable_params_[i]->data()->mutable_cpu_data();
+    }
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
 }
 
+template <typename Dtype>
+Dtype Net<Dtype>::ClipParamDiffs(Dtype max_norm) {
+  // With contiguous params, the norm and scaling are over a single blob.
+  vector<Blob<Dtype>*> params = learnable_params_;
+  if (use_param_arena()) {
+    params.assign(1, param_arena_.get());
+  }
+  Dtype sumsq_diff = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    sumsq_diff += params[i]->sumsq_diff();
+  }
+  const Dtype l2norm_diff = std::sqrt(sumsq_diff);
+  if (l2norm_diff > max_norm) {
+    for (int i = 0; i < params.size(); ++i) {
+      params[i]->scale_diff(max_norm / l2norm_diff);
+    }
+  }
+  return l2norm_diff;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (use_param_arena()) {
+    caffe_set(param_arena_->count(), static_cast<Dtype>(0),
+              param_arena_->mutable_cpu_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
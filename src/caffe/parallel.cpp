@@ -2,14 +2,18 @@
 #include <cuda_runtime.h>
 #endif
 #include <glog/logging.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "boost/thread.hpp"
@@ -41,13 +45,13 @@ static void apply_buffers(const vector<Blob<Dtype>*>& blobs,
         break;
       }
       case replace_cpu:
-        blobs[i]->data()->set_cpu_data(ptr);
+        blobs[i]->set_cpu_data(ptr);
         break;
       case replace_gpu:
         blobs[i]->data()->set_gpu_data(ptr);
         break;
       case replace_cpu_diff:
-        blobs[i]->diff()->set_cpu_data(ptr);
+        blobs[i]->set_cpu_diff(ptr);
         break;
       case replace_gpu_diff:
         blobs[i]->diff()->set_gpu_data(ptr);
@@ -118,6 +122,84 @@ void GPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
   apply_buffers(net, diff_, size_, replace_gpu_diff);
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver)
+    : Params<Dtype>(root_solver),
+      arena_(root_solver->net()->param_arena()) {
+  if (arena_ && arena_->count() > 0) {
+    // The params already are back to back in the arena, in the same order.
+    CHECK_EQ(size_, arena_->count());
+    data_ = arena_->mutable_cpu_data();
+    diff_ = arena_->mutable_cpu_diff();
+    return;
+  }
+  arena_.reset();
+  data_ = new Dtype[size_];
+  apply_buffers(root_solver->net()->learnable_params(), data_, size_, copy);
+  diff_ = new Dtype[size_];
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  if (!arena_) {
+    delete[] data_;
+    delete[] diff_;
+  }
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+      solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
+template<typename Dtype>
+void ComputeGradientBuckets(const Net<Dtype>& net, size_t bucket_size,
+    vector<int>* layer_buckets, vector<pair<size_t, size_t> >* buckets) {
+  const int num_layers = net.layers().size();
+  // ready_begin[l]: the offset of the first learnable param owned by layer l
+  // or above, i.e. of the gradients final once layer l is done.
+  const vector<Blob<Dtype>*>& learnable_params = net.learnable_params();
+  vector<int> owner_layers(learnable_params.size());
+  for (int i = 0; i < net.params().size(); ++i) {
+    if (net.param_owners()[i] < 0) {
+      owner_layers[net.learnable_param_ids()[i]] =
+          net.param_layer_indices()[i].first;
+    }
+  }
+  vector<size_t> ready_begin(num_layers + 1, 0);
+  size_t offset = 0;
+  int param_id = 0;
+  for (int l = 0; l <= num_layers; ++l) {
+    while (param_id < learnable_params.size() &&
+           owner_layers[param_id] < l) {
+      offset += learnable_params[param_id++]->count();
+    }
+    ready_begin[l] = offset;
+  }
+  layer_buckets->assign(num_layers, -1);
+  buckets->clear();
+  size_t end = offset;
+  for (int l = num_layers - 1; l >= 0; --l) {
+    const size_t begin = ready_begin[l];
+    if (end > begin && (end - begin >= bucket_size || l == 0)) {
+      (*layer_buckets)[l] = buckets->size();
+      buckets->push_back(make_pair(begin, end));
+      end = begin;
+    }
+  }
+}
+
+template void ComputeGradientBuckets<float>(const Net<float>& net,
+    size_t bucket_size, vector<int>* layer_buckets,
+    vector<pair<size_t, size_t> >* buckets);
+template void ComputeGradientBuckets<double>(const Net<double>& net,
+    size_t bucket_size, vector<int>* layer_buckets,
+    vector<pair<size_t, size_t> >* buckets);
+
 void DevicePair::compute(const vector<int> devices, vector<DevicePair>* pairs) {
 #ifndef CPU_ONLY
   vector<int> remaining(devices);
@@ -210,7 +292,8 @@ P2PSync<Dtype>::P2PSync(shared_ptr<Solver<Dtype> > root_solver,
       children_(),
       queue_(),
       initial_iter_(root_solver->iter()),
-      solver_() {
+      solver_(),
+      backward_passes_(0) {
 #ifndef CPU_ONLY
   int initial_device;
   CUDA_CHECK(cudaGetDevice(&initial_device));
@@ -226,6 +309,20 @@ P2PSync<Dtype>::P2PSync(shared_ptr<Solver<Dtype> > root_solver,
   }
   this->configure(solver_.get());
   solver_->add_callback(this);
+  if (param.reduce_bucket_size() > 0) {
+    ComputeGradientBuckets(*solver_->net(), param.reduce_bucket_size(),
+        &layer_buckets_, &buckets_);
+    bucket_events_.resize(buckets_.size());
+    for (int i = 0; i < buckets_.size(); ++i) {
+      CUDA_CHECK(cudaEventCreateWithFlags(&bucket_events_[i],
+          cudaEventDisableTiming));
+    }
+    CUDA_CHECK(cudaStreamCreateWithFlags(&reduce_stream_,
+        cudaStreamNonBlocking));
+    solver_->net()->add_after_backward(this);
+    reduce_thread_.reset(new boost::thread(&P2PSync<Dtype>::ReduceThreadEntry,
+        this, Caffe::solver_count()));
+  }
 
   if (parent) {
     // Enable p2p access between devices
@@ -257,6 +354,14 @@ P2PSync<Dtype>::~P2PSync() {
   const int self = solver_->param().device_id();
   CUDA_CHECK(cudaSetDevice(self));
 
+  if (reduce_thread_) {
+    reduce_queue_.push(-1);
+    reduce_thread_->join();
+    for (int i = 0; i < bucket_events_.size(); ++i) {
+      CUDA_CHECK(cudaEventDestroy(bucket_events_[i]));
+    }
+    CUDA_CHECK(cudaStreamDestroy(reduce_stream_));
+  }
   if (parent_) {
     CUDA_CHECK(cudaFree(parent_grads_));
     const int peer = parent_->solver_->param().device_id();
@@ -302,6 +407,12 @@ void P2PSync<Dtype>::on_start() {
   if (parent_) {
     P2PSync<Dtype> *parent = queue_.pop();
     CHECK(parent == parent_);
+    // The parent copied the weights into data_, behind the back of the
+    // params, whose sharers would not see them change otherwise.
+    const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      params[i]->mutable_gpu_data();
+    }
   }
 
   // Update children
@@ -325,6 +436,64 @@ void P2PSync<Dtype>::on_start() {
 #endif
 }
 
+template<typename Dtype>
+void P2PSync<Dtype>::run(int layer) {
+#ifndef CPU_ONLY
+  // Gradients accumulated over several passes are only final in the last.
+  const int iter_size = solver_->param().iter_size();
+  const int bucket = layer_buckets_[layer];
+  if (backward_passes_ % iter_size == iter_size - 1 && bucket >= 0) {
+    // The reduction stream waits for the backward kernels on this bucket.
+    CUDA_CHECK(cudaEventRecord(bucket_events_[bucket], cudaStreamDefault));
+    reduce_queue_.push(bucket);
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+#endif
+}
+
+template<typename Dtype>
+void P2PSync<Dtype>::ReduceThreadEntry(int solver_count) {
+#ifndef CPU_ONLY
+  // Caffe's state is per thread, see InternalThread::entry.
+  Caffe::SetDevice(solver_->param().device_id());
+  Caffe::set_mode(Caffe::GPU);
+  Caffe::set_solver_count(solver_count);
+  CUBLAS_CHECK(cublasSetStream(Caffe::cublas_handle(), reduce_stream_));
+  for (int bucket = reduce_queue_.pop(); bucket >= 0;
+       bucket = reduce_queue_.pop()) {
+    ReduceBucket(bucket);
+    reduced_queue_.push(bucket);
+  }
+#endif
+}
+
+template<typename Dtype>
+void P2PSync<Dtype>::ReduceBucket(int bucket) {
+#ifndef CPU_ONLY
+  const size_t offset = buckets_[bucket].first;
+  const size_t count = buckets_[bucket].second - offset;
+  CUDA_CHECK(cudaStreamWaitEvent(reduce_stream_, bucket_events_[bucket], 0));
+  // Children send buckets in the same order, so each one's next is this one.
+  for (int i = 0; i < children_.size(); ++i) {
+    CHECK_EQ(bucket, children_[i]->sent_queue_.pop());
+    caffe_gpu_axpy<Dtype>(count, Dtype(1),
+        children_[i]->parent_grads_ + offset, diff_ + offset);
+  }
+  if (parent_) {
+    CUDA_CHECK(cudaMemcpyAsync(parent_grads_ + offset, diff_ + offset,
+        count * sizeof(Dtype), cudaMemcpyDeviceToDevice, reduce_stream_));
+    CUDA_CHECK(cudaStreamSynchronize(reduce_stream_));
+    sent_queue_.push(bucket);
+  } else {
+    caffe_gpu_scal<Dtype>(count, Dtype(1.0 / Caffe::solver_count()),
+        diff_ + offset);
+    CUDA_CHECK(cudaStreamSynchronize(reduce_stream_));
+  }
+#endif
+}
+
 template<typename Dtype>
 void P2PSync<Dtype>::on_gradients_ready() {
 #ifndef CPU_ONLY
@@ -334,6 +503,14 @@ void P2PSync<Dtype>::on_gradients_ready() {
   CHECK(device == solver_->param().device_id());
 #endif
 
+  if (reduce_thread_) {
+    // The buckets were queued during the backward pass; wait for them.
+    for (int i = 0; i < buckets_.size(); ++i) {
+      CHECK_EQ(i, reduced_queue_.pop());
+    }
+    return;
+  }
+
   // Sum children gradients as they appear in the queue
   for (int i = 0; i < children_.size(); ++i) {
     P2PSync<Dtype> *child = queue_.pop();
@@ -434,8 +611,387 @@ void P2PSync<Dtype>::run(const vector<int>& gpus) {
   }
 }
 
+template<typename Dtype>
+DistSync<Dtype>::DistSync(shared_ptr<Solver<Dtype> > solver,
+                          shared_ptr<Transport> transport)
+    : CPUParams<Dtype>(solver),
+      solver_(solver),
+      transport_(transport),
+      initialized_(false),
+      backward_passes_(0) {
+  // The buffers back the host copies of the params, also in GPU mode where
+  // they stage the transfers. With contiguous_params, they are the arena.
+  this->configure(solver_.get());
+  solver_->add_callback(this);
+  const SolverParameter& param = solver_->param();
+  if (param.reduce_bucket_size() > 0 && Caffe::mode() == Caffe::CPU) {
+    ComputeGradientBuckets(*solver_->net(), param.reduce_bucket_size(),
+        &layer_buckets_, &buckets_);
+    solver_->net()->add_after_backward(this);
+    reduce_thread_.reset(new boost::thread(
+        &DistSync<Dtype>::ReduceThreadEntry, this));
+  } else {
+    LOG_IF(INFO, param.reduce_bucket_size() > 0)
+        << "Ignoring reduce_bucket_size, only supported in CPU mode.";
+    buckets_.assign(1, make_pair(size_t(0), size_));
+  }
+  HalfFormat format;
+  if (param.gradient_compression() != SolverParameter::NONE &&
+      !IsHalfCompression(param.gradient_compression(), &format)) {
+    for (int i = 0; i < buckets_.size(); ++i) {
+      compressors_.push_back(shared_ptr<GradientCompressor<Dtype> >(
+          new GradientCompressor<Dtype>(param.gradient_compression(),
+              buckets_[i].second - buckets_[i].first, param.top_k_ratio())));
+    }
+  }
+}
+
+template<typename Dtype>
+DistSync<Dtype>::~DistSync() {
+  if (reduce_thread_) {
+    reduce_queue_.push(-1);
+    reduce_thread_->join();
+  }
+}
+
+template<typename Dtype>
+void DistSync<Dtype>::run() {
+  LOG(INFO) << "Starting Optimization, rank " << transport_->rank() << " of "
+            << transport_->size();
+  solver_->Solve();
+  if (solver_->iter() < solver_->param().max_iter()) {
+    LOG(INFO) << "Stopped early, aborting the other processes";
+    transport_->Abort();
+  }
+}
+
+template<typename Dtype>
+void DistSync<Dtype>::on_start() {
+  if (initialized_) {
+    return;
+  }
+  // Start from the weights of rank 0, as the processes were seeded
+  // differently.
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->cpu_data();
+  }
+  caffe_ring_broadcast(transport_.get(), size_, data_);
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->mutable_cpu_data();
+  }
+  initialized_ = true;
+}
+
+template<typename Dtype>
+void DistSync<Dtype>::run(int layer) {
+  // Gradients accumulated over several passes are only final in the last.
+  const int iter_size = solver_->param().iter_size();
+  const int bucket = layer_buckets_[layer];
+  if (backward_passes_ % iter_size == iter_size - 1 && bucket >= 0) {
+    reduce_queue_.push(bucket);
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+}
+
+template<typename Dtype>
+void DistSync<Dtype>::ReduceThreadEntry() {
+  // The net calls back in the order of the layers, so all the processes
+  // reduce the buckets in the same order.
+  for (int bucket = reduce_queue_.pop(); bucket >= 0;
+       bucket = reduce_queue_.pop()) {
+    ReduceBucket(bucket);
+    reduced_queue_.push(bucket);
+  }
+}
+
+template<typename Dtype>
+void DistSync<Dtype>::ReduceBucket(int bucket) {
+  const size_t offset = buckets_[bucket].first;
+  const int count = buckets_[bucket].second - offset;
+  Dtype* diff = diff_ + offset;
+  HalfFormat format;
+  if (IsHalfCompression(solver_->param().gradient_compression(), &format)) {
+    caffe_ring_allreduce_half(transport_.get(), count, format, diff);
+  } else if (compressors_.size()) {
+    // Sparse or one-bit gradients cannot be summed on their way around the
+    // ring: gather them all, and decode them in the same order in every
+    // process, so that the weights stay identical.
+    vector<char> message;
+    compressors_[bucket]->Compress(diff, &message);
+    vector<vector<char> > messages;
+    caffe_ring_allgather(transport_.get(), message, &messages);
+    caffe_set(count, Dtype(0), diff);
+    for (int i = 0; i < messages.size(); ++i) {
+      compressors_[bucket]->DecompressAdd(messages[i], diff);
+    }
+  } else {
+    caffe_ring_allreduce(transport_.get(), count, diff);
+  }
+  caffe_scal(count, Dtype(1) / transport_->size(), diff);
+}
+
+template<typename Dtype>
+void DistSync<Dtype>::on_gradients_ready() {
+  if (reduce_thread_) {
+    // The buckets were queued during the backward pass; wait for them.
+    for (int i = 0; i < buckets_.size(); ++i) {
+      CHECK_EQ(i, reduced_queue_.pop());
+    }
+    return;
+  }
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->cpu_diff();
+  }
+  ReduceBucket(0);
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->mutable_cpu_diff();
+  }
+}
+
+template<typename Dtype>
+void ComputeParamShards(const vector<Blob<Dtype>*>& params, int num_shards,
+    vector<vector<int> >* shards) {
+  // Give the largest params first to the least loaded shard.
+  vector<pair<int, int> > order;
+  for (int i = 0; i < params.size(); ++i) {
+    order.push_back(make_pair(-params[i]->count(), i));
+  }
+  std::sort(order.begin(), order.end());
+  vector<size_t> loads(num_shards, 0);
+  shards->assign(num_shards, vector<int>());
+  for (int i = 0; i < order.size(); ++i) {
+    const int shard =
+        std::min_element(loads.begin(), loads.end()) - loads.begin();
+    (*shards)[shard].push_back(order[i].second);
+    loads[shard] += -order[i].first;
+  }
+  for (int s = 0; s < num_shards; ++s) {
+    std::sort((*shards)[s].begin(), (*shards)[s].end());
+  }
+}
+
+template void ComputeParamShards<float>(const vector<Blob<float>*>& params,
+    int num_shards, vector<vector<int> >* shards);
+template void ComputeParamShards<double>(const vector<Blob<double>*>& params,
+    int num_shards, vector<vector<int> >* shards);
+
+// Messages from workers to servers.
+enum ParamServerMessage {
+  PUSH_GRADIENTS,
+  WORKER_DONE
+};
+
+template<typename Dtype>
+ParamServerSync<Dtype>::ParamServerSync(shared_ptr<Solver<Dtype> > solver,
+    shared_ptr<Transport> transport, int num_servers, int staleness,
+    const SolverParameter& param)
+    : solver_(solver),
+      transport_(transport),
+      num_servers_(num_servers),
+      staleness_(staleness),
+      param_(param),
+      initialized_(false) {
+  CHECK_GT(num_servers, 0);
+  CHECK_GT(transport->size(), num_servers) << "Need at least one worker.";
+  CHECK_GE(staleness, 0);
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  ComputeParamShards(params, num_servers, &shards_);
+  size_t max_count = 1;
+  for (int s = 0; s < num_servers; ++s) {
+    size_t count = 0;
+    for (int i = 0; i < shards_[s].size(); ++i) {
+      count += params[shards_[s][i]]->count();
+    }
+    CHECK_GT(count, 0) << "More parameter servers than learnable params.";
+    shard_counts_.push_back(count);
+    max_count = std::max(max_count, count);
+    compressors_.push_back(shared_ptr<GradientCompressor<Dtype> >(
+        new GradientCompressor<Dtype>(param.gradient_compression(), count,
+            param.top_k_ratio())));
+  }
+  buffer_.resize(max_count);
+  if (is_server()) {
+    CHECK(dynamic_cast<SGDSolver<Dtype>*>(solver_.get()))
+        << "Parameter servers need an SGDSolver.";
+  } else {
+    solver_->add_callback(this);
+  }
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::run() {
+  if (is_server()) {
+    LOG(INFO) << "Serving " << shard_counts_[transport_->rank()]
+              << " parameters to " << transport_->size() - num_servers_
+              << " workers";
+    Serve();
+    return;
+  }
+  LOG(INFO) << "Starting Optimization, worker "
+            << transport_->rank() - num_servers_ << " of "
+            << transport_->size() - num_servers_;
+  solver_->Solve();
+  const int message = WORKER_DONE;
+  for (int s = 0; s < num_servers_; ++s) {
+    transport_->Send(s, &message, sizeof(message));
+  }
+  if (param_.snapshot_after_train() && (!param_.snapshot() ||
+      solver_->iter() % param_.snapshot() != 0)) {
+    SnapshotWeights(solver_->iter());
+  }
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::GatherShard(int shard, bool diff) {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  Dtype* ptr = &buffer_[0];
+  for (int i = 0; i < shards_[shard].size(); ++i) {
+    const Blob<Dtype>* blob = params[shards_[shard][i]];
+    caffe_copy(blob->count(), diff ? blob->cpu_diff() : blob->cpu_data(),
+        ptr);
+    ptr += blob->count();
+  }
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::ScatterShard(int shard, bool diff) {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  const Dtype* ptr = &buffer_[0];
+  for (int i = 0; i < shards_[shard].size(); ++i) {
+    Blob<Dtype>* blob = params[shards_[shard][i]];
+    caffe_copy(blob->count(), ptr,
+        diff ? blob->mutable_cpu_diff() : blob->mutable_cpu_data());
+    ptr += blob->count();
+  }
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::Serve() {
+  const int self = transport_->rank();
+  const int num_workers = transport_->size() - num_servers_;
+  const size_t bytes = shard_counts_[self] * sizeof(Dtype);
+  SGDSolver<Dtype>* solver = static_cast<SGDSolver<Dtype>*>(solver_.get());
+  const int start_iter = solver_->iter();
+  int updates = 0;
+  // Iterations pushed by each worker, and whether it waits for weights.
+  vector<int> clocks(num_workers, 0);
+  vector<bool> done(num_workers, false);
+  vector<bool> waiting(num_workers, false);
+  vector<int> active;
+  // Workers start by pulling the weights.
+  GatherShard(self, false);
+  for (int w = 0; w < num_workers; ++w) {
+    active.push_back(num_servers_ + w);
+    transport_->Send(num_servers_ + w, &buffer_[0], bytes);
+  }
+  while (!active.empty()) {
+    const int peer = transport_->Poll(active);
+    const int w = peer - num_servers_;
+    int message;
+    transport_->Recv(peer, &message, sizeof(message));
+    if (message == WORKER_DONE) {
+      done[w] = true;
+      active.erase(std::find(active.begin(), active.end(), peer));
+    } else {
+      CHECK_EQ(message, PUSH_GRADIENTS);
+      uint64_t message_size;
+      transport_->Recv(peer, &message_size, sizeof(message_size));
+      message_.resize(message_size);
+      transport_->Recv(peer, &message_[0], message_size);
+      caffe_set(shard_counts_[self], Dtype(0), &buffer_[0]);
+      compressors_[self]->DecompressAdd(message_, &buffer_[0]);
+      ScatterShard(self, true);
+      // Learning rate policies follow the equivalent synchronous iteration.
+      solver->set_iter(start_iter + updates++ / num_workers);
+      solver->UpdateParams(shards_[self]);
+      ++clocks[w];
+      waiting[w] = true;
+    }
+    int min_clock = INT_MAX;
+    for (int w = 0; w < num_workers; ++w) {
+      if (!done[w]) {
+        min_clock = std::min(min_clock, clocks[w]);
+      }
+    }
+    bool gathered = false;
+    for (int w = 0; w < num_workers; ++w) {
+      if (waiting[w] && !done[w] && clocks[w] - min_clock <= staleness_) {
+        if (!gathered) {
+          GatherShard(self, false);
+          gathered = true;
+        }
+        transport_->Send(num_servers_ + w, &buffer_[0], bytes);
+        waiting[w] = false;
+      }
+    }
+  }
+  LOG(INFO) << "Applied " << updates << " updates";
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::on_start() {
+  if (initialized_) {
+    return;
+  }
+  for (int s = 0; s < num_servers_; ++s) {
+    transport_->Recv(s, &buffer_[0], shard_counts_[s] * sizeof(Dtype));
+    ScatterShard(s, false);
+  }
+  initialized_ = true;
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::on_gradients_ready() {
+  // Exchanging with one server at a time guarantees that servers only send
+  // to workers reading from them, so that they cannot block each other.
+  // Pulling blocks while this worker is too far ahead of the others.
+  // The servers only see their shard, so the norm of the whole gradient is
+  // clipped here, as in SGDSolver::ApplyUpdate.
+  if (param_.clip_gradients() >= 0) {
+    solver_->net()->ClipParamDiffs(param_.clip_gradients());
+  }
+  const int message = PUSH_GRADIENTS;
+  for (int s = 0; s < num_servers_; ++s) {
+    GatherShard(s, true);
+    compressors_[s]->Compress(&buffer_[0], &message_);
+    const uint64_t message_size = message_.size();
+    transport_->Send(s, &message, sizeof(message));
+    transport_->Send(s, &message_size, sizeof(message_size));
+    transport_->Send(s, &message_[0], message_size);
+    transport_->Recv(s, &buffer_[0], shard_counts_[s] * sizeof(Dtype));
+    ScatterShard(s, false);
+  }
+  // The solver increments its iteration after this.
+  const int iter = solver_->iter() + 1;
+  if (param_.snapshot() && iter % param_.snapshot() == 0) {
+    SnapshotWeights(iter);
+  }
+}
+
+template<typename Dtype>
+void ParamServerSync<Dtype>::SnapshotWeights(int iter) {
+  // Workers hold the same weights, the first one saves them.
+  if (transport_->rank() != num_servers_ || param_.snapshot_prefix().empty()) {
+    return;
+  }
+  NetParameter net_param;
+  solver_->net()->ToProto(&net_param, param_.snapshot_diff());
+  ostringstream filename;
+  filename << param_.snapshot_prefix() << "_iter_" << iter
+           << ".caffemodel";
+  LOG(INFO) << "Snapshotting to binary proto file " << filename.str();
+  WriteProtoToBinaryFile(net_param, filename.str());
+}
+
 INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(DistSync);
+INSTANTIATE_CLASS(ParamServerSync);
 
 }  // namespace caffe
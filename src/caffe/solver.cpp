@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <cstdio>
 
 #include <algorithm>
@@ -10,6 +12,7 @@
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -17,6 +20,43 @@
 
 namespace caffe {
 
+SolverThread::SolverThread(const boost::function<void()>& task)
+    : task_(task), running_(false) {
+}
+
+SolverThread::~SolverThread() {
+  Wait();
+  StopInternalThread();
+}
+
+void SolverThread::Run() {
+  CHECK(!running_) << "The previous run is not done.";
+  if (!is_started()) {
+    StartInternalThread();
+  }
+  running_ = true;
+  start_.push(0);
+}
+
+void SolverThread::Wait() {
+  if (running_) {
+    done_.pop();
+    running_ = false;
+  }
+}
+
+void SolverThread::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      start_.pop();
+      task_();
+      done_.push(0);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -66,6 +106,15 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   }
   iter_ = 0;
   current_step_ = 0;
+  test_iter_ = 0;
+  if (param_.pipelined()) {
+    update_thread_.reset(new SolverThread(
+        boost::bind(&Solver<Dtype>::ApplyUpdate, this)));
+  }
+  if (param_.test_async() && Caffe::root_solver()) {
+    test_thread_.reset(new SolverThread(
+        boost::bind(&Solver<Dtype>::RunTests, this)));
+  }
 }
 
 template <typename Dtype>
@@ -203,6 +252,16 @@ void Solver<Dtype>::Step(int iters) {
   int average_loss = this->param_.average_loss();
   vector<Dtype> losses;
   Dtype smoothed_loss = 0;
+  // With pipelined, the forward pass of the data layers at the start of the
+  // net, which only fill their tops, is run for the next iteration while the
+  // update of the current one is applied.
+  int num_data_layers = 0;
+  while (update_thread_ && num_data_layers < net_->layers().size() &&
+      net_->bottom_vecs()[num_data_layers].empty() &&
+      net_->layers()[num_data_layers]->blobs().empty()) {
+    ++num_data_layers;
+  }
+  bool data_ready = false;
 
   while (iter_ < stop_iter) {
     // zero-init the params
@@ -220,12 +279,19 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_start();
     }
+    PrepareIteration();
     const bool display = param_.display() && iter_ % param_.display() == 0;
     net_->set_debug_info(display && param_.debug_info());
     // accumulate the loss and gradient
     Dtype loss = 0;
     for (int i = 0; i < param_.iter_size(); ++i) {
-      loss += net_->ForwardBackward(bottom_vec);
+      if (data_ready) {
+        loss += net_->ForwardFrom(num_data_layers);
+        net_->Backward();
+        data_ready = false;
+      } else {
+        loss += net_->ForwardBackward(bottom_vec);
+      }
     }
     loss /= param_.iter_size();
     // average the loss across iterations for smoothed reporting
@@ -264,14 +330,27 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
-    ApplyUpdate();
+    SolverAction::Enum request = GetRequestedAction();
+    // The data of the next iteration are only fetched when it surely runs,
+    // as they would be lost otherwise: not when a stop is requested, or
+    // tests, which may request one, come first.
+    const bool next_runs = iter_ + 1 < stop_iter &&
+        request != SolverAction::STOP &&
+        !(param_.test_interval() && (iter_ + 1) % param_.test_interval() == 0
+          && Caffe::root_solver());
+    if (num_data_layers && next_runs) {
+      update_thread_->Run();
+      net_->ForwardTo(num_data_layers - 1);
+      update_thread_->Wait();
+      data_ready = true;
+    } else {
+      ApplyUpdate();
+    }
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
     ++iter_;
 
-    SolverAction::Enum request = GetRequestedAction();
-
     // Save a snapshot if needed.
     if ((param_.snapshot()
          && iter_ % param_.snapshot() == 0
@@ -285,6 +364,7 @@ void Solver<Dtype>::Step(int iters) {
       break;
     }
   }
+  WaitForTests();
 }
 
 template <typename Dtype>
@@ -327,12 +407,35 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   }
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
+    WaitForTests();
   }
   LOG(INFO) << "Optimization Done.";
 }
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  test_iter_ = iter_;
+  if (test_thread_) {
+    // Test a copy of the current weights, while training goes on.
+    WaitForTests();
+    for (int i = 0; i < test_nets_.size(); ++i) {
+      test_nets_[i]->CopyTrainedLayersFrom(net_.get());
+    }
+    test_thread_->Run();
+  } else {
+    RunTests();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForTests() {
+  if (test_thread_) {
+    test_thread_->Wait();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::RunTests() {
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
@@ -343,17 +446,21 @@ void Solver<Dtype>::TestAll() {
 template <typename Dtype>
 void Solver<Dtype>::Test(const int test_net_id) {
   CHECK(Caffe::root_solver());
-  LOG(INFO) << "Iteration " << iter_
+  LOG(INFO) << "Iteration " << test_iter_
             << ", Testing net (#" << test_net_id << ")";
-  CHECK_NOTNULL(test_nets_[test_net_id].get())->
-      ShareTrainedLayersWith(net_.get());
+  if (!test_thread_) {
+    CHECK_NOTNULL(test_nets_[test_net_id].get())->
+        ShareTrainedLayersWith(net_.get());
+  }
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   vector<Blob<Dtype>*> bottom_vec;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
+    // Asynchronous tests leave the requests to the training loop.
+    SolverAction::Enum request = test_thread_ ? SolverAction::NONE :
+        GetRequestedAction();
     // Check to see if stoppage of testing/training has been requested.
     while (request != SolverAction::NONE) {
         if (SolverAction::SNAPSHOT == request) {
@@ -524,6 +631,10 @@ Dtype SGDSolver<Dtype>::GetLearningRate() {
   } else {
     LOG(FATAL) << "Unknown learning rate policy: " << lr_policy;
   }
+  const int warmup_iter = this->param_.warmup_iter();
+  if (this->iter_ < warmup_iter) {
+    rate *= Dtype(this->iter_ + 1) / warmup_iter;
+  }
   return rate;
 }
 
@@ -540,26 +651,75 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  half_params_.clear();
+  loss_scale_ = this->param_.loss_scale();
+  loss_scale_iter_ = 0;
+  if (this->param_.mixed_precision()) {
+    CHECK_GT(loss_scale_, 0) << "loss_scale must be positive.";
+    for (int i = 0; i < net_params.size(); ++i) {
+      half_params_.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>(net_params[i]->shape())));
+    }
+    this->net_->set_half_activations(true,
+        this->param_.mixed_precision_format());
+  }
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
-  const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+void SGDSolver<Dtype>::PrepareIteration() {
+  if (!this->param_.mixed_precision()) { return; }
+  CHECK_EQ(Caffe::mode(), Caffe::CPU)
+      << "Mixed precision training is only implemented on the CPU.";
+  // The master params stay the net's between iterations, for snapshots,
+  // tests and the other processes, and are only swapped, not copied.
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
-  Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+    caffe_cpu_round_half(net_params[i]->count(), Dtype(1),
+        net_params[i]->cpu_data(), this->param_.mixed_precision_format(),
+        half_params_[i]->mutable_cpu_data());
+    net_params[i]->SwapData(half_params_[i].get());
   }
-  const Dtype l2norm_diff = std::sqrt(sumsq_diff);
+  this->net_->set_loss_scale(loss_scale_);
+}
+
+template <typename Dtype>
+bool SGDSolver<Dtype>::RestoreMasterParams() {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  bool finite = true;
+  for (int i = 0; i < net_params.size(); ++i) {
+    const int count = net_params[i]->count();
+    net_params[i]->SwapData(half_params_[i].get());
+    // The gradients come out of the backward pass scaled by the loss scale.
+    Dtype* diff = net_params[i]->mutable_cpu_diff();
+    finite = caffe_cpu_round_half(count, Dtype(1), diff,
+        this->param_.mixed_precision_format(), diff) && finite;
+    caffe_scal(count, Dtype(1) / loss_scale_, diff);
+  }
+  // Back off as soon as the gradients overflow, dropping them, and try a
+  // larger scale after loss_scale_window updates without overflow.
+  if (!finite) {
+    this->net_->ClearParamDiffs();
+    loss_scale_ = std::max(Dtype(1), loss_scale_ / 2);
+    loss_scale_iter_ = 0;
+    return false;
+  }
+  if (this->param_.loss_scale_window() &&
+      ++loss_scale_iter_ >= this->param_.loss_scale_window()) {
+    loss_scale_ *= 2;
+    loss_scale_iter_ = 0;
+  }
+  return true;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype clip_gradients = this->param_.clip_gradients();
+  if (clip_gradients < 0) { return; }
+  const Dtype l2norm_diff = this->net_->ClipParamDiffs(clip_gradients);
   if (l2norm_diff > clip_gradients) {
-    Dtype scale_factor = clip_gradients / l2norm_diff;
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
-        << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+        << "by scale factor " << clip_gradients / l2norm_diff;
   }
 }
 
@@ -570,7 +730,19 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  if (this->param_.mixed_precision() && !RestoreMasterParams()) {
+    LOG(INFO) << "Iteration " << this->iter_ << ", gradient overflow, "
+        << "skipping the update; loss scale = " << loss_scale_;
+    return;
+  }
   ClipGradients();
+  if (Caffe::mode() == Caffe::CPU && this->param_.fused_update()) {
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      FusedUpdate(param_id, rate);
+    }
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -580,6 +752,47 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::UpdateParams(const vector<int>& param_ids) {
+  Dtype rate = GetLearningRate();
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < param_ids.size(); ++i) {
+    const int param_id = param_ids[i];
+    if (Caffe::mode() == Caffe::CPU && this->param_.fused_update()) {
+      FusedUpdate(param_id, rate);
+    } else {
+      Normalize(param_id);
+      Regularize(param_id);
+      ComputeUpdateValue(param_id, rate);
+      net_params[param_id]->Update();
+    }
+  }
+}
+
+template <typename Dtype>
+GradientTerms<Dtype> SGDSolver<Dtype>::FusedGradientTerms(int param_id) {
+  GradientTerms<Dtype> terms;
+  terms.scale = Dtype(1.) / this->param_.iter_size();
+  terms.decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  if (regularization_type == "L1") {
+    terms.l1 = true;
+  } else if (regularization_type != "L2") {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  return terms;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  caffe_cpu_sgd_update(param->count(), FusedGradientTerms(param_id),
+      Dtype(this->param_.momentum()), local_rate, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), history_[param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -724,6 +937,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
   state.set_iter(this->iter_);
   state.set_learned_net(model_filename);
   state.set_current_step(this->current_step_);
+  state.set_loss_scale(loss_scale_);
   state.clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
@@ -749,6 +963,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   hdf5_save_int(file_hid, "iter", this->iter_);
   hdf5_save_string(file_hid, "learned_net", model_filename);
   hdf5_save_int(file_hid, "current_step", this->current_step_);
+  hdf5_save_float(file_hid, "loss_scale", loss_scale_);
   hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(history_hid, 0)
@@ -774,6 +989,9 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
     this->net_->CopyTrainedLayersFrom(net_param);
   }
   this->current_step_ = state.current_step();
+  if (state.has_loss_scale()) {
+    loss_scale_ = state.loss_scale();
+  }
   CHECK_EQ(state.history_size(), history_.size())
       << "Incorrect length of history blobs.";
   LOG(INFO) << "SGDSolver: restoring history";
@@ -792,6 +1010,9 @@ void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
     this->net_->CopyTrainedLayersFrom(learned_net);
   }
   this->current_step_ = hdf5_load_int(file_hid, "current_step");
+  if (H5LTfind_dataset(file_hid, "loss_scale")) {
+    loss_scale_ = hdf5_load_float(file_hid, "loss_scale");
+  }
   hid_t history_hid = H5Gopen2(file_hid, "history", H5P_DEFAULT);
   CHECK_GE(history_hid, 0) << "Error reading history from " << state_file;
   int state_history_size = hdf5_get_num_links(history_hid);
@@ -868,6 +1089,15 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  caffe_cpu_nesterov_update(param->count(), this->FusedGradientTerms(param_id),
+      Dtype(this->param_.momentum()), local_rate, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   CHECK(Caffe::root_solver());
@@ -947,6 +1177,15 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  caffe_cpu_adagrad_update(param->count(), this->FusedGradientTerms(param_id),
+      Dtype(this->param_.delta()), local_rate, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -1022,6 +1261,16 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  caffe_cpu_rmsprop_update(param->count(), this->FusedGradientTerms(param_id),
+      Dtype(this->param_.rms_decay()), Dtype(this->param_.delta()),
+      local_rate, param->mutable_cpu_data(), param->mutable_cpu_diff(),
+      this->history_[param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void AdaDeltaSolver<Dtype>::AdaDeltaPreSolve() {
   // Add the extra history entries for AdaDelta after those from
@@ -1168,6 +1417,19 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  size_t update_history_offset = net_params.size();
+  caffe_cpu_adadelta_update(param->count(), this->FusedGradientTerms(param_id),
+      Dtype(this->param_.momentum()), Dtype(this->param_.delta()), local_rate,
+      param->mutable_cpu_data(), param->mutable_cpu_diff(),
+      this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void AdamSolver<Dtype>::AdamPreSolve() {
   // Add the extra history entries for Adam after those from
@@ -1271,6 +1533,164 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  size_t update_history_offset = net_params.size();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  caffe_cpu_adam_update(param->count(), this->FusedGradientTerms(param_id),
+      beta1, beta2, Dtype(this->param_.delta()), local_rate * correction,
+      param->mutable_cpu_data(), param->mutable_cpu_diff(),
+      this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LARSSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+  // The diff holds the regularized gradient by now.
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype trust = caffe_trust_ratio(Dtype(this->param_.lars_eta()),
+      std::sqrt(param->sumsq_data()), std::sqrt(param->sumsq_diff()));
+  SGDSolver<Dtype>::ComputeUpdateValue(param_id, rate * trust);
+}
+
+template <typename Dtype>
+void LARSSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  caffe_cpu_lars_update(param->count(), this->FusedGradientTerms(param_id),
+      Dtype(this->param_.momentum()), Dtype(this->param_.lars_eta()),
+      local_rate, param->mutable_cpu_data(), param->mutable_cpu_diff(),
+      this->history_[param_id]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LAMBSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+
+  // we create aliases for convenience
+  size_t update_history_offset = net_params.size();
+  Blob<Dtype>* val_m = this->history_[param_id].get();
+  Blob<Dtype>* val_v = this->history_[param_id + update_history_offset].get();
+  Blob<Dtype>* val_t = this->temp_[param_id].get();
+
+  const int t = this->iter_ + 1;
+  const Dtype bias1 = Dtype(1) - pow(beta1, t);
+  const Dtype bias2 = Dtype(1) - pow(beta2, t);
+  const int N = param->count();
+  const Dtype eps = this->param_.delta();
+
+  // Compute the direction r = m_hat / (sqrt(v_hat) + eps) + decay term in
+  // val_t, then scale it by the trust ratio into the diff.
+  Dtype direction_sumsq = 0;
+  switch (Caffe::mode()) {
+  case Caffe::CPU: {
+    caffe_cpu_axpby(N, Dtype(1) - beta1, param->cpu_diff(), beta1,
+        val_m->mutable_cpu_data());
+    caffe_mul(N, param->cpu_diff(), param->cpu_diff(),
+        val_t->mutable_cpu_data());
+    caffe_cpu_axpby(N, Dtype(1) - beta2, val_t->cpu_data(), beta2,
+        val_v->mutable_cpu_data());
+    caffe_powx(N, val_v->cpu_data(), Dtype(0.5), val_t->mutable_cpu_data());
+    caffe_scal(N, Dtype(1) / std::sqrt(bias2), val_t->mutable_cpu_data());
+    caffe_add_scalar(N, eps, val_t->mutable_cpu_data());
+    caffe_div(N, val_m->cpu_data(), val_t->cpu_data(),
+        val_t->mutable_cpu_data());
+    caffe_scal(N, Dtype(1) / bias1, val_t->mutable_cpu_data());
+    if (local_decay) {
+      if (regularization_type == "L2") {
+        caffe_axpy(N, local_decay, param->cpu_data(),
+            val_t->mutable_cpu_data());
+      } else if (regularization_type == "L1") {
+        // the gradient is no longer needed, so the diff holds the signs
+        caffe_cpu_sign(N, param->cpu_data(), param->mutable_cpu_diff());
+        caffe_axpy(N, local_decay, param->cpu_diff(),
+            val_t->mutable_cpu_data());
+      } else {
+        LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+      }
+    }
+    direction_sumsq = caffe_cpu_dot(N, val_t->cpu_data(), val_t->cpu_data());
+    const Dtype trust = caffe_trust_ratio(Dtype(1),
+        std::sqrt(param->sumsq_data()), std::sqrt(direction_sumsq));
+    caffe_cpu_scale(N, local_rate * trust, val_t->cpu_data(),
+        param->mutable_cpu_diff());
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    caffe_gpu_axpby(N, Dtype(1) - beta1, param->gpu_diff(), beta1,
+        val_m->mutable_gpu_data());
+    caffe_gpu_mul(N, param->gpu_diff(), param->gpu_diff(),
+        val_t->mutable_gpu_data());
+    caffe_gpu_axpby(N, Dtype(1) - beta2, val_t->gpu_data(), beta2,
+        val_v->mutable_gpu_data());
+    caffe_gpu_powx(N, val_v->gpu_data(), Dtype(0.5),
+        val_t->mutable_gpu_data());
+    caffe_gpu_scal(N, Dtype(1) / std::sqrt(bias2), val_t->mutable_gpu_data());
+    caffe_gpu_add_scalar(N, eps, val_t->mutable_gpu_data());
+    caffe_gpu_div(N, val_m->gpu_data(), val_t->gpu_data(),
+        val_t->mutable_gpu_data());
+    caffe_gpu_scal(N, Dtype(1) / bias1, val_t->mutable_gpu_data());
+    if (local_decay) {
+      if (regularization_type == "L2") {
+        caffe_gpu_axpy(N, local_decay, param->gpu_data(),
+            val_t->mutable_gpu_data());
+      } else if (regularization_type == "L1") {
+        // the gradient is no longer needed, so the diff holds the signs
+        caffe_gpu_sign(N, param->gpu_data(), param->mutable_gpu_diff());
+        caffe_gpu_axpy(N, local_decay, param->gpu_diff(),
+            val_t->mutable_gpu_data());
+      } else {
+        LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+      }
+    }
+    caffe_gpu_dot(N, val_t->gpu_data(), val_t->gpu_data(), &direction_sumsq);
+    const Dtype trust = caffe_trust_ratio(Dtype(1),
+        std::sqrt(param->sumsq_data()), std::sqrt(direction_sumsq));
+    caffe_gpu_scale(N, local_rate * trust, val_t->gpu_data(),
+        param->mutable_gpu_diff());
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+}
+
+template <typename Dtype>
+void LAMBSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  size_t update_history_offset = net_params.size();
+  const int t = this->iter_ + 1;
+  const Dtype bias1 = Dtype(1) - pow(beta1, t);
+  const Dtype bias2 = Dtype(1) - pow(beta2, t);
+  caffe_cpu_lamb_update(param->count(), this->FusedGradientTerms(param_id),
+      beta1, beta2, bias1, bias2, Dtype(this->param_.delta()), local_rate,
+      param->mutable_cpu_data(), param->mutable_cpu_diff(),
+      this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data());
+}
+
 INSTANTIATE_CLASS(Solver);
 INSTANTIATE_CLASS(SGDSolver);
 INSTANTIATE_CLASS(NesterovSolver);
@@ -1278,5 +1698,7 @@ INSTANTIATE_CLASS(AdaGradSolver);
 INSTANTIATE_CLASS(RMSPropSolver);
 INSTANTIATE_CLASS(AdaDeltaSolver);
 INSTANTIATE_CLASS(AdamSolver);
+INSTANTIATE_CLASS(LARSSolver);
+INSTANTIATE_CLASS(LAMBSolver);
 
 }  // namespace caffe
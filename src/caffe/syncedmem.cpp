@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 
 #include "caffe/common.hpp"
@@ -78,6 +79,18 @@ inline void SyncedMemory::to_gpu() {
 #endif
 }
 
+void SyncedMemory::swap(SyncedMemory* other) {
+  CHECK_EQ(size_, other->size_);
+  std::swap(cpu_ptr_, other->cpu_ptr_);
+  std::swap(gpu_ptr_, other->gpu_ptr_);
+  std::swap(head_, other->head_);
+  std::swap(own_cpu_data_, other->own_cpu_data_);
+  std::swap(own_gpu_data_, other->own_gpu_data_);
+  std::swap(gpu_device_, other->gpu_device_);
+  ++writes_;
+  ++other->writes_;
+}
+
 const void* SyncedMemory::cpu_data() {
   to_cpu();
   return (const void*)cpu_ptr_;
@@ -91,6 +104,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  ++writes_;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -117,6 +131,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  ++writes_;
 #else
   NO_GPU;
 #endif
@@ -125,6 +140,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++writes_;
   return cpu_ptr_;
 }
 
@@ -132,6 +148,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++writes_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -105,6 +105,229 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestCompactToHalf) {
+  const TypeParam values[] = { 0, -2.25, 1, 65504, 1e6, 1 + 1. / 2048,
+      1 + 3. / 2048, 1. / (1 << 24) };
+  const TypeParam fp16_values[] = { 0, -2.25, 1, 65504, INFINITY, 1,
+      1 + 1. / 512, 1. / (1 << 24) };
+  const TypeParam bf16_values[] = { 0, -2.25, 1, 65536, 999424, 1, 1,
+      1. / (1 << 24) };
+  const int count = sizeof(values) / sizeof(values[0]);
+  for (int format = FP16; format <= BF16; ++format) {
+    const TypeParam* expected = format == FP16 ? fp16_values : bf16_values;
+    vector<int> shape(1, count);
+    this->blob_->Reshape(shape);
+    caffe_copy(count, values, this->blob_->mutable_cpu_data());
+    this->blob_->CompactToHalf(static_cast<HalfFormat>(format));
+    EXPECT_TRUE(this->blob_->is_half());
+    EXPECT_EQ(format, this->blob_->half_format());
+    BlobProto proto;
+    this->blob_->ToProto(&proto);
+    EXPECT_EQ(0, proto.data_size());
+    EXPECT_EQ(0, proto.double_data_size());
+    EXPECT_EQ(count * sizeof(uint16_t), proto.half_data().size());
+    // The data can be read after expanding it, which keeps the 16-bit copy
+    // for compacting again.
+    TypeParam copy[count];
+    this->blob_->ExpandData(copy);
+    EXPECT_TRUE(this->blob_->is_half());
+    this->blob_->Expand();
+    EXPECT_FALSE(this->blob_->is_half());
+    const TypeParam* data = this->blob_->cpu_data();
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(expected[i], data[i]);
+      EXPECT_EQ(expected[i], copy[i]);
+    }
+    this->blob_->CompactToHalf(static_cast<HalfFormat>(format));
+    EXPECT_TRUE(this->blob_->is_half());
+    // Writing the data drops the 16-bit copy.
+    this->blob_->mutable_cpu_data()[0] = 3;
+    this->blob_->ToProto(&proto);
+    EXPECT_FALSE(proto.has_half_data());
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfFromProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  this->blob_preshaped_->CompactToHalf(BF16);
+  BlobProto proto;
+  this->blob_preshaped_->ToProto(&proto);
+  this->blob_->FromProto(proto);
+  EXPECT_TRUE(this->blob_->shape() == this->blob_preshaped_->shape());
+  EXPECT_TRUE(this->blob_->is_half());
+  EXPECT_EQ(BF16, this->blob_->half_format());
+  const int count = this->blob_->count();
+  EXPECT_EQ(0, memcmp(this->blob_->cpu_half_data(),
+      this->blob_preshaped_->cpu_half_data(), count * sizeof(uint16_t)));
+  this->blob_->Expand();
+  this->blob_preshaped_->Expand();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(this->blob_preshaped_->cpu_data()[i],
+        this->blob_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfFromProtoBorrowed) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  this->blob_preshaped_->CompactToHalf(FP16);
+  BlobProto proto;
+  this->blob_preshaped_->ToProto(&proto);
+  // A blob backed by a buffer it does not own, as the params in
+  // Net::param_arena, is decoded in place.
+  const int count = this->blob_preshaped_->count();
+  vector<TypeParam> buffer(count);
+  this->blob_->ReshapeLike(*this->blob_preshaped_);
+  this->blob_->set_cpu_data(&buffer[0]);
+  this->blob_->FromProto(proto);
+  EXPECT_FALSE(this->blob_->is_half());
+  EXPECT_EQ(&buffer[0], this->blob_->cpu_data());
+  this->blob_preshaped_->Expand();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(this->blob_preshaped_->cpu_data()[i], buffer[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfFromProtoReplacesSparse) {
+  const TypeParam values[] = { 0, 1.5, 0, 0, -2, 0, 0, 0, 0, 3, 0, 4 };
+  const int count = sizeof(values) / sizeof(values[0]);
+  vector<int> shape(2);
+  shape[0] = 3;
+  shape[1] = 4;
+  this->blob_->Reshape(shape);
+  caffe_copy(count, values, this->blob_->mutable_cpu_data());
+  this->blob_->CompactToSparse();
+  // Loading 16-bit data drops the sparse copy of the previous data.
+  Blob<TypeParam> half(shape);
+  caffe_set(count, TypeParam(2), half.mutable_cpu_data());
+  half.CompactToHalf(FP16);
+  BlobProto proto;
+  half.ToProto(&proto);
+  this->blob_->FromProto(proto);
+  EXPECT_TRUE(this->blob_->is_half());
+  EXPECT_FALSE(this->blob_->is_sparse());
+  this->blob_->Expand();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(2, this->blob_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestCompactToSparse) {
+  const TypeParam values[] = { 0, 1.5, 0, 0, -2, 0, 0, 0, 0, 3, 0, 4 };
+  const int count = sizeof(values) / sizeof(values[0]);
+  vector<int> shape(2);
+  shape[0] = 3;
+  shape[1] = 4;
+  this->blob_->Reshape(shape);
+  caffe_copy(count, values, this->blob_->mutable_cpu_data());
+  EXPECT_EQ(2. / 3., caffe_cpu_sparsity(count, this->blob_->cpu_data()));
+  this->blob_->CompactToSparse();
+  EXPECT_TRUE(this->blob_->is_sparse());
+  const SparseMatrix<TypeParam>& sparse = this->blob_->cpu_sparse_data();
+  EXPECT_EQ(3, sparse.rows);
+  EXPECT_EQ(4, sparse.cols);
+  EXPECT_EQ(4, sparse.nnz());
+  const int row_ptr[] = { 0, 1, 2, 4 };
+  const int col_idx[] = { 1, 0, 1, 3 };
+  for (int i = 0; i <= sparse.rows; ++i) {
+    EXPECT_EQ(row_ptr[i], sparse.row_ptr[i]);
+  }
+  for (int k = 0; k < sparse.nnz(); ++k) {
+    EXPECT_EQ(col_idx[k], sparse.col_idx[k]);
+  }
+  BlobProto proto;
+  this->blob_->ToProto(&proto);
+  EXPECT_EQ(0, proto.data_size());
+  EXPECT_EQ(0, proto.double_data_size());
+  EXPECT_EQ(4, proto.sparse_col_size());
+  // Expanding the data keeps the sparse copy.
+  this->blob_->Expand();
+  const TypeParam* data = this->blob_->cpu_data();
+  EXPECT_FALSE(this->blob_->is_sparse());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(values[i], data[i]);
+  }
+  // Loading a sparse proto keeps the blob sparse.
+  Blob<TypeParam> loaded;
+  loaded.FromProto(proto);
+  EXPECT_TRUE(loaded.shape() == shape);
+  EXPECT_TRUE(loaded.is_sparse());
+  // As does sharing it.
+  Blob<TypeParam> shared(shape);
+  shared.ShareData(loaded);
+  EXPECT_TRUE(shared.is_sparse());
+  loaded.Expand();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(values[i], loaded.cpu_data()[i]);
+  }
+  // Writing the data drops the sparse copy.
+  this->blob_->mutable_cpu_data()[0] = 3;
+  this->blob_->ToProto(&proto);
+  EXPECT_EQ(0, proto.sparse_row_size());
+  EXPECT_EQ(count, proto.data_size() + proto.double_data_size());
+}
+
+TYPED_TEST(BlobSimpleTest, TestDataView) {
+  vector<int> shape(1, 3);
+  Blob<TypeParam> view(shape);
+  view.ShareDataView(*this->blob_preshaped_, 6);
+  view.ShareDiffView(*this->blob_preshaped_, 6);
+  EXPECT_TRUE(view.IsDataViewOf(*this->blob_preshaped_, 6));
+  EXPECT_FALSE(view.IsDataViewOf(*this->blob_preshaped_, 0));
+  EXPECT_EQ(this->blob_preshaped_->cpu_data() + 6, view.cpu_data());
+  EXPECT_EQ(this->blob_preshaped_->cpu_diff() + 6, view.cpu_diff());
+  // Views of views are offset from the original blob.
+  Blob<TypeParam> subview(vector<int>(1, 2));
+  subview.ShareDataView(view, 1);
+  EXPECT_TRUE(subview.IsDataViewOf(*this->blob_preshaped_, 7));
+  subview.mutable_cpu_data()[0] = 5;
+  EXPECT_EQ(5, this->blob_preshaped_->cpu_data()[7]);
+  // Reshaping within the count keeps the view, growing leaves it.
+  view.Reshape(vector<int>(1, 2));
+  EXPECT_TRUE(view.IsDataViewOf(*this->blob_preshaped_, 6));
+  view.Reshape(shape);
+  EXPECT_TRUE(view.IsDataViewOf(*this->blob_preshaped_, 6));
+  view.Reshape(vector<int>(1, 4));
+  EXPECT_FALSE(view.IsDataViewOf(*this->blob_preshaped_, 6));
+  EXPECT_FALSE(view.IsDiffViewOf(*this->blob_preshaped_, 6));
+}
+
+TYPED_TEST(BlobSimpleTest, TestReserve) {
+  vector<int> shape(2, 3);
+  this->blob_->Reshape(shape);
+  vector<int> max_shape(2, 5);
+  this->blob_->Reserve(max_shape);
+  EXPECT_EQ(shape, this->blob_->shape());
+  // Reshaping up to the reserved size keeps the memory.
+  const TypeParam* data = this->blob_->cpu_data();
+  const unsigned int version = this->blob_->version();
+  this->blob_->Reshape(max_shape);
+  EXPECT_EQ(data, this->blob_->cpu_data());
+  EXPECT_NE(version, this->blob_->version());
+  this->blob_->Reserve(shape);
+  this->blob_->Reshape(shape);
+  EXPECT_EQ(data, this->blob_->cpu_data());
+}
+
+TYPED_TEST(BlobSimpleTest, TestVersion) {
+  const unsigned int version = this->blob_preshaped_->version();
+  this->blob_preshaped_->Reshape(2, 3, 4, 5);
+  this->blob_preshaped_->mutable_cpu_data();
+  EXPECT_EQ(version, this->blob_preshaped_->version());
+  this->blob_preshaped_->Reshape(3, 2, 4, 5);
+  EXPECT_NE(version, this->blob_preshaped_->version());
+  Blob<TypeParam> other(3, 2, 4, 5);
+  const unsigned int shared_version = other.version();
+  other.ShareData(*this->blob_preshaped_);
+  EXPECT_NE(shared_version, other.version());
+  const unsigned int reshared_version = other.version();
+  other.ShareData(*this->blob_preshaped_);
+  EXPECT_EQ(reshared_version, other.version());
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
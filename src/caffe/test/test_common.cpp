@@ -44,6 +44,17 @@ TEST_F(CommonTest, TestRandSeedCPU) {
   }
 }
 
+TEST_F(CommonTest, TestCPUWorkspace) {
+  // The workspace is reused while it is large enough, and grows otherwise.
+  int* small = static_cast<int*>(Caffe::cpu_workspace(10 * sizeof(int)));
+  small[9] = 1701;
+  int* smaller = static_cast<int*>(Caffe::cpu_workspace(5 * sizeof(int)));
+  EXPECT_EQ(small, smaller);
+  int* large = static_cast<int*>(Caffe::cpu_workspace(1000 * sizeof(int)));
+  large[999] = 1701;
+  EXPECT_EQ(large, Caffe::cpu_workspace(10 * sizeof(int)));
+}
+
 #ifndef CPU_ONLY  // GPU Caffe singleton test.
 
 TEST_F(CommonTest, TestRandSeedGPU) {
@@ -141,6 +141,36 @@ TYPED_TEST(ConcatLayerTest, TestForwardNum) {
   }
 }
 
+TYPED_TEST(ConcatLayerTest, TestForwardNumViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_axis(0);
+  layer_param.mutable_concat_param()->set_view_bottoms(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  const int offset = this->blob_bottom_0_->count();
+  EXPECT_TRUE(this->blob_bottom_0_->IsDataViewOf(*this->blob_top_, 0));
+  EXPECT_TRUE(this->blob_bottom_2_->IsDataViewOf(*this->blob_top_, offset));
+  EXPECT_TRUE(this->blob_bottom_2_->IsDiffViewOf(*this->blob_top_, offset));
+  // The values of the bottoms are kept, and written in the top.
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(i < offset ? 1 : 3, this->blob_top_->cpu_data()[i]);
+  }
+  // Growing a bottom moves the parts.
+  this->blob_bottom_0_->Reshape(3, 3, 6, 5);
+  caffe_set(this->blob_bottom_0_->count(), Dtype(4),
+      this->blob_bottom_0_->mutable_cpu_data());
+  layer.Reshape(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  EXPECT_TRUE(this->blob_bottom_2_->IsDataViewOf(*this->blob_top_,
+      this->blob_bottom_0_->count()));
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(i < this->blob_bottom_0_->count() ? 4 : 3,
+        this->blob_top_->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(ConcatLayerTest, TestForwardChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -187,6 +217,17 @@ TYPED_TEST(ConcatLayerTest, TestGradientNum) {
     this->blob_top_vec_);
 }
 
+TYPED_TEST(ConcatLayerTest, TestGradientNumViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_axis(0);
+  layer_param.mutable_concat_param()->set_view_bottoms(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradient(&layer, this->blob_bottom_vec_1_,
+    this->blob_top_vec_);
+}
+
 TYPED_TEST(ConcatLayerTest, TestGradientChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
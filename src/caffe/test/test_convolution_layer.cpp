@@ -1,11 +1,15 @@
 #include <cstring>
+#include <string>
 #include <vector>
 
+#include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/layout.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -272,6 +276,241 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestHalfConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->blobs()[0]->CompactToHalf(BF16);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(layer->blobs()[0]->is_half());
+  // The reference reads the weights expanded from the same 16-bit values.
+  layer->blobs()[0]->Expand();
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSparseConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Prune most of the weights, leaving one filter entirely zero.
+  Blob<Dtype>* weights = layer->blobs()[0].get();
+  Dtype* weight_data = weights->mutable_cpu_data();
+  for (int i = 0; i < weights->count(); ++i) {
+    if (i % 3 != 0 || i >= weights->count(1)) {
+      weight_data[i] = 0;
+    }
+  }
+  weight_data[weights->count() - 1] = 1;
+  weights->CompactToSparse();
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_TRUE(weights->is_sparse());
+  }
+  weights->Expand();
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestInt8ConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Put the input and the weights on the int8 grid with unit scales, so that
+  // quantization is lossless and the result must match the reference exactly.
+  Dtype* bottom_data = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    bottom_data[i] = (i * 73) % 255 - 127;
+  }
+  bottom_data[0] = 127;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_precision(QuantizationParameter_Precision_INT8);
+  quantization_param->set_input_range(127);
+  for (int per_channel = 0; per_channel <= 1; ++per_channel) {
+    quantization_param->set_per_channel(per_channel);
+    shared_ptr<Layer<Dtype> > layer(
+        new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype>* weights = layer->blobs()[0].get();
+    const int kernel_dim = weights->count(1);
+    Dtype* weight_data = weights->mutable_cpu_data();
+    for (int i = 0; i < weights->count(); ++i) {
+      weight_data[i] = (i * 31) % 255 - 127;
+    }
+    for (int i = 0; i < weights->num(); ++i) {
+      weight_data[i * kernel_dim] = i % 2 ? 127 : -127;
+    }
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBlockedConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(8);
+  convolution_param->set_channel_block(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(4, this->blob_top_->channel_block());
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const int spatial_dim = this->blob_top_->count(2);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int n = 0; n < this->blob_top_->num(); ++n) {
+    for (int c = 0; c < this->blob_top_->channels(); ++c) {
+      for (int s = 0; s < spatial_dim; ++s) {
+        EXPECT_NEAR(top_data[this->blob_top_->offset(n) +
+            channel_block_offset(spatial_dim, 4, c, s)],
+            ref_top_data[this->blob_top_->offset(n, c) + s], 1e-4);
+      }
+    }
+  }
+  // Convolve the blocked output again into a different block.
+  convolution_param->set_kernel_size(2);
+  convolution_param->set_stride(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_channel_block(2);
+  layer.reset(new ConvolutionLayer<Dtype>(layer_param));
+  vector<Blob<Dtype>*> bottom_vec(1, this->blob_top_);
+  vector<Blob<Dtype>*> top_vec(1, this->blob_top_2_);
+  layer->SetUp(bottom_vec, top_vec);
+  layer->Forward(bottom_vec, top_vec);
+  EXPECT_EQ(2, this->blob_top_2_->channel_block());
+  Blob<Dtype> ref_top_2(this->blob_top_2_->shape());
+  caffe_set(ref_top_2.count(), Dtype(0), ref_top_2.mutable_cpu_data());
+  caffe_conv(this->ref_blob_top_.get(), convolution_param, layer->blobs(),
+      &ref_top_2);
+  const int spatial_dim_2 = this->blob_top_2_->count(2);
+  top_data = this->blob_top_2_->cpu_data();
+  ref_top_data = ref_top_2.cpu_data();
+  for (int n = 0; n < this->blob_top_2_->num(); ++n) {
+    for (int c = 0; c < this->blob_top_2_->channels(); ++c) {
+      for (int s = 0; s < spatial_dim_2; ++s) {
+        EXPECT_NEAR(top_data[this->blob_top_2_->offset(n) +
+            channel_block_offset(spatial_dim_2, 2, c, s)],
+            ref_top_data[ref_top_2.offset(n, c) + s], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSharedWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The column buffers of the layers of a net are the workspace of the
+  // thread, which the second layer reuses, as it needs less.
+  const string& proto =
+      "input: 'data' "
+      "input_shape { dim: 2 dim: 3 dim: 6 dim: 4 } "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    stride: 2 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_h: 2 "
+      "    kernel_w: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  net.input_blobs()[0]->CopyFrom(*this->blob_bottom_);
+  net.ForwardPrefilled();
+  const void* workspace = Caffe::mode() == Caffe::CPU ?
+      Caffe::cpu_workspace(0) : Caffe::gpu_workspace(0);
+  net.ForwardPrefilled();
+  EXPECT_EQ(workspace, Caffe::mode() == Caffe::CPU ?
+      Caffe::cpu_workspace(0) : Caffe::gpu_workspace(0));
+  // Each output is still that of its own convolution.
+  const char* names[] = {"data", "conv1", "conv2"};
+  for (int i = 1; i < 3; ++i) {
+    Layer<Dtype>& layer = *net.layer_by_name(names[i]);
+    ConvolutionParameter conv_param = layer.layer_param().convolution_param();
+    const Blob<Dtype>& top = *net.blob_by_name(names[i]);
+    Blob<Dtype> ref_top(top.shape());
+    caffe_conv(net.blob_by_name(names[i - 1]).get(), &conv_param,
+        layer.blobs(), &ref_top);
+    for (int j = 0; j < top.count(); ++j) {
+      EXPECT_NEAR(top.cpu_data()[j], ref_top.cpu_data()[j], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
@@ -0,0 +1,210 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/transport.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Runs one process of the group, on its own thread, copying its final
+// weights to weights. With seed_per_rank, each process draws its own data.
+template <typename Dtype>
+static void DistSyncRank(SolverParameter param, const string& uri,
+    int rank, int size, bool seed_per_rank, vector<Dtype>* weights) {
+  if (seed_per_rank) {
+    param.set_random_seed(param.random_seed() + rank);
+  }
+  shared_ptr<Transport> transport(new SocketTransport(uri, rank, size));
+  shared_ptr<Solver<Dtype> > solver(new SGDSolver<Dtype>(param));
+  DistSync<Dtype> sync(solver, transport);
+  sync.run();
+  const vector<Blob<Dtype>*>& params = solver->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    weights->insert(weights->end(), params[i]->cpu_data(),
+        params[i]->cpu_data() + params[i]->count());
+  }
+}
+
+template <typename Dtype>
+class DistSyncTest : public ::testing::Test {
+ protected:
+  DistSyncTest() {
+    MakeTempDir(&temp_dir_);
+    const string& net_proto =
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 3 } "
+        "    shape { dim: 4 dim: 2 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'targets' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip2' "
+        "  bottom: 'targets' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(net_proto,
+        param_.mutable_net_param()));
+    param_.set_base_lr(0.01);
+    param_.set_lr_policy("fixed");
+    param_.set_momentum(0.9);
+    param_.set_weight_decay(0.01);
+    param_.set_max_iter(6);
+    param_.set_display(0);
+    param_.set_snapshot_after_train(false);
+    param_.set_random_seed(1701);
+  }
+
+  // Trains with size processes, returning the final weights of each one.
+  void RunGroup(int size, bool seed_per_rank,
+      vector<vector<Dtype> >* weights) {
+    const string uri = "unix://" + temp_dir_ + "/socket";
+    weights->assign(size, vector<Dtype>());
+    vector<shared_ptr<boost::thread> > threads;
+    for (int rank = 0; rank < size; ++rank) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &DistSyncRank<Dtype>, param_, uri, rank, size, seed_per_rank,
+          &(*weights)[rank])));
+    }
+    for (int rank = 0; rank < size; ++rank) {
+      threads[rank]->join();
+    }
+  }
+
+  // Processes seeded alike see the same data, so that averaging their
+  // gradients is plain SGD.
+  void CheckMatchesSGD(int size) {
+    vector<vector<Dtype> > weights;
+    RunGroup(size, false, &weights);
+    SGDSolver<Dtype> solver(param_);
+    solver.Solve();
+    const vector<Blob<Dtype>*>& params = solver.net()->learnable_params();
+    for (int rank = 0; rank < size; ++rank) {
+      int offset = 0;
+      for (int i = 0; i < params.size(); ++i) {
+        for (int j = 0; j < params[i]->count(); ++j) {
+          EXPECT_NEAR(params[i]->cpu_data()[j], weights[rank][offset + j],
+              1e-5);
+        }
+        offset += params[i]->count();
+      }
+      EXPECT_EQ(offset, weights[rank].size());
+    }
+  }
+
+  // Processes drawing different data end up with the same weights as with
+  // a single reduction after the backward pass.
+  void CheckMatchesSingleReduce(int size) {
+    vector<vector<Dtype> > weights;
+    RunGroup(size, true, &weights);
+    SolverParameter param = param_;
+    param_.clear_reduce_bucket_size();
+    param_.mutable_net_param()->clear_contiguous_params();
+    vector<vector<Dtype> > expected;
+    RunGroup(size, true, &expected);
+    param_ = param;
+    for (int rank = 0; rank < size; ++rank) {
+      ASSERT_EQ(expected[0].size(), weights[rank].size());
+      for (int i = 0; i < weights[rank].size(); ++i) {
+        EXPECT_EQ(weights[0][i], weights[rank][i]);
+        EXPECT_NEAR(expected[0][i], weights[rank][i], 1e-5);
+      }
+    }
+  }
+
+  SolverParameter param_;
+  string temp_dir_;
+};
+
+TYPED_TEST_CASE(DistSyncTest, TestDtypes);
+
+TYPED_TEST(DistSyncTest, TestMatchesSGD) {
+  this->CheckMatchesSGD(2);
+}
+
+TYPED_TEST(DistSyncTest, TestWeightsStayIdentical) {
+  typedef TypeParam Dtype;
+  vector<vector<Dtype> > weights;
+  this->RunGroup(3, true, &weights);
+  for (int rank = 1; rank < weights.size(); ++rank) {
+    ASSERT_EQ(weights[0].size(), weights[rank].size());
+    for (int i = 0; i < weights[rank].size(); ++i) {
+      EXPECT_EQ(weights[0][i], weights[rank][i]);
+    }
+  }
+}
+
+TYPED_TEST(DistSyncTest, TestHalfCompression) {
+  // The 16-bit gradients are summed along the ring, and the weights stay
+  // identical.
+  typedef TypeParam Dtype;
+  this->param_.set_gradient_compression(SolverParameter::BF16);
+  this->param_.set_reduce_bucket_size(4);
+  vector<vector<Dtype> > weights;
+  this->RunGroup(3, true, &weights);
+  this->param_.clear_gradient_compression();
+  vector<vector<Dtype> > expected;
+  this->RunGroup(3, true, &expected);
+  for (int rank = 0; rank < weights.size(); ++rank) {
+    ASSERT_EQ(expected[0].size(), weights[rank].size());
+    for (int i = 0; i < weights[rank].size(); ++i) {
+      EXPECT_EQ(weights[0][i], weights[rank][i]);
+      EXPECT_NEAR(expected[0][i], weights[rank][i], 1e-2);
+    }
+  }
+}
+
+TYPED_TEST(DistSyncTest, TestBuckets) {
+  // One bucket per layer, reduced during the backward pass.
+  this->param_.set_reduce_bucket_size(4);
+  this->CheckMatchesSGD(3);
+  this->CheckMatchesSingleReduce(3);
+}
+
+TYPED_TEST(DistSyncTest, TestContiguousParams) {
+  // The gradients are reduced in the param arena.
+  this->param_.mutable_net_param()->set_contiguous_params(true);
+  this->param_.set_reduce_bucket_size(4);
+  this->CheckMatchesSGD(2);
+  this->CheckMatchesSingleReduce(2);
+}
+
+}  // namespace caffe
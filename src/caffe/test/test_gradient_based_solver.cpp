@@ -26,7 +26,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), fused_update_(false), regularization_type_("L2"),
+      warmup_iter_(0), mixed_precision_(false), loss_scale_(1),
+      loss_scale_window_(0), pipelined_(false) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -42,7 +44,16 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
-  Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
+  bool fused_update_;
+  string regularization_type_;
+  int warmup_iter_;
+  // Mixed precision in FP16, with the given loss scaling.
+  bool mixed_precision_;
+  float loss_scale_;
+  int loss_scale_window_;
+  bool pipelined_;
+  // Stability constant for RMSProp, AdaGrad, AdaDelta, Adam and LAMB
+  Dtype delta_;
 
   // Test data: check out generate_sample_data.py in the same directory.
   string* input_file_;
@@ -177,6 +188,23 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    if (fused_update_) {
+      proto << "fused_update: true ";
+    }
+    if (regularization_type_ != "L2") {
+      proto << "regularization_type: '" << regularization_type_ << "' ";
+    }
+    if (warmup_iter_) {
+      proto << "warmup_iter: " << warmup_iter_ << " ";
+    }
+    if (mixed_precision_) {
+      proto << "mixed_precision: true mixed_precision_format: FP16 "
+            << "loss_scale: " << loss_scale_ << " "
+            << "loss_scale_window: " << loss_scale_window_ << " ";
+    }
+    if (pipelined_) {
+      proto << "pipelined: true ";
+    }
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
@@ -223,11 +251,13 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // using the analytical formula for the least squares gradient.
   // updated_params will store the updated weight and bias results,
   // using the blobs' diffs to hold the update values themselves.
-  void ComputeLeastSquaresUpdate(const Dtype learning_rate,
+  void ComputeLeastSquaresUpdate(const Dtype base_learning_rate,
       const Dtype weight_decay, const Dtype momentum, const int num_iters,
       vector<shared_ptr<Blob<Dtype> > >* updated_params) {
     const int N = num_;
     const int D = channels_ * height_ * width_;
+    const Dtype learning_rate = num_iters < warmup_iter_ ?
+        base_learning_rate * num_iters / warmup_iter_ : base_learning_rate;
 
     // Run a forward pass, and manually compute the update values from the
     // result.
@@ -291,7 +321,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       // Finally, compute update.
       const vector<shared_ptr<Blob<Dtype> > >& history = solver_->history();
       if (solver_type() != SolverParameter_SolverType_ADADELTA
-          && solver_type() != SolverParameter_SolverType_ADAM) {
+          && solver_type() != SolverParameter_SolverType_ADAM
+          && solver_type() != SolverParameter_SolverType_LAMB) {
         ASSERT_EQ(2, history.size());  // 1 blob for weights, 1 for bias
       } else {
         ASSERT_EQ(4, history.size());  // additional blobs for update history
@@ -346,6 +377,30 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
         update_value = alpha_t * val_m / (std::sqrt(val_v) + delta_);
         break;
       }
+      // The layer-wise solvers only compute the direction of the update
+      // here, it is scaled by the trust ratio of its blob below.
+      case SolverParameter_SolverType_LARS:
+        update_value = grad;
+        break;
+      case SolverParameter_SolverType_LAMB: {
+        const Dtype momentum2 = 0.999;
+        const Dtype param_value =
+            (i == D) ? bias.cpu_data()[0] : weights.cpu_data()[i];
+        // the weight decay is decoupled from the moments
+        const Dtype raw_grad = grad - weight_decay * param_value;
+        const Dtype m = history_value;
+        const Dtype v = (i == D) ?
+            history[1 + num_param_blobs]->cpu_data()[0] :
+            history[0 + num_param_blobs]->cpu_data()[i];
+        const Dtype val_m = (1 - momentum) * raw_grad + momentum * m;
+        const Dtype val_v =
+            (1 - momentum2) * raw_grad * raw_grad + momentum2 * v;
+        const Dtype m_hat = val_m / (Dtype(1) - pow(momentum, num_iters));
+        const Dtype v_hat = val_v / (Dtype(1) - pow(momentum2, num_iters));
+        update_value = m_hat / (std::sqrt(v_hat) + delta_) +
+            weight_decay * param_value;
+        break;
+      }
       default:
         LOG(FATAL) << "Unknown solver type: " << solver_type();
       }
@@ -358,6 +413,38 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
             weights.cpu_data()[i] - update_value;
       }
     }
+    if (solver_type() == SolverParameter_SolverType_LARS
+        || solver_type() == SolverParameter_SolverType_LAMB) {
+      const bool lars = solver_type() == SolverParameter_SolverType_LARS;
+      const Blob<Dtype>* blobs[] = { &weights, &bias };
+      Blob<Dtype>* updated_blobs[] = { &updated_weights, &updated_bias };
+      for (int b = 0; b < num_param_blobs; ++b) {
+        const Dtype* param_data = blobs[b]->cpu_data();
+        Dtype* direction = updated_blobs[b]->mutable_cpu_diff();
+        Dtype data_sumsq = 0;
+        Dtype direction_sumsq = 0;
+        for (int j = 0; j < blobs[b]->count(); ++j) {
+          data_sumsq += param_data[j] * param_data[j];
+          direction_sumsq += direction[j] * direction[j];
+        }
+        Dtype trust = 1;
+        if (data_sumsq > 0 && direction_sumsq > 0) {
+          trust = std::sqrt(data_sumsq / direction_sumsq);
+          if (lars) {
+            trust *= solver_->param().lars_eta();
+          }
+        }
+        for (int j = 0; j < blobs[b]->count(); ++j) {
+          Dtype update_value = learning_rate * trust * direction[j];
+          if (lars) {
+            update_value += momentum * solver_->history()[b]->cpu_data()[j];
+          }
+          direction[j] = update_value;
+          updated_blobs[b]->mutable_cpu_data()[j] =
+              param_data[j] - update_value;
+        }
+      }
+    }
   }
 
   void CheckLeastSquaresUpdate(
@@ -449,6 +536,58 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  // Check that the fused update gives the same parameters and history as the
+  // separate Normalize, Regularize, ComputeUpdateValue and Update steps, with
+  // either regularization.
+  void CheckFusedUpdate(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kIterSize) {
+    const double kPrecision = 1e-4;
+    const double kMinPrecision = 1e-7;
+    const char* regularization_types[] = { "L2", "L1" };
+    for (int r = 0; r < 2; ++r) {
+      regularization_type_ = regularization_types[r];
+      // Solve with the separate steps and save the state for comparison.
+      fused_update_ = false;
+      this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+          kNumIters, kIterSize);
+      vector<shared_ptr<Blob<Dtype> > > unfused_state;
+      const vector<Blob<Dtype>*>& orig_params =
+          solver_->net()->learnable_params();
+      const vector<shared_ptr<Blob<Dtype> > >& orig_history =
+          solver_->history();
+      for (int i = 0; i < orig_params.size(); ++i) {
+        unfused_state.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        unfused_state.back()->CopyFrom(*orig_params[i], false, true);
+      }
+      for (int i = 0; i < orig_history.size(); ++i) {
+        unfused_state.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        unfused_state.back()->CopyFrom(*orig_history[i], false, true);
+      }
+      // Solve again with the fused update.
+      fused_update_ = true;
+      this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+          kNumIters, kIterSize);
+      vector<Blob<Dtype>*> fused_state = solver_->net()->learnable_params();
+      for (int i = 0; i < solver_->history().size(); ++i) {
+        fused_state.push_back(solver_->history()[i].get());
+      }
+      ASSERT_EQ(unfused_state.size(), fused_state.size());
+      for (int i = 0; i < fused_state.size(); ++i) {
+        for (int j = 0; j < fused_state[i]->count(); ++j) {
+          const Dtype expected = unfused_state[i]->cpu_data()[j];
+          const Dtype actual = fused_state[i]->cpu_data()[j];
+          const Dtype error_margin = std::max(kMinPrecision, kPrecision *
+              std::min(fabs(expected), fabs(actual)));
+          EXPECT_NEAR(expected, actual, error_margin)
+              << regularization_type_ << " blob " << i << " differed at dim "
+              << j;
+        }
+      }
+    }
+    regularization_type_ = "L2";
+    fused_update_ = false;
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -599,6 +738,126 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateLROneHundredth) {
   this->TestLeastSquaresUpdate(kLearningRate);
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithWarmup) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->warmup_iter_ = 3;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdatePipelined) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->pipelined_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdatePipelinedAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->pipelined_ = true;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestMixedPrecision) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+      kNumIters);
+  vector<shared_ptr<Blob<Dtype> > > full_params;
+  const vector<Blob<Dtype>*>& orig_params =
+      this->solver_->net()->learnable_params();
+  for (int i = 0; i < orig_params.size(); ++i) {
+    full_params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    full_params.back()->CopyFrom(*orig_params[i], false, true);
+  }
+  // The params rounded for the passes are within the FP16 precision of the
+  // full precision ones, and so are the updates.
+  this->mixed_precision_ = true;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+      kNumIters);
+  const vector<Blob<Dtype>*>& params =
+      this->solver_->net()->learnable_params();
+  ASSERT_EQ(full_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      const Dtype expected = full_params[i]->cpu_data()[j];
+      EXPECT_NEAR(expected, params[i]->cpu_data()[j],
+          std::max(Dtype(1e-3), Dtype(1e-2) * fabs(expected)));
+    }
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestMixedPrecisionSkipsOverflow) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const Dtype kLearningRate = 0.01;
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 0);
+  vector<shared_ptr<Blob<Dtype> > > initial_params;
+  const vector<Blob<Dtype>*>& orig_params =
+      this->solver_->net()->learnable_params();
+  for (int i = 0; i < orig_params.size(); ++i) {
+    initial_params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    initial_params.back()->CopyFrom(*orig_params[i], false, true);
+  }
+  // The scaled gradients overflow FP16, so the update is skipped and the
+  // loss scale halved.
+  this->mixed_precision_ = true;
+  this->loss_scale_ = 1e9;
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 1);
+  EXPECT_EQ(5e8, this->solver_->loss_scale());
+  const vector<Blob<Dtype>*>& params =
+      this->solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(initial_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestMixedPrecisionLossScaleGrows) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const Dtype kLearningRate = 0.01;
+  this->mixed_precision_ = true;
+  this->loss_scale_window_ = 2;
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 4);
+  EXPECT_EQ(4, this->solver_->loss_scale());
+}
+
+TYPED_TEST(SGDSolverTest, TestMixedPrecisionSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->mixed_precision_ = true;
+  this->loss_scale_ = 1 << 16;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithWeightDecay) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -677,6 +936,17 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -780,6 +1050,17 @@ TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdaGradSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -917,6 +1198,17 @@ TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(NesterovSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1050,6 +1342,17 @@ TYPED_TEST(AdaDeltaSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdaDeltaSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.1;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.95;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaDeltaSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.1;
@@ -1155,6 +1458,17 @@ TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdamSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1261,6 +1575,17 @@ TYPED_TEST(RMSPropSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(RMSPropSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(RMSPropSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1296,4 +1621,257 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+template <typename TypeParam>
+class LARSSolverTest : public GradientBasedSolverTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void InitSolver(const SolverParameter& param) {
+    SolverParameter new_param = param;
+    new_param.set_lars_eta(0.1);
+    this->solver_.reset(new LARSSolver<Dtype>(new_param));
+  }
+  virtual SolverParameter_SolverType solver_type() {
+    return SolverParameter_SolverType_LARS;
+  }
+};
+
+TYPED_TEST_CASE(LARSSolverTest, TestDtypesAndDevices);
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithWeightDecay) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithEverything) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithEverythingShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithWarmup) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->warmup_iter_ = 3;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LARSSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LARSSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LARSSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->share_ = true;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LARSSolverTest, TestSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LARSSolverTest, TestSnapshotShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1.0;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+template <typename TypeParam>
+class LAMBSolverTest : public GradientBasedSolverTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void InitSolver(const SolverParameter& param) {
+    SolverParameter new_param = param;
+    const Dtype momentum = 0.9;
+    new_param.set_momentum(momentum);
+    const Dtype momentum2 = 0.999;
+    new_param.set_momentum2(momentum2);
+    this->solver_.reset(new LAMBSolver<Dtype>(new_param));
+  }
+  virtual SolverParameter_SolverType solver_type() {
+    return SolverParameter_SolverType_LAMB;
+  }
+};
+
+TYPED_TEST_CASE(LAMBSolverTest, TestDtypesAndDevices);
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithWeightDecay) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithEverything) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithEverythingShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithWarmup) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->warmup_iter_ = 3;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LAMBSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LAMBSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LAMBSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->share_ = true;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LAMBSolverTest, TestSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LAMBSolverTest, TestSnapshotShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/gradient_compression.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class GradientCompressionTest : public ::testing::Test {
+ protected:
+  GradientCompressionTest()
+      : blob_(new Blob<Dtype>(1, 1, 30, 20)) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_);
+  }
+  virtual ~GradientCompressionTest() { delete blob_; }
+
+  // Compresses a few different gradients, and checks that what was decoded
+  // plus what is left in the residual adds up to them.
+  void TestErrorFeedback(SolverParameter::GradientCompression type) {
+    const int count = blob_->count();
+    GradientCompressor<Dtype> compressor(type, count, 0.05);
+    vector<Dtype> sent(count, 0);
+    vector<Dtype> expected(count, 0);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    vector<char> message;
+    for (int iter = 0; iter < 5; ++iter) {
+      filler.Fill(blob_);
+      for (int i = 0; i < count; ++i) {
+        expected[i] += blob_->cpu_data()[i];
+      }
+      compressor.Compress(blob_->cpu_data(), &message);
+      compressor.DecompressAdd(message, &sent[0]);
+    }
+    ASSERT_EQ(count, compressor.residual().size());
+    for (int i = 0; i < count; ++i) {
+      EXPECT_NEAR(expected[i], sent[i] + compressor.residual()[i], 1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_;
+};
+
+TYPED_TEST_CASE(GradientCompressionTest, TestDtypes);
+
+TYPED_TEST(GradientCompressionTest, TestFP16) {
+  const int count = this->blob_->count();
+  GradientCompressor<TypeParam> compressor(SolverParameter::FP16, count, 0);
+  vector<char> message;
+  compressor.Compress(this->blob_->cpu_data(), &message);
+  EXPECT_EQ(count * 2, message.size());
+  vector<TypeParam> decoded(count, 1);
+  compressor.DecompressAdd(message, &decoded[0]);
+  for (int i = 0; i < count; ++i) {
+    const TypeParam value = this->blob_->cpu_data()[i];
+    EXPECT_NEAR(value + 1, decoded[i], 1e-3 * std::fabs(value) + 1e-6);
+  }
+}
+
+TYPED_TEST(GradientCompressionTest, TestBF16) {
+  const int count = this->blob_->count();
+  GradientCompressor<TypeParam> compressor(SolverParameter::BF16, count, 0);
+  vector<char> message;
+  compressor.Compress(this->blob_->cpu_data(), &message);
+  EXPECT_EQ(count * 2, message.size());
+  vector<TypeParam> decoded(count, 0);
+  compressor.DecompressAdd(message, &decoded[0]);
+  for (int i = 0; i < count; ++i) {
+    const TypeParam value = this->blob_->cpu_data()[i];
+    EXPECT_NEAR(value, decoded[i], 4e-3 * std::fabs(value));
+  }
+}
+
+TYPED_TEST(GradientCompressionTest, TestTopK) {
+  const int count = this->blob_->count();
+  GradientCompressor<TypeParam> compressor(SolverParameter::TOP_K, count,
+      0.1);
+  vector<char> message;
+  compressor.Compress(this->blob_->cpu_data(), &message);
+  const int top_k = count / 10;
+  EXPECT_EQ(top_k * (4 + sizeof(TypeParam)), message.size());
+  vector<TypeParam> decoded(count, 0);
+  compressor.DecompressAdd(message, &decoded[0]);
+  // The values sent are the largest ones, the others are kept.
+  TypeParam min_sent = INFINITY;
+  TypeParam max_kept = 0;
+  int num_sent = 0;
+  for (int i = 0; i < count; ++i) {
+    const TypeParam value = this->blob_->cpu_data()[i];
+    if (decoded[i] != 0) {
+      ++num_sent;
+      EXPECT_EQ(value, decoded[i]);
+      EXPECT_EQ(0, compressor.residual()[i]);
+      min_sent = std::min(min_sent, std::fabs(value));
+    } else {
+      EXPECT_EQ(value, compressor.residual()[i]);
+      max_kept = std::max(max_kept, std::fabs(value));
+    }
+  }
+  EXPECT_EQ(top_k, num_sent);
+  EXPECT_GE(min_sent, max_kept);
+}
+
+TYPED_TEST(GradientCompressionTest, TestOneBit) {
+  const int count = this->blob_->count();
+  GradientCompressor<TypeParam> compressor(SolverParameter::ONE_BIT, count,
+      0);
+  vector<char> message;
+  compressor.Compress(this->blob_->cpu_data(), &message);
+  // Two means per block of 256 values, and a bit per value.
+  EXPECT_EQ(3 * 2 * sizeof(TypeParam) + count / 8, message.size());
+  vector<TypeParam> decoded(count, 0);
+  compressor.DecompressAdd(message, &decoded[0]);
+  for (int i = 0; i < count; ++i) {
+    const TypeParam value = this->blob_->cpu_data()[i];
+    EXPECT_EQ(value >= 0, decoded[i] >= 0);
+  }
+}
+
+TYPED_TEST(GradientCompressionTest, TestTopKErrorFeedback) {
+  this->TestErrorFeedback(SolverParameter::TOP_K);
+}
+
+TYPED_TEST(GradientCompressionTest, TestOneBitErrorFeedback) {
+  this->TestErrorFeedback(SolverParameter::ONE_BIT);
+}
+
+}  // namespace caffe
@@ -0,0 +1,112 @@
+#include <boost/thread.hpp>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    SetHostPooling(true);
+    ReleaseHostCache();
+  }
+};
+
+static bool IsAligned(const void* ptr, size_t alignment) {
+  return reinterpret_cast<size_t>(ptr) % alignment == 0;
+}
+
+static void FreeOnThread(void* ptr) {
+  HostFree(ptr);
+}
+
+TEST_F(HostAllocatorTest, TestAlignment) {
+  for (size_t size = 1; size < 100000; size = size * 3 + 1) {
+    void* ptr = HostAllocate(size);
+    EXPECT_TRUE(IsAligned(ptr, kHostAlignment));
+    memset(ptr, 1, size);
+    HostFree(ptr);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestReuse) {
+  void* ptr = HostAllocate(1000);
+  HostFree(ptr);
+  // Sizes of the same class get the cached block back.
+  void* same_class = HostAllocate(1010);
+  EXPECT_EQ(ptr, same_class);
+  void* other_class = HostAllocate(2000);
+  EXPECT_NE(ptr, other_class);
+  HostFree(same_class);
+  HostFree(other_class);
+}
+
+TEST_F(HostAllocatorTest, TestReuseAcrossThreads) {
+  // A block freed on a thread which exits goes to the shared pool.
+  void* ptr = HostAllocate(5000);
+  boost::thread thread(&FreeOnThread, ptr);
+  thread.join();
+  void* reused = HostAllocate(5000);
+  EXPECT_EQ(ptr, reused);
+  HostFree(reused);
+}
+
+TEST_F(HostAllocatorTest, TestStats) {
+  ReleaseHostCache();
+  const HostAllocatorStats before = GetHostAllocatorStats();
+  void* ptr = HostAllocate(1000);
+  HostAllocatorStats stats = GetHostAllocatorStats();
+  EXPECT_EQ(before.bytes_in_use + 1000, stats.bytes_in_use);
+  EXPECT_GE(stats.peak_bytes_in_use, stats.bytes_in_use);
+  EXPECT_GE(stats.bytes_reserved, before.bytes_reserved + 1000);
+  EXPECT_GT(stats.fragmentation(), 0);
+  HostFree(ptr);
+  stats = GetHostAllocatorStats();
+  EXPECT_EQ(before.bytes_in_use, stats.bytes_in_use);
+  EXPECT_GE(stats.bytes_cached, before.bytes_cached + 1000);
+  ReleaseHostCache();
+  stats = GetHostAllocatorStats();
+  EXPECT_EQ(before.bytes_reserved, stats.bytes_reserved);
+}
+
+TEST_F(HostAllocatorTest, TestNoPooling) {
+  SetHostPooling(false);
+  ReleaseHostCache();
+  const HostAllocatorStats before = GetHostAllocatorStats();
+  void* ptr = HostAllocate(1000);
+  EXPECT_TRUE(IsAligned(ptr, kHostAlignment));
+  EXPECT_EQ(before.bytes_reserved + 1000,
+      GetHostAllocatorStats().bytes_reserved);
+  HostFree(ptr);
+  EXPECT_EQ(before.bytes_reserved, GetHostAllocatorStats().bytes_reserved);
+  EXPECT_EQ(0, GetHostAllocatorStats().bytes_cached);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  SyncedMemory mem(3 * kHugePageSize);
+  void* ptr = mem.mutable_cpu_data();
+  EXPECT_TRUE(IsAligned(ptr, kHostAlignment));
+  // Large blocks are aligned to huge pages, but for their header.
+  EXPECT_TRUE(IsAligned(static_cast<char*>(ptr) - kHostAlignment,
+      kHugePageSize));
+  // Reused blocks are cleared like new ones.
+  void* other_ptr;
+  {
+    SyncedMemory other(mem.size());
+    other_ptr = other.mutable_cpu_data();
+    EXPECT_NE(ptr, other_ptr);
+    memset(other_ptr, 1, other.size());
+  }
+  SyncedMemory reused(mem.size());
+  EXPECT_EQ(other_ptr, reused.cpu_data());
+  EXPECT_EQ(0, static_cast<const char*>(reused.cpu_data())[0]);
+}
+
+}  // namespace caffe
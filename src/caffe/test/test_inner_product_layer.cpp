@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -123,6 +124,131 @@ TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  // Enough outputs for the weights to be expanded in several panels.
+  inner_product_param->set_num_output(300);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weights = layer->blobs()[0].get();
+  weights->CompactToHalf(FP16);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(weights->is_half());
+  Blob<Dtype> half_top;
+  half_top.CopyFrom(*this->blob_top_, false, true);
+  // Expand the rounded weights and compare with the full precision path.
+  weights->mutable_cpu_data();
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* data = half_top.cpu_data();
+  const Dtype* ref_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], ref_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Prune most of the weights.
+  Blob<Dtype>* weights = layer->blobs()[0].get();
+  Dtype* weight_data = weights->mutable_cpu_data();
+  for (int i = 0; i < weights->count(); ++i) {
+    if (i % 5 != 0) {
+      weight_data[i] = 0;
+    }
+  }
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.CopyFrom(*this->blob_top_, false, true);
+  weights->CompactToSparse();
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_TRUE(weights->is_sparse());
+  }
+  const Dtype* data = this->blob_top_->cpu_data();
+  const Dtype* ref_data = ref_top.cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], ref_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.CopyFrom(*this->blob_top_, false, true);
+  // Run the same layer in INT8, calibrated on this input.
+  const Blob<Dtype>& weights = *layer->blobs()[0];
+  const Dtype input_range = caffe_cpu_amax(this->blob_bottom_->count(),
+      this->blob_bottom_->cpu_data());
+  const Dtype weight_range = caffe_cpu_amax(weights.count(),
+      weights.cpu_data());
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_precision(QuantizationParameter_Precision_INT8);
+  quantization_param->set_input_range(input_range);
+  shared_ptr<InnerProductLayer<Dtype> > int8_layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  int8_layer->blobs() = layer->blobs();
+  int8_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Each of the K products is off by at most half a quantization step of
+  // either factor times the magnitude of the other.
+  const int K = this->blob_bottom_->count(1);
+  const Dtype bound = K * input_range * weight_range / kInt8Max;
+  const Dtype* data = this->blob_top_->cpu_data();
+  const Dtype* ref_data = ref_top.cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], ref_data[i], bound);
+  }
+  // The weights are quantized again when they change.
+  layer->blobs()[0]->scale_data(-1);
+  layer->blobs()[1]->scale_data(-1);
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], -ref_data[i], bound);
+  }
+  // Also when written through another Blob sharing their memory, as the
+  // weights of a test net are by training.
+  Blob<Dtype> shared_weights(weights.shape());
+  shared_weights.ShareData(weights);
+  shared_weights.scale_data(-1);
+  layer->blobs()[1]->scale_data(-1);
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], ref_data[i], bound);
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_);
@@ -3,6 +3,7 @@
 #include <climits>
 #include <cmath>  // for std::fabs
 #include <cstdlib>  // for rand_r
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -10,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -150,6 +152,45 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestQuantizeSaturates) {
+  const TypeParam x[] = {1e12, -1e12, 126.5, -126.5, 0.49, -0.5};
+  const int8_t expected[] = {127, -127, 127, -127, 0, -1};
+  int8_t y[6];
+  caffe_cpu_quantize<TypeParam>(6, x, 1, y);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected[i], y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmS8) {
+  // Sizes crossing the panel boundaries, with extremal values so that the
+  // 32-bit accumulation is exercised.
+  const int M = 3, N = 1031, K = 517;
+  vector<int8_t> A(M * K), B(K * N), Bt(N * K);
+  for (int i = 0; i < M * K; ++i) {
+    A[i] = (i % 3 == 0) ? -127 : static_cast<int8_t>(i % 255 - 127);
+  }
+  for (int k = 0; k < K; ++k) {
+    for (int j = 0; j < N; ++j) {
+      B[k * N + j] = static_cast<int8_t>((k * 31 + j * 7) % 255 - 127);
+      Bt[j * K + k] = B[k * N + j];
+    }
+  }
+  vector<int32_t> C(M * N), Ct(M * N);
+  caffe_cpu_gemm_s8(CblasNoTrans, M, N, K, &A[0], &B[0], &C[0]);
+  caffe_cpu_gemm_s8(CblasTrans, M, N, K, &A[0], &Bt[0], &Ct[0]);
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < N; ++j) {
+      int32_t expected = 0;
+      for (int k = 0; k < K; ++k) {
+        expected += A[i * K + k] * B[k * N + j];
+      }
+      EXPECT_EQ(expected, C[i * N + j]);
+      EXPECT_EQ(expected, Ct[i * N + j]);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
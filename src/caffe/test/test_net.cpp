@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,6 +11,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/util/fold_layers.hpp"
+#include "caffe/util/insert_reorders.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -16,6 +21,17 @@
 
 namespace caffe {
 
+// Runs the forward pass of net on input, copying the output.
+template <typename Dtype>
+static void ForwardContext(Net<Dtype>* net, const Blob<Dtype>* input,
+    vector<Dtype>* output) {
+  for (int iter = 0; iter < 10; ++iter) {
+    net->input_blobs()[0]->CopyFrom(*input);
+    const Blob<Dtype>& top = *net->ForwardPrefilled()[0];
+    output->assign(top.cpu_data(), top.cpu_data() + top.count());
+  }
+}
+
 template <typename TypeParam>
 class NetTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -614,6 +630,198 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  // A TRAIN net, with net_option added to the net and layer_option to the
+  // layers before the dropout.
+  virtual void InitRecomputeNet(const string& net_option,
+      const string& layer_option) {
+    const string proto =
+        "name: 'RecomputeNetwork' "
+        "state { phase: TRAIN } " + net_option +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 6 } "
+        "    data_filler { type: 'gaussian' } "
+        "    shape { dim: 4 } "
+        "    data_filler { type: 'constant' value: 1 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'label' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' " + layer_option +
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct1' " + layer_option +
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct2' " + layer_option +
+        "} "
+        "layer { "
+        "  name: 'dropout' "
+        "  type: 'Dropout' "
+        "  bottom: 'innerproduct2' "
+        "  top: 'dropout' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'dropout' "
+        "  top: 'innerproduct3' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'innerproduct3' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // Checks that the recompute net set up with the options given computes the
+  // same as without them, holding the released blobs only when needed.
+  virtual void TestRecompute(const string& net_option,
+      const string& layer_option, const vector<string>& released) {
+    Caffe::set_random_seed(seed_);
+    InitRecomputeNet("", "");
+    shared_ptr<Net<Dtype> > net = net_;
+    Caffe::set_random_seed(seed_);
+    InitRecomputeNet(net_option, layer_option);
+    vector<Blob<Dtype>*> bottom;
+    for (int pass = 0; pass < 2; ++pass) {
+      Caffe::set_random_seed(seed_ + pass);
+      Dtype loss;
+      net->Forward(bottom, &loss);
+      net->Backward();
+      Caffe::set_random_seed(seed_ + pass);
+      Dtype recompute_loss;
+      net_->Forward(bottom, &recompute_loss);
+      EXPECT_EQ(loss, recompute_loss);
+      for (int i = 0; i < net_->blobs().size(); ++i) {
+        const bool is_released = std::find(released.begin(), released.end(),
+            net_->blob_names()[i]) != released.end();
+        EXPECT_EQ(is_released, net_->blobs()[i]->data()->head() ==
+            SyncedMemory::UNINITIALIZED) << net_->blob_names()[i];
+      }
+      net_->Backward();
+      for (int i = 0; i < released.size(); ++i) {
+        EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+            net_->blob_by_name(released[i])->data()->head());
+      }
+      // The dropout mask is not drawn again, the gradients are the same.
+      const vector<Blob<Dtype>*>& params = net->learnable_params();
+      const vector<Blob<Dtype>*>& recompute_params =
+          net_->learnable_params();
+      ASSERT_EQ(params.size(), recompute_params.size());
+      for (int i = 0; i < params.size(); ++i) {
+        for (int j = 0; j < params[i]->count(); ++j) {
+          EXPECT_EQ(params[i]->cpu_diff()[j],
+              recompute_params[i]->cpu_diff()[j]);
+        }
+      }
+    }
+  }
+
+  // Slices a batch of one, and concatenates what the branches compute from
+  // the slices, along the channels.
+  virtual void InitConcatSliceNet(const string& net_option,
+      const string& concat_top_layer) {
+    const string proto =
+        "name: 'ConcatSliceNetwork' " + net_option +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 1 dim: 6 } "
+        "    shape { dim: 1 dim: 3 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'targets' "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  slice_param { slice_point: 2 } "
+        "  bottom: 'data' "
+        "  top: 'slice0' "
+        "  top: 'slice1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct0' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'slice0' "
+        "  top: 'innerproduct0' "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'innerproduct0' "
+        "  top: 'innerproduct0' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'slice1' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'innerproduct0' "
+        "  bottom: 'innerproduct1' "
+        "  top: 'concat' "
+        "} " + concat_top_layer +
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'concat' "
+        "  top: 'innerproduct2' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'innerproduct2' "
+        "  bottom: 'targets' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -863,6 +1071,33 @@ TYPED_TEST(NetTest, TestLossWeight) {
   }
 }
 
+TYPED_TEST(NetTest, TestLossScale) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The loss scale multiplies the gradients, on top of the loss weight, but
+  // not the loss.
+  vector<Blob<Dtype>*> bottom;
+  Caffe::set_random_seed(this->seed_);
+  const bool kForceBackward = true;
+  Dtype loss_weight = 2;
+  this->InitUnsharedWeightsNet(&loss_weight, NULL, kForceBackward);
+  const Dtype loss = this->net_->ForwardBackward(bottom);
+  vector<shared_ptr<Blob<Dtype> > > param_grads;
+  this->CopyNetParams(true, &param_grads);
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet(&loss_weight, NULL, kForceBackward);
+  const Dtype kLossScale = 8;
+  this->net_->set_loss_scale(kLossScale);
+  EXPECT_NEAR(loss, this->net_->ForwardBackward(bottom), 1e-4 * fabs(loss));
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(param_grads.size(), params.size());
+  for (int j = 0; j < param_grads.size(); ++j) {
+    for (int k = 0; k < param_grads[j]->count(); ++k) {
+      EXPECT_NEAR(param_grads[j]->cpu_diff()[k] * kLossScale,
+          params[j]->cpu_diff()[k], 1e-4 * kLossScale);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestLossWeightMidNet) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
@@ -1180,6 +1415,519 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestContiguousParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  NetParameter param;
+  this->net_->ToProto(&param);
+  param.set_contiguous_params(true);
+  Net<Dtype> arena_net(param);
+  const shared_ptr<Blob<Dtype> >& arena = arena_net.param_arena();
+  if (Caffe::mode() != Caffe::CPU) {
+    EXPECT_FALSE(arena.get());
+    return;
+  }
+  ASSERT_TRUE(arena.get());
+  // The params are views of the arena, in order.
+  const vector<Blob<Dtype>*>& params = arena_net.learnable_params();
+  const vector<Blob<Dtype>*>& ref_params = this->net_->learnable_params();
+  ASSERT_EQ(2, params.size());
+  int offset = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(arena->cpu_data() + offset, params[i]->cpu_data());
+    EXPECT_EQ(arena->cpu_diff() + offset, params[i]->cpu_diff());
+    offset += params[i]->count();
+  }
+  EXPECT_EQ(offset, arena->count());
+  // Updating through the arena matches updating each param.
+  vector<Blob<Dtype>*> bottom;
+  Caffe::set_random_seed(this->seed_);
+  this->net_->ForwardBackward(bottom);
+  this->net_->Update();
+  Caffe::set_random_seed(this->seed_);
+  arena_net.ForwardBackward(bottom);
+  arena_net.Update();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(ref_params[i]->cpu_diff()[j], params[i]->cpu_diff()[j]);
+      EXPECT_EQ(ref_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  arena_net.ClearParamDiffs();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+template <typename Dtype>
+class RecordingCallback : public Net<Dtype>::Callback {
+ public:
+  vector<int> layers;
+
+ protected:
+  void run(int layer) { layers.push_back(layer); }
+};
+
+TYPED_TEST(NetTest, TestBackwardCallback) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitDiffDataUnsharedWeightsNet();
+  RecordingCallback<Dtype> callback;
+  this->net_->add_after_backward(&callback);
+  vector<Blob<Dtype>*> bottom;
+  this->net_->ForwardBackward(bottom);
+  // Called for every layer, including the data layer, from the last one.
+  const int num_layers = this->net_->layers().size();
+  ASSERT_EQ(num_layers, callback.layers.size());
+  for (int i = 0; i < num_layers; ++i) {
+    EXPECT_EQ(num_layers - 1 - i, callback.layers[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestGradientBuckets) {
+  this->InitDiffDataUnsharedWeightsNet();
+  // Layers: data, innerproduct1 and innerproduct2 with 100 weights each, loss.
+  vector<int> layer_buckets;
+  vector<pair<size_t, size_t> > buckets;
+  ComputeGradientBuckets(*this->net_, 1, &layer_buckets, &buckets);
+  ASSERT_EQ(2, buckets.size());
+  EXPECT_EQ(make_pair(size_t(100), size_t(200)), buckets[0]);
+  EXPECT_EQ(make_pair(size_t(0), size_t(100)), buckets[1]);
+  ASSERT_EQ(4, layer_buckets.size());
+  EXPECT_EQ(-1, layer_buckets[0]);
+  EXPECT_EQ(1, layer_buckets[1]);
+  EXPECT_EQ(0, layer_buckets[2]);
+  EXPECT_EQ(-1, layer_buckets[3]);
+  // A bucket too large to fill is flushed at the first layer.
+  ComputeGradientBuckets(*this->net_, 1000, &layer_buckets, &buckets);
+  ASSERT_EQ(1, buckets.size());
+  EXPECT_EQ(make_pair(size_t(0), size_t(200)), buckets[0]);
+  EXPECT_EQ(0, layer_buckets[0]);
+  EXPECT_EQ(-1, layer_buckets[1]);
+  EXPECT_EQ(-1, layer_buckets[2]);
+}
+
+TYPED_TEST(NetTest, TestHalfActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'HalfActivationsNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 4 dim: 6 } "
+      "    data_filler { type: 'gaussian' } "
+      "    shape { dim: 4 } "
+      "    data_filler { type: 'constant' value: 1 } "
+      "  } "
+      "  top: 'data' "
+      "  top: 'label' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 10 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct2' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'innerproduct2' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> half_net(param);
+  half_net.set_half_activations(true, BF16);
+  vector<Blob<Dtype>*> bottom;
+  // Twice, the second pass overwriting compacted blobs.
+  for (int pass = 0; pass < 2; ++pass) {
+    Caffe::set_random_seed(this->seed_ + pass);
+    Dtype loss;
+    this->net_->Forward(bottom, &loss);
+    this->net_->Backward();
+    Caffe::set_random_seed(this->seed_ + pass);
+    Dtype half_loss;
+    half_net.Forward(bottom, &half_loss);
+    // Only the 16-bit copies of the activations are held after the forward
+    // pass, but for the net output, and in CPU mode only.
+    const bool cpu = Caffe::mode() == Caffe::CPU;
+    EXPECT_EQ(cpu, half_net.blob_by_name("data")->is_half());
+    EXPECT_EQ(cpu, half_net.blob_by_name("innerproduct1")->is_half());
+    EXPECT_EQ(cpu, half_net.blob_by_name("innerproduct2")->is_half());
+    EXPECT_FALSE(half_net.blob_by_name("loss")->is_half());
+    half_net.Backward();
+    EXPECT_EQ(cpu, half_net.blob_by_name("innerproduct1")->is_half());
+    EXPECT_NEAR(loss, half_loss, 1e-2 * fabs(loss));
+    // The gradients are computed from the rounded activations.
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    const vector<Blob<Dtype>*>& half_params = half_net.learnable_params();
+    ASSERT_EQ(params.size(), half_params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      const Dtype scale = std::max(Dtype(1e-3), params[i]->asum_diff() /
+          params[i]->count());
+      for (int j = 0; j < params[i]->count(); ++j) {
+        const Dtype expected = params[i]->cpu_diff()[j];
+        EXPECT_NEAR(expected, half_params[i]->cpu_diff()[j],
+            5e-2 * scale + 1e-2 * fabs(expected));
+      }
+    }
+    // The activations can still be read, once expanded.
+    const Blob<Dtype>& top = *this->net_->blob_by_name("innerproduct2");
+    half_net.blob_by_name("innerproduct2")->Expand();
+    const Blob<Dtype>& half_top = *half_net.blob_by_name("innerproduct2");
+    for (int j = 0; j < top.count(); ++j) {
+      EXPECT_NEAR(top.cpu_data()[j], half_top.cpu_data()[j],
+          1e-2 * std::max(Dtype(1), fabs(top.cpu_data()[j])));
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestLoadCompactParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet();
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->CompactToHalf(FP16);
+  }
+  NetParameter param;
+  this->net_->ToProto(&param);
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->Expand();
+  }
+  // A TEST net keeps the weights of the inner product compacted, as it reads
+  // them in 16-bit form, but not its bias.
+  param.mutable_state()->set_phase(TEST);
+  Net<Dtype> half_net(param);
+  EXPECT_EQ(Caffe::mode() == Caffe::CPU, half_net.params()[0]->is_half());
+  EXPECT_FALSE(half_net.params()[1]->is_half());
+  Caffe::set_random_seed(this->seed_);
+  this->net_->ForwardPrefilled();
+  Caffe::set_random_seed(this->seed_);
+  half_net.ForwardPrefilled();
+  const Blob<Dtype>& top = *this->net_->blob_by_name("innerproduct");
+  const Blob<Dtype>& half_top = *half_net.blob_by_name("innerproduct");
+  for (int j = 0; j < top.count(); ++j) {
+    EXPECT_NEAR(top.cpu_data()[j], half_top.cpu_data()[j], 1e-4);
+  }
+  // Sharing the weights keeps them compacted too.
+  Net<Dtype> shared_net(param);
+  shared_net.ShareTrainedLayersWith(&half_net);
+  EXPECT_EQ(half_net.params()[0]->is_half(),
+      shared_net.params()[0]->is_half());
+}
+
+TYPED_TEST(NetTest, TestRecompute) {
+  // The first three layers form one segment, in which innerproduct1 is both
+  // produced and consumed.
+  vector<string> released(1, "innerproduct1");
+  this->TestRecompute("", "recompute: true ", released);
+}
+
+TYPED_TEST(NetTest, TestRecomputeSegments) {
+  // The dropout splits the net in two segments, around innerproduct1 and
+  // innerproduct3.
+  vector<string> released;
+  released.push_back("innerproduct1");
+  released.push_back("innerproduct3");
+  this->TestRecompute("checkpoint_segments: 1 ", "", released);
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcatSlice) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatSliceNet("", "");
+  shared_ptr<Net<Dtype> > net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatSliceNet("zero_copy_concat_slice: true ", "");
+  const Blob<Dtype>& data = *this->net_->blob_by_name("data");
+  const Blob<Dtype>& concat = *this->net_->blob_by_name("concat");
+  EXPECT_TRUE(this->net_->blob_by_name("slice1")->IsDataViewOf(data, 2));
+  EXPECT_TRUE(this->net_->blob_by_name("innerproduct1")->IsDataViewOf(
+      concat, 4));
+  EXPECT_TRUE(this->net_->blob_by_name("innerproduct1")->IsDiffViewOf(
+      concat, 4));
+  vector<Blob<Dtype>*> bottom;
+  for (int pass = 0; pass < 2; ++pass) {
+    Caffe::set_random_seed(this->seed_ + pass);
+    Dtype loss;
+    net->Forward(bottom, &loss);
+    net->Backward();
+    Caffe::set_random_seed(this->seed_ + pass);
+    Dtype zero_copy_loss;
+    this->net_->Forward(bottom, &zero_copy_loss);
+    this->net_->Backward();
+    EXPECT_EQ(loss, zero_copy_loss);
+    const vector<Blob<Dtype>*>& params = net->learnable_params();
+    const vector<Blob<Dtype>*>& zero_copy_params =
+        this->net_->learnable_params();
+    ASSERT_EQ(params.size(), zero_copy_params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(params[i]->cpu_diff()[j], zero_copy_params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcatInPlace) {
+  // Writing the concatenation in place would change the output of the
+  // sigmoid, which its backward pass needs: the concat has to copy.
+  this->InitConcatSliceNet("zero_copy_concat_slice: true ",
+      "layer { name: 'relu' type: 'ReLU' bottom: 'concat' top: 'concat' } ");
+  EXPECT_FALSE(this->net_->layer_by_name("concat")->layer_param()
+      .concat_param().view_bottoms());
+  EXPECT_TRUE(this->net_->layer_by_name("slice")->layer_param()
+      .slice_param().view_tops());
+  EXPECT_FALSE(this->net_->blob_by_name("innerproduct0")->IsDataViewOf(
+      *this->net_->blob_by_name("concat"), 0));
+}
+
+TYPED_TEST(NetTest, TestPruneNet) {
+  const string proto =
+      "name: 'PruneNetwork' "
+      "output: 'prob' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 5 dim: 2 } "
+      "    shape { dim: 5 } "
+      "    data_filler { type: 'gaussian' } "
+      "    data_filler { type: 'constant' } "
+      "  } "
+      "  top: 'data' "
+      "  top: 'label' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} "
+      "layer { "
+      "  name: 'prob' "
+      "  type: 'Softmax' "
+      "  bottom: 'innerproduct' "
+      "  top: 'prob' "
+      "} "
+      "layer { "
+      "  name: 'accuracy' "
+      "  type: 'Accuracy' "
+      "  bottom: 'innerproduct' "
+      "  bottom: 'label' "
+      "  top: 'accuracy' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'innerproduct' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  ASSERT_EQ(3, this->net_->layers().size());
+  EXPECT_TRUE(this->net_->has_layer("prob"));
+  EXPECT_FALSE(this->net_->has_layer("accuracy"));
+  EXPECT_FALSE(this->net_->has_layer("loss"));
+  // The data layer is kept, with its unused label.
+  ASSERT_EQ(2, this->net_->output_blobs().size());
+  EXPECT_EQ(this->net_->blob_by_name("label").get(),
+      this->net_->output_blobs()[0]);
+  EXPECT_EQ(this->net_->blob_by_name("prob").get(),
+      this->net_->output_blobs()[1]);
+}
+
+TYPED_TEST(NetTest, TestFoldConstants) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'FoldConstantsNetwork' "
+      "fold_constants: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 } "
+      "    data_filler { type: 'gaussian' } "
+      "    data_filler { type: 'constant' value: 2 } "
+      "    data_filler { type: 'constant' value: 3 } "
+      "  } "
+      "  top: 'data' "
+      "  top: 'scale' "
+      "  top: 'bias' "
+      "} "
+      "layer { "
+      "  name: 'square' "
+      "  type: 'Power' "
+      "  power_param { power: 2 } "
+      "  bottom: 'scale' "
+      "  top: 'square' "
+      "} "
+      "layer { "
+      "  name: 'flatten' "
+      "  type: 'Flatten' "
+      "  bottom: 'square' "
+      "  top: 'flat' "
+      "} "
+      "layer { "
+      "  name: 'shift' "
+      "  type: 'Power' "
+      "  power_param { shift: 1 } "
+      "  bottom: 'bias' "
+      "  top: 'shifted' "
+      "} "
+      "layer { "
+      "  name: 'dropout' "
+      "  type: 'Dropout' "
+      "  bottom: 'shifted' "
+      "  top: 'shifted' "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'data' "
+      "  bottom: 'flat' "
+      "  bottom: 'shifted' "
+      "  top: 'sum' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  const vector<bool>& folded = this->net_->layer_folded();
+  ASSERT_EQ(6, folded.size());
+  EXPECT_FALSE(folded[0]);
+  EXPECT_TRUE(folded[1]);
+  EXPECT_TRUE(folded[2]);
+  // The dropout writes the output of shift in place, and is not folded.
+  EXPECT_FALSE(folded[3]);
+  EXPECT_FALSE(folded[4]);
+  EXPECT_FALSE(folded[5]);
+  vector<Blob<Dtype>*> bottom;
+  for (int pass = 0; pass < 2; ++pass) {
+    this->net_->Forward(bottom);
+    const Blob<Dtype>& data = *this->net_->blob_by_name("data");
+    const Blob<Dtype>& sum = *this->net_->blob_by_name("sum");
+    for (int i = 0; i < data.count(); ++i) {
+      EXPECT_NEAR(data.cpu_data()[i] + 8, sum.cpu_data()[i], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFoldAffineLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'FoldNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 dim: 4 dim: 4 } "
+      "    data_filler { type: 'gaussian' } "
+      "  } "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 2 "
+      "    kernel_size: 3 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Power' "
+      "  power_param { scale: 2 shift: 1 } "
+      "  bottom: 'conv' "
+      "  top: 'scaled' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'scaled' "
+      "  top: 'scaled' "
+      "} "
+      "layer { "
+      "  name: 'dropout' "
+      "  type: 'Dropout' "
+      "  bottom: 'scaled' "
+      "  top: 'scaled' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'scaled' "
+      "  top: 'innerproduct' "
+      "} "
+      "layer { "
+      "  name: 'shift' "
+      "  type: 'Power' "
+      "  power_param { scale: -1 shift: 0.5 } "
+      "  bottom: 'innerproduct' "
+      "  top: 'innerproduct' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  NetParameter folded_param;
+  FoldAffineLayers(trained_param, &folded_param);
+  ASSERT_EQ(4, folded_param.layer_size());
+  EXPECT_EQ("conv", folded_param.layer(1).name());
+  EXPECT_EQ("scaled", folded_param.layer(1).top(0));
+  EXPECT_TRUE(folded_param.layer(1).convolution_param().bias_term());
+  EXPECT_EQ("relu", folded_param.layer(2).name());
+  EXPECT_EQ("innerproduct", folded_param.layer(3).name());
+  Net<Dtype> folded_net(folded_param);
+  Caffe::set_random_seed(this->seed_);
+  this->net_->ForwardPrefilled();
+  Caffe::set_random_seed(this->seed_);
+  folded_net.ForwardPrefilled();
+  const Blob<Dtype>& output = *this->net_->blob_by_name("innerproduct");
+  const Blob<Dtype>& folded_output = *folded_net.blob_by_name("innerproduct");
+  ASSERT_EQ(output.count(), folded_output.count());
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_NEAR(output.cpu_data()[i], folded_output.cpu_data()[i], 1e-4);
+  }
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsResume) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -2317,6 +3065,449 @@ TYPED_TEST(NetTest, TestReshape) {
   }
 }
 
+TYPED_TEST(NetTest, TestIncrementalReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  const string& proto =
+      "input: 'data1' "
+      "input_shape { dim: 2 dim: 3 } "
+      "input: 'data2' "
+      "input_shape { dim: 2 dim: 4 } "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data1' "
+      "  top: 'ip1' "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data2' "
+      "  top: 'ip2' "
+      "} "
+      "layer { "
+      "  name: 'relu2' "
+      "  type: 'ReLU' "
+      "  bottom: 'ip2' "
+      "  top: 'relu2' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  const vector<shared_ptr<Layer<Dtype> > >& layers = this->net_->layers();
+  const vector<vector<Blob<Dtype>*> >& bottom_vecs =
+      this->net_->bottom_vecs();
+  const vector<vector<Blob<Dtype>*> >& top_vecs = this->net_->top_vecs();
+  // Nothing changed since the net was set up.
+  for (int i = 0; i < layers.size(); ++i) {
+    EXPECT_FALSE(layers[i]->ReshapeIfChanged(bottom_vecs[i], top_vecs[i]));
+  }
+  // Only the layers downstream of the reshaped input are reshaped.
+  vector<int> shape(2, 4);
+  shape[0] = 3;
+  this->net_->input_blobs()[1]->Reshape(shape);
+  EXPECT_FALSE(layers[0]->ReshapeIfChanged(bottom_vecs[0], top_vecs[0]));
+  EXPECT_TRUE(layers[1]->ReshapeIfChanged(bottom_vecs[1], top_vecs[1]));
+  EXPECT_TRUE(layers[2]->ReshapeIfChanged(bottom_vecs[2], top_vecs[2]));
+  EXPECT_FALSE(layers[2]->ReshapeIfChanged(bottom_vecs[2], top_vecs[2]));
+  EXPECT_EQ(3, this->net_->blob_by_name("relu2")->num());
+  // Once reserved, the blobs are not reallocated for smaller inputs.
+  vector<vector<int> > max_shapes(2, vector<int>(2, 8));
+  max_shapes[0][1] = 3;
+  max_shapes[1][1] = 4;
+  this->net_->Reserve(max_shapes);
+  EXPECT_EQ(shape, this->net_->input_blobs()[1]->shape());
+  EXPECT_EQ(3, this->net_->blob_by_name("relu2")->num());
+  const Dtype* data = this->net_->blob_by_name("relu2")->cpu_data();
+  for (int num = 1; num <= 8; ++num) {
+    shape[0] = num;
+    this->net_->input_blobs()[1]->Reshape(shape);
+    this->net_->ForwardPrefilled();
+    EXPECT_EQ(num, this->net_->blob_by_name("relu2")->num());
+    EXPECT_EQ(data, this->net_->blob_by_name("relu2")->cpu_data());
+  }
+}
+
+TYPED_TEST(NetTest, TestBranchThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  // Two towers with results concatenated. Running them concurrently gives
+  // the same results.
+  const string& proto =
+      "force_backward: true "
+      "input: 'data' "
+      "input_shape { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "input: 'targets' "
+      "input_shape { dim: 2 dim: 4 } "
+      "layer { "
+      "  name: 'conv_a' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'conv_a' "
+      "} "
+      "layer { "
+      "  name: 'relu_a' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv_a' "
+      "  top: 'conv_a' "
+      "} "
+      "layer { "
+      "  name: 'conv_b' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 2 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'conv_b' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid_b' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'conv_b' "
+      "  top: 'conv_b' "
+      "} "
+      "layer { "
+      "  name: 'concat' "
+      "  type: 'Concat' "
+      "  bottom: 'conv_a' "
+      "  bottom: 'conv_b' "
+      "  top: 'concat' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'concat' "
+      "  top: 'ip' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'ip' "
+      "  bottom: 'targets' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  vector<shared_ptr<Blob<Dtype> > > inputs(2);
+  vector<Dtype> losses;
+  vector<vector<Dtype> > diffs;
+  for (int num_threads = 1; num_threads <= 3; num_threads += 2) {
+    Caffe::set_random_seed(this->seed_);
+    param.set_branch_threads(num_threads);
+    Net<Dtype> net(param);
+    for (int i = 0; i < inputs.size(); ++i) {
+      if (!inputs[i]) {
+        inputs[i].reset(new Blob<Dtype>(net.input_blobs()[i]->shape()));
+        filler.Fill(inputs[i].get());
+      }
+      net.input_blobs()[i]->CopyFrom(*inputs[i]);
+    }
+    Dtype loss;
+    net.ForwardPrefilled(&loss);
+    net.Backward();
+    losses.push_back(loss);
+    diffs.push_back(vector<Dtype>());
+    const vector<Blob<Dtype>*>& params = net.learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      diffs.back().insert(diffs.back().end(), params[i]->cpu_diff(),
+          params[i]->cpu_diff() + params[i]->count());
+    }
+    diffs.back().insert(diffs.back().end(), net.input_blobs()[0]->cpu_diff(),
+        net.input_blobs()[0]->cpu_diff() + net.input_blobs()[0]->count());
+  }
+  EXPECT_GT(losses[0], 0);
+  EXPECT_EQ(losses[0], losses[1]);
+  ASSERT_EQ(diffs[0].size(), diffs[1].size());
+  for (int i = 0; i < diffs[0].size(); ++i) {
+    EXPECT_EQ(diffs[0][i], diffs[1][i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestBranchThreadsRandom) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  // Two towers with dropout, and random data. Running them concurrently
+  // draws the same numbers as running them in order.
+  const string& proto =
+      "force_backward: true "
+      "state { phase: TRAIN } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "    data_filler { type: 'gaussian' } "
+      "  } "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'ip_a' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 8 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'ip_a' "
+      "} "
+      "layer { "
+      "  name: 'drop_a' "
+      "  type: 'Dropout' "
+      "  bottom: 'ip_a' "
+      "  top: 'ip_a' "
+      "} "
+      "layer { "
+      "  name: 'ip_b' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 8 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'ip_b' "
+      "} "
+      "layer { "
+      "  name: 'drop_b' "
+      "  type: 'Dropout' "
+      "  bottom: 'ip_b' "
+      "  top: 'ip_b' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'ip_a' "
+      "  bottom: 'ip_b' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  const int num_passes = 3;
+  vector<vector<Dtype> > results;
+  for (int num_threads = 1; num_threads <= 3; num_threads += 2) {
+    Caffe::set_random_seed(this->seed_);
+    param.set_branch_threads(num_threads);
+    Net<Dtype> net(param);
+    // Starting the branch threads drew their seeds.
+    Caffe::set_random_seed(this->seed_);
+    results.push_back(vector<Dtype>());
+    for (int pass = 0; pass < num_passes; ++pass) {
+      Dtype loss;
+      net.ForwardPrefilled(&loss);
+      net.Backward();
+      results.back().push_back(loss);
+      const char* names[] = {"ip_a", "ip_b"};
+      for (int i = 0; i < 2; ++i) {
+        const Blob<Dtype>& blob = *net.blob_by_name(names[i]);
+        results.back().insert(results.back().end(), blob.cpu_data(),
+            blob.cpu_data() + blob.count());
+      }
+      const vector<Blob<Dtype>*>& params = net.learnable_params();
+      for (int i = 0; i < params.size(); ++i) {
+        results.back().insert(results.back().end(), params[i]->cpu_diff(),
+            params[i]->cpu_diff() + params[i]->count());
+      }
+    }
+  }
+  EXPECT_GT(results[0][0], 0);
+  ASSERT_EQ(results[0].size(), results[1].size());
+  for (int i = 0; i < results[0].size(); ++i) {
+    EXPECT_EQ(results[0][i], results[1][i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestContexts) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  const string& proto =
+      "input: 'data' "
+      "input_shape { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'conv' "
+      "  top: 'ip' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  // Each context runs on its own thread, with its own input.
+  const int num_contexts = 3;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  vector<shared_ptr<Blob<Dtype> > > inputs;
+  vector<shared_ptr<Net<Dtype> > > contexts;
+  vector<vector<Dtype> > outputs(num_contexts);
+  for (int i = 0; i < num_contexts; ++i) {
+    inputs.push_back(shared_ptr<Blob<Dtype> >(
+        new Blob<Dtype>(this->net_->input_blobs()[0]->shape())));
+    filler.Fill(inputs[i].get());
+    contexts.push_back(this->net_->NewContext());
+    const vector<Blob<Dtype>*>& params = contexts[i]->learnable_params();
+    ASSERT_EQ(this->net_->learnable_params().size(), params.size());
+    for (int j = 0; j < params.size(); ++j) {
+      EXPECT_EQ(this->net_->learnable_params()[j], params[j]);
+    }
+  }
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < num_contexts; ++i) {
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &ForwardContext<Dtype>, contexts[i].get(), inputs[i].get(),
+        &outputs[i])));
+  }
+  for (int i = 0; i < num_contexts; ++i) {
+    threads[i]->join();
+  }
+  for (int i = 0; i < num_contexts; ++i) {
+    vector<Dtype> expected;
+    ForwardContext(this->net_.get(), inputs[i].get(), &expected);
+    ASSERT_EQ(expected.size(), outputs[i].size());
+    for (int j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(expected[j], outputs[i][j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestChannelBlock) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run a net with and without blocked layouts and check that the outputs,
+  // which are always in NCHW, match.
+  Caffe::set_mode(Caffe::CPU);
+  const string& proto =
+      "name: 'BlockedNetwork' "
+      "input: 'data' "
+      "input_shape { dim: 2 dim: 3 dim: 9 dim: 8 } "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 8 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'Pooling' "
+      "  bottom: 'conv1' "
+      "  top: 'pool1' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'pool1' "
+      "  top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 8 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'conv2' "
+      "  bottom: 'conv2' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'pool2' "
+      "  type: 'Pooling' "
+      "  bottom: 'sum' "
+      "  top: 'pool2' "
+      "  pooling_param { pool: AVE global_pooling: true } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool1' "
+      "  top: 'ip' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  param.set_channel_block(4);
+  Net<Dtype> blocked_net(param);
+  NetParameter weights;
+  net.ToProto(&weights);
+  blocked_net.CopyTrainedLayersFrom(weights);
+  // Blocked intermediate blobs are renamed, so that they are not mistaken
+  // for NCHW ones.
+  EXPECT_FALSE(blocked_net.has_blob("conv1"));
+  EXPECT_EQ(4,
+      blocked_net.blob_by_name(BlockedBlobName("conv1"))->channel_block());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.input_blobs()[0]);
+  blocked_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  net.ForwardPrefilled();
+  blocked_net.ForwardPrefilled();
+  const char* outputs[] = { "pool2", "ip" };
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& output = *net.blob_by_name(outputs[i]);
+    const Blob<Dtype>& blocked_output = *blocked_net.blob_by_name(outputs[i]);
+    EXPECT_EQ(1, blocked_output.channel_block());
+    EXPECT_TRUE(output.shape() == blocked_output.shape());
+    for (int j = 0; j < output.count(); ++j) {
+      EXPECT_NEAR(output.cpu_data()[j], blocked_output.cpu_data()[j], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
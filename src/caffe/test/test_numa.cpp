@@ -0,0 +1,69 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/numa.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NumaTest : public ::testing::Test {};
+
+// The last node with CPUs.
+static int LastNode() {
+  int node = NumaNodeCount() - 1;
+  while (NumaNodeCpus(node).empty()) {
+    --node;
+  }
+  return node;
+}
+
+static void RunOnCurrentNode(int* node) {
+  *node = CurrentNumaNode();
+}
+
+// Binds the thread to the last node, then starts a thread which should run
+// there too.
+static void RunBound(int* node, int* child_node) {
+  BindThreadToNumaNode(LastNode());
+  *node = CurrentNumaNode();
+  boost::thread child(&RunOnCurrentNode, child_node);
+  child.join();
+}
+
+TEST_F(NumaTest, TestParseCpuList) {
+  std::vector<int> cpus = ParseCpuList("0-3,8,10-11\n");
+  ASSERT_EQ(7, cpus.size());
+  EXPECT_EQ(0, cpus[0]);
+  EXPECT_EQ(3, cpus[3]);
+  EXPECT_EQ(8, cpus[4]);
+  EXPECT_EQ(10, cpus[5]);
+  EXPECT_EQ(11, cpus[6]);
+  EXPECT_TRUE(ParseCpuList("").empty());
+}
+
+TEST_F(NumaTest, TestTopology) {
+  ASSERT_GE(NumaNodeCount(), 1);
+  int num_cpus = 0;
+  for (int node = 0; node < NumaNodeCount(); ++node) {
+    num_cpus += NumaNodeCpus(node).size();
+  }
+  EXPECT_GE(num_cpus, 1);
+  const int node = CurrentNumaNode();
+  EXPECT_GE(node, 0);
+  EXPECT_LT(node, NumaNodeCount());
+}
+
+TEST_F(NumaTest, TestBindThread) {
+  int node = -1;
+  int child_node = -1;
+  boost::thread thread(&RunBound, &node, &child_node);
+  thread.join();
+  EXPECT_EQ(LastNode(), node);
+  EXPECT_EQ(LastNode(), child_node);
+}
+
+}  // namespace caffe
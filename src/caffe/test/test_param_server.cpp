@@ -0,0 +1,238 @@
+#include <boost/thread.hpp>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/transport.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Runs one process of the group, on its own thread. Workers copy their final
+// weights to weights.
+template <typename Dtype>
+static void ParamServerRank(const SolverParameter& param, const string& uri,
+    int rank, int size, int num_servers, int staleness,
+    vector<Dtype>* weights) {
+  shared_ptr<Transport> transport(new SocketTransport(uri, rank, size));
+  shared_ptr<Solver<Dtype> > solver(rank < num_servers ?
+      static_cast<Solver<Dtype>*>(new SGDSolver<Dtype>(param)) :
+      new WorkerSolver<Dtype>(param));
+  ParamServerSync<Dtype> sync(solver, transport, num_servers, staleness,
+      param);
+  sync.run();
+  const vector<Blob<Dtype>*>& params = solver->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    weights->insert(weights->end(), params[i]->cpu_data(),
+        params[i]->cpu_data() + params[i]->count());
+  }
+}
+
+template <typename Dtype>
+class ParamServerTest : public ::testing::Test {
+ protected:
+  ParamServerTest() {
+    MakeTempDir(&temp_dir_);
+    const string& net_proto =
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 3 } "
+        "    shape { dim: 4 dim: 2 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'targets' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip2' "
+        "  bottom: 'targets' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(net_proto,
+        param_.mutable_net_param()));
+    param_.set_base_lr(0.01);
+    param_.set_lr_policy("step");
+    param_.set_gamma(0.5);
+    param_.set_stepsize(2);
+    param_.set_momentum(0.9);
+    param_.set_weight_decay(0.01);
+    param_.set_max_iter(6);
+    param_.set_display(0);
+    param_.set_snapshot_after_train(false);
+    param_.set_random_seed(1701);
+  }
+
+  // Trains with the group, returning the final weights of each worker.
+  void RunGroup(int num_servers, int num_workers, int staleness,
+      vector<vector<Dtype> >* weights) {
+    const string uri = "unix://" + temp_dir_ + "/socket";
+    const int size = num_servers + num_workers;
+    weights->assign(size, vector<Dtype>());
+    vector<shared_ptr<boost::thread> > threads;
+    for (int rank = 0; rank < size; ++rank) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &ParamServerRank<Dtype>, param_, uri, rank, size, num_servers,
+          staleness, &(*weights)[rank])));
+    }
+    for (int rank = 0; rank < size; ++rank) {
+      threads[rank]->join();
+    }
+    weights->erase(weights->begin(), weights->begin() + num_servers);
+  }
+
+  // The mean loss of the net of param_ with weights over a few batches.
+  Dtype Loss(const vector<Dtype>& weights) {
+    Net<Dtype> net(param_.net_param());
+    const vector<Blob<Dtype>*>& params = net.learnable_params();
+    int offset = 0;
+    for (int i = 0; i < params.size(); ++i) {
+      caffe_copy(params[i]->count(), &weights[offset],
+          params[i]->mutable_cpu_data());
+      offset += params[i]->count();
+    }
+    CHECK_EQ(offset, weights.size());
+    const int batches = 20;
+    Dtype loss = 0;
+    for (int i = 0; i < batches; ++i) {
+      Dtype batch_loss;
+      net.ForwardPrefilled(&batch_loss);
+      loss += batch_loss;
+    }
+    return loss / batches;
+  }
+
+  SolverParameter param_;
+  string temp_dir_;
+};
+
+TYPED_TEST_CASE(ParamServerTest, TestDtypes);
+
+TYPED_TEST(ParamServerTest, TestShards) {
+  Blob<TypeParam> blob_15(1, 1, 3, 5), blob_5(1, 1, 1, 5);
+  Blob<TypeParam> blob_10(1, 1, 2, 5), blob_2(1, 1, 1, 2);
+  vector<Blob<TypeParam>*> params;
+  params.push_back(&blob_15);
+  params.push_back(&blob_5);
+  params.push_back(&blob_10);
+  params.push_back(&blob_2);
+  vector<vector<int> > shards;
+  ComputeParamShards(params, 2, &shards);
+  ASSERT_EQ(2, shards.size());
+  ASSERT_EQ(2, shards[0].size());
+  EXPECT_EQ(0, shards[0][0]);
+  EXPECT_EQ(3, shards[0][1]);
+  ASSERT_EQ(2, shards[1].size());
+  EXPECT_EQ(1, shards[1][0]);
+  EXPECT_EQ(2, shards[1][1]);
+}
+
+TYPED_TEST(ParamServerTest, TestSingleWorkerMatchesSGD) {
+  typedef TypeParam Dtype;
+  // With one worker, asynchronous training is plain SGD.
+  vector<vector<Dtype> > weights;
+  this->RunGroup(2, 1, 0, &weights);
+  SGDSolver<Dtype> solver(this->param_);
+  solver.Solve();
+  const vector<Blob<Dtype>*>& params = solver.net()->learnable_params();
+  int offset = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_NEAR(params[i]->cpu_data()[j], weights[0][offset + j], 1e-5);
+    }
+    offset += params[i]->count();
+  }
+  EXPECT_EQ(offset, weights[0].size());
+}
+
+TYPED_TEST(ParamServerTest, TestBoundedStaleness) {
+  typedef TypeParam Dtype;
+  // Learn constant targets from random data, so that the loss tells how far
+  // training got. Each worker's gradients miss the updates of the others, so
+  // the learning rate is small enough for momentum not to amplify that.
+  DummyDataParameter* data_param = this->param_.mutable_net_param()->
+      mutable_layer(0)->mutable_dummy_data_param();
+  data_param->add_data_filler()->set_type("constant");
+  data_param->mutable_data_filler(1)->set_value(0.5);
+  this->param_.set_base_lr(0.001);
+  this->param_.set_lr_policy("fixed");
+  this->param_.set_max_iter(20);
+  vector<vector<Dtype> > weights;
+  this->RunGroup(2, 3, 1, &weights);
+  ASSERT_EQ(3, weights.size());
+  // Synchronous training, from the same initial weights.
+  SGDSolver<Dtype> solver(this->param_);
+  const vector<Blob<Dtype>*>& params = solver.net()->learnable_params();
+  vector<Dtype> initial, sync;
+  for (int i = 0; i < params.size(); ++i) {
+    initial.insert(initial.end(), params[i]->cpu_data(),
+        params[i]->cpu_data() + params[i]->count());
+  }
+  solver.Solve();
+  for (int i = 0; i < params.size(); ++i) {
+    sync.insert(sync.end(), params[i]->cpu_data(),
+        params[i]->cpu_data() + params[i]->count());
+  }
+  const Dtype initial_loss = this->Loss(initial);
+  const Dtype sync_loss = this->Loss(sync);
+  // The servers apply the updates of three workers, so they get at least
+  // about as far as synchronous training.
+  for (int w = 0; w < weights.size(); ++w) {
+    ASSERT_EQ(sync.size(), weights[w].size());
+    const Dtype loss = this->Loss(weights[w]);
+    EXPECT_LT(loss, initial_loss / 10);
+    EXPECT_LT(loss, 2 * sync_loss);
+  }
+}
+
+TYPED_TEST(ParamServerTest, TestCompressedGradients) {
+  typedef TypeParam Dtype;
+  this->param_.set_gradient_compression(SolverParameter::TOP_K);
+  this->param_.set_top_k_ratio(0.2);
+  vector<vector<Dtype> > weights;
+  this->RunGroup(1, 2, 0, &weights);
+  ASSERT_EQ(2, weights.size());
+  for (int w = 0; w < weights.size(); ++w) {
+    for (int i = 0; i < weights[w].size(); ++i) {
+      EXPECT_FALSE(std::isnan(weights[w][i]));
+    }
+  }
+}
+
+}  // namespace caffe
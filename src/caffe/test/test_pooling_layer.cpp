@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/layout.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -414,6 +415,20 @@ TYPED_TEST(PoolingLayerTest, TestSetupGlobalPooling) {
   EXPECT_EQ(this->blob_top_->width(), 1);
 }
 
+TYPED_TEST(PoolingLayerTest, TestAllowRecompute) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  layer_param.set_phase(TRAIN);
+  EXPECT_TRUE(PoolingLayer<Dtype>(layer_param).AllowRecompute());
+  // Stochastic pooling is only random in training.
+  pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
+  EXPECT_FALSE(PoolingLayer<Dtype>(layer_param).AllowRecompute());
+  layer_param.set_phase(TEST);
+  EXPECT_TRUE(PoolingLayer<Dtype>(layer_param).AllowRecompute());
+}
+
 /*
 TYPED_TEST(PoolingLayerTest, PrintBackward) {
   LayerParameter layer_param;
@@ -569,6 +584,52 @@ TYPED_TEST(PoolingLayerTest, TestForwardAve) {
   EXPECT_NEAR(this->blob_top_->cpu_data()[8], 8.0 / 9, epsilon);
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardBlocked) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const int block = 2;
+  Blob<Dtype> blocked_bottom(this->blob_bottom_->shape());
+  caffe_cpu_change_channel_block(this->blob_bottom_->num(),
+      this->blob_bottom_->channels(), this->blob_bottom_->count(2), 1, block,
+      this->blob_bottom_->cpu_data(), blocked_bottom.mutable_cpu_data());
+  blocked_bottom.set_channel_block(block);
+  Blob<Dtype> blocked_top;
+  vector<Blob<Dtype>*> bottom_vec(1, &blocked_bottom);
+  vector<Blob<Dtype>*> top_vec(1, &blocked_top);
+  for (int method = PoolingParameter_PoolMethod_MAX;
+       method <= PoolingParameter_PoolMethod_AVE; ++method) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    pooling_param->set_pool(
+        static_cast<PoolingParameter_PoolMethod>(method));
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    PoolingLayer<Dtype> blocked_layer(layer_param);
+    blocked_layer.SetUp(bottom_vec, top_vec);
+    blocked_layer.Forward(bottom_vec, top_vec);
+    EXPECT_EQ(block, blocked_top.channel_block());
+    EXPECT_TRUE(blocked_top.shape() == this->blob_top_->shape());
+    const int spatial_dim = blocked_top.count(2);
+    for (int n = 0; n < blocked_top.num(); ++n) {
+      for (int c = 0; c < blocked_top.channels(); ++c) {
+        for (int s = 0; s < spatial_dim; ++s) {
+          EXPECT_NEAR(this->blob_top_->cpu_data()[
+              this->blob_top_->offset(n, c) + s],
+              blocked_top.cpu_data()[blocked_top.offset(n) +
+              channel_block_offset(spatial_dim, block, c, s)], 1e-5);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(PoolingLayerTest, TestGradientAve) {
   typedef typename TypeParam::Dtype Dtype;
   for (int kernel_h = 3; kernel_h <= 4; kernel_h++) {
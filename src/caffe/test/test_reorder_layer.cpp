@@ -0,0 +1,309 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/insert_reorders.hpp"
+#include "caffe/util/layout.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ReorderLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ReorderLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 8, 3, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ReorderLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ReorderLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ReorderLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_reorder_param()->set_channel_block(4);
+  ReorderLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(this->blob_top_->shape() == this->blob_bottom_->shape());
+  EXPECT_EQ(4, this->blob_top_->channel_block());
+}
+
+TYPED_TEST(ReorderLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_reorder_param()->set_channel_block(4);
+  ReorderLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int spatial_dim = this->blob_bottom_->count(2);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int n = 0; n < this->blob_bottom_->num(); ++n) {
+    for (int c = 0; c < this->blob_bottom_->channels(); ++c) {
+      for (int s = 0; s < spatial_dim; ++s) {
+        EXPECT_EQ(this->blob_bottom_->cpu_data()[
+            this->blob_bottom_->offset(n, c) + s],
+            top_data[this->blob_top_->offset(n) +
+            channel_block_offset(spatial_dim, 4, c, s)]);
+      }
+    }
+  }
+  // Reorder from one block to another and back to NCHW.
+  Blob<Dtype> blob_2, blob_nchw;
+  vector<Blob<Dtype>*> bottom_vec(1, this->blob_top_);
+  vector<Blob<Dtype>*> top_vec(1, &blob_2);
+  layer_param.mutable_reorder_param()->set_channel_block(2);
+  ReorderLayer<Dtype> layer_2(layer_param);
+  layer_2.SetUp(bottom_vec, top_vec);
+  layer_2.Forward(bottom_vec, top_vec);
+  bottom_vec[0] = &blob_2;
+  top_vec[0] = &blob_nchw;
+  layer_param.mutable_reorder_param()->set_channel_block(1);
+  ReorderLayer<Dtype> layer_nchw(layer_param);
+  layer_nchw.SetUp(bottom_vec, top_vec);
+  layer_nchw.Forward(bottom_vec, top_vec);
+  EXPECT_EQ(1, blob_nchw.channel_block());
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i], blob_nchw.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_reorder_param()->set_channel_block(8);
+  ReorderLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+class ReorderInsertionTest : public ::testing::Test {
+ protected:
+  void RunInsertionTest(
+      const string& input_param_string, const string& output_param_string) {
+    // Test that InsertReorders called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    InsertReorders(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+  }
+};
+
+TEST_F(ReorderInsertionTest, TestNoInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 } "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv' "
+      "  top: 'innerprod' "
+      "} ";
+  this->RunInsertionTest(input_proto, input_proto);
+}
+
+TEST_F(ReorderInsertionTest, TestInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "channel_block: 8 "
+      "input: 'data' "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 16 } "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 6 } "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'prelu' "
+      "  type: 'PReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling' "
+      "  bottom: 'conv1' "
+      "  top: 'pool' "
+      "} "
+      "layer { "
+      "  name: 'conv3' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 } "
+      "  bottom: 'conv2' "
+      "  top: 'conv3' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "channel_block: 8 "
+      "input: 'data' "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 16 channel_block: 8 } "
+      "  bottom: 'data' "
+      "  top: 'conv1_blocked' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1_blocked' "
+      "  top: 'conv1_blocked' "
+      "} "
+      "layer { "
+      "  name: 'conv1_reorder_0' "
+      "  type: 'Reorder' "
+      "  bottom: 'conv1_blocked' "
+      "  top: 'conv1_reorder_0' "
+      "  reorder_param { channel_block: 1 } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 6 } "
+      "  bottom: 'conv1_reorder_0' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'prelu' "
+      "  type: 'PReLU' "
+      "  bottom: 'conv1_reorder_0' "
+      "  top: 'conv1_reorder_0' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling' "
+      "  bottom: 'conv1_reorder_0' "
+      "  top: 'pool' "
+      "} "
+      "layer { "
+      "  name: 'conv3' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 channel_block: 8 } "
+      "  bottom: 'conv2' "
+      "  top: 'conv3_blocked' "
+      "} "
+      "layer { "
+      "  name: 'conv3_reorder_0' "
+      "  type: 'Reorder' "
+      "  bottom: 'conv3_blocked' "
+      "  top: 'conv3' "
+      "  reorder_param { channel_block: 1 } "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(ReorderInsertionTest, TestInsertionOutput) {
+  // A blob requested as an output is reordered even if it is consumed.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "channel_block: 8 "
+      "input: 'data' "
+      "output: 'conv1' "
+      "output: 'conv2' "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 } "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 } "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "channel_block: 8 "
+      "input: 'data' "
+      "output: 'conv1' "
+      "output: 'conv2' "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 channel_block: 8 } "
+      "  bottom: 'data' "
+      "  top: 'conv1_blocked' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  convolution_param { num_output: 8 channel_block: 8 } "
+      "  bottom: 'conv1_blocked' "
+      "  top: 'conv2_blocked' "
+      "} "
+      "layer { "
+      "  name: 'conv1_reorder_0' "
+      "  type: 'Reorder' "
+      "  bottom: 'conv1_blocked' "
+      "  top: 'conv1' "
+      "  reorder_param { channel_block: 1 } "
+      "} "
+      "layer { "
+      "  name: 'conv2_reorder_0' "
+      "  type: 'Reorder' "
+      "  bottom: 'conv2_blocked' "
+      "  top: 'conv2' "
+      "  reorder_param { channel_block: 1 } "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+}  // namespace caffe
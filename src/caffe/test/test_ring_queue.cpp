@@ -0,0 +1,102 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/ring_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class RingQueueTest : public ::testing::Test {};
+
+static void Produce(RingQueue<int>* queue, int first, int count) {
+  for (int i = first; i < first + count; ++i) {
+    queue->push(i);
+  }
+}
+
+static void Consume(RingQueue<int>* queue, int count, vector<int>* values) {
+  for (int i = 0; i < count; ++i) {
+    values->push_back(queue->pop());
+  }
+}
+
+TEST_F(RingQueueTest, TestOrder) {
+  for (int single = 0; single < 2; ++single) {
+    RingQueue<int> queue(3, single);
+    EXPECT_EQ(4, queue.capacity());
+    int value;
+    EXPECT_FALSE(queue.try_pop(&value));
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_TRUE(queue.try_push(i));
+    }
+    EXPECT_FALSE(queue.try_push(4));
+    EXPECT_EQ(4, queue.size());
+    EXPECT_EQ(0, queue.peek());
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(i, queue.pop());
+    }
+    EXPECT_EQ(0, queue.size());
+    EXPECT_FALSE(queue.try_peek(&value));
+  }
+}
+
+TEST_F(RingQueueTest, TestThreads) {
+  // Two producers and two consumers, through a queue too small to hold the
+  // values, so that they wait on each other.
+  const int count = 10000;
+  RingQueue<int> queue(8);
+  vector<vector<int> > values(2);
+  boost::thread producer0(&Produce, &queue, 0, count);
+  boost::thread producer1(&Produce, &queue, count, count);
+  boost::thread consumer0(&Consume, &queue, count, &values[0]);
+  boost::thread consumer1(&Consume, &queue, count, &values[1]);
+  producer0.join();
+  producer1.join();
+  consumer0.join();
+  consumer1.join();
+  vector<int> seen(2 * count, 0);
+  for (int c = 0; c < 2; ++c) {
+    ASSERT_EQ(count, values[c].size());
+    for (int i = 0; i < count; ++i) {
+      ++seen[values[c][i]];
+      // The values of each producer are popped in order.
+      if (i > 0 && (values[c][i] < count) == (values[c][i - 1] < count)) {
+        EXPECT_LT(values[c][i - 1], values[c][i]);
+      }
+    }
+  }
+  for (int i = 0; i < 2 * count; ++i) {
+    EXPECT_EQ(1, seen[i]);
+  }
+}
+
+TEST_F(RingQueueTest, TestSingleProducerConsumer) {
+  // The values go through in order, the threads waiting on each other.
+  const int count = 10000;
+  RingQueue<int> queue(8, true);
+  vector<int> values;
+  boost::thread producer(&Produce, &queue, 0, count);
+  boost::thread consumer(&Consume, &queue, count, &values);
+  producer.join();
+  consumer.join();
+  ASSERT_EQ(count, values.size());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(i, values[i]);
+  }
+}
+
+TEST_F(RingQueueTest, TestInterrupt) {
+  // A thread waiting on an empty queue can be stopped.
+  RingQueue<int> queue(2);
+  vector<int> values;
+  boost::thread consumer(&Consume, &queue, 1, &values);
+  consumer.interrupt();
+  consumer.join();
+  EXPECT_TRUE(values.empty());
+}
+
+}  // namespace caffe
@@ -133,6 +133,26 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossNum) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  layer_param.mutable_slice_param()->set_view_tops(true);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  const int offset = this->blob_top_0_->count();
+  EXPECT_TRUE(this->blob_top_0_->IsDataViewOf(*this->blob_bottom_, 0));
+  EXPECT_TRUE(this->blob_top_1_->IsDataViewOf(*this->blob_bottom_, offset));
+  EXPECT_TRUE(this->blob_top_1_->IsDiffViewOf(*this->blob_bottom_, offset));
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  for (int i = 0; i < offset; ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_0_->cpu_data()[i]);
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[offset + i],
+        this->blob_top_1_->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -200,6 +220,19 @@ TYPED_TEST(SliceLayerTest, TestGradientAcrossNum) {
     this->blob_top_vec_0_);
 }
 
+TYPED_TEST(SliceLayerTest, TestGradientAcrossNumViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Gradient checks are slow; reduce blob size.
+  this->ReduceBottomBlobSize();
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  layer_param.mutable_slice_param()->set_view_tops(true);
+  SliceLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+    this->blob_top_vec_0_);
+}
+
 TYPED_TEST(SliceLayerTest, TestGradientAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   // Gradient checks are slow; reduce blob size.
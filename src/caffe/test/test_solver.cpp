@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
@@ -105,4 +106,130 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTests) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "test_interval: 2 "
+     "test_iter: 3 "
+     "test_async: true "
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "max_iter: 4 "
+     "display: 0 "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 2 } "
+     "      data_filler { type: 'gaussian' } "
+     "      shape { dim: 5 } "
+     "      data_filler { type: 'constant' value: 1 } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 3 "
+     "      weight_filler { type: 'gaussian' } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // The test net was last given a copy of the final weights.
+  ASSERT_EQ(1, this->solver_->test_nets().size());
+  const Blob<Dtype>& weights =
+      *this->solver_->net()->layer_by_name("innerprod")->blobs()[0];
+  const Blob<Dtype>& test_weights =
+      *this->solver_->test_nets()[0]->layer_by_name("innerprod")->blobs()[0];
+  EXPECT_NE(weights.cpu_data(), test_weights.cpu_data());
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], test_weights.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(SolverTest, TestTestNetFollowsUpdates) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The test net shares the weights of the training net, and in CPU mode
+  // runs the convolution on a copy of them in the channel-blocked layout,
+  // which must follow the updates, also when they go through the arena.
+  for (int contiguous = 0; contiguous < 2; ++contiguous) {
+    ostringstream proto;
+    proto <<
+       "test_interval: 1 "
+       "test_iter: 1 "
+       "base_lr: 0.1 "
+       "lr_policy: 'fixed' "
+       "max_iter: 2 "
+       "display: 0 "
+       "snapshot_after_train: false "
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  channel_block: 2 "
+       "  contiguous_params: " << (contiguous ? "true" : "false") << " "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      shape { dim: 2 dim: 2 dim: 4 dim: 4 } "
+       "      data_filler { type: 'constant' value: 1 } "
+       "      shape { dim: 2 dim: 4 dim: 2 dim: 2 } "
+       "      data_filler { type: 'constant' value: 0 } "
+       "    } "
+       "    top: 'data' "
+       "    top: 'target' "
+       "  } "
+       "  layer { "
+       "    name: 'conv' "
+       "    type: 'Convolution' "
+       "    convolution_param { "
+       "      num_output: 4 "
+       "      kernel_size: 3 "
+       "      weight_filler { type: 'gaussian' } "
+       "      bias_filler { type: 'constant' value: 0.1 } "
+       "    } "
+       "    bottom: 'data' "
+       "    top: 'conv' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'conv' "
+       "    bottom: 'target' "
+       "  } "
+       "} ";
+    this->InitSolverFromProtoString(proto.str());
+    ASSERT_EQ(1, this->solver_->test_nets().size());
+    Net<Dtype>* test_net = this->solver_->test_nets()[0].get();
+    Dtype initial_loss;
+    test_net->ForwardPrefilled(&initial_loss);
+    // Tests after every iteration.
+    this->solver_->Solve();
+    Dtype loss;
+    test_net->ForwardPrefilled(&loss);
+    NetParameter net_param = this->solver_->param().net_param();
+    net_param.mutable_state()->set_phase(TEST);
+    Net<Dtype> expected_net(net_param);
+    expected_net.CopyTrainedLayersFrom(this->solver_->net().get());
+    Dtype expected_loss;
+    expected_net.ForwardPrefilled(&expected_loss);
+    EXPECT_NE(initial_loss, expected_loss);
+    EXPECT_NEAR(expected_loss, loss, 1e-4 * std::fabs(expected_loss));
+  }
+}
+
 }  // namespace caffe
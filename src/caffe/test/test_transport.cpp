@@ -0,0 +1,143 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/transport.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+enum RingOp { ALLREDUCE, ALLREDUCE_HALF, BROADCAST, ALLGATHER };
+
+// Runs one process of the group, on its own thread.
+template <typename Dtype>
+static void RingWorker(const string& uri, int rank, int size, RingOp op,
+    vector<Dtype>* data) {
+  SocketTransport transport(uri, rank, size);
+  if (op == ALLGATHER) {
+    // Gathers messages of rank + 1 bytes equal to rank.
+    vector<vector<char> > messages;
+    caffe_ring_allgather(&transport, vector<char>(rank + 1, rank), &messages);
+    for (int r = 0; r < messages.size(); ++r) {
+      data->insert(data->end(), messages[r].begin(), messages[r].end());
+    }
+  } else if (op == ALLREDUCE_HALF) {
+    caffe_ring_allreduce_half(&transport, data->size(), FP16, &(*data)[0]);
+  } else if (op == BROADCAST) {
+    caffe_ring_broadcast(&transport, data->size(), &(*data)[0]);
+  } else {
+    caffe_ring_allreduce(&transport, data->size(), &(*data)[0]);
+  }
+}
+
+template <typename Dtype>
+class TransportTest : public ::testing::Test {
+ protected:
+  TransportTest() {
+    MakeTempDir(&temp_dir_);
+  }
+
+  // Runs size processes on data, where data[r] is the data of rank r.
+  void RunGroup(int size, RingOp op, vector<vector<Dtype> >* data) {
+    const string uri = "unix://" + temp_dir_ + "/socket";
+    vector<shared_ptr<boost::thread> > threads;
+    for (int rank = 0; rank < size; ++rank) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &RingWorker<Dtype>, uri, rank, size, op, &(*data)[rank])));
+    }
+    for (int rank = 0; rank < size; ++rank) {
+      threads[rank]->join();
+    }
+  }
+
+  void TestAllReduce(int size, int count) {
+    vector<vector<Dtype> > data(size, vector<Dtype>(count));
+    for (int rank = 0; rank < size; ++rank) {
+      for (int i = 0; i < count; ++i) {
+        data[rank][i] = rank * count + i;
+      }
+    }
+    RunGroup(size, ALLREDUCE, &data);
+    for (int rank = 0; rank < size; ++rank) {
+      for (int i = 0; i < count; ++i) {
+        EXPECT_EQ(count * size * (size - 1) / 2 + size * i, data[rank][i]);
+      }
+    }
+  }
+
+  string temp_dir_;
+};
+
+TYPED_TEST_CASE(TransportTest, TestDtypes);
+
+TYPED_TEST(TransportTest, TestAllReduce) {
+  this->TestAllReduce(3, 1000);
+}
+
+TYPED_TEST(TransportTest, TestAllReducePair) {
+  this->TestAllReduce(2, 7);
+}
+
+TYPED_TEST(TransportTest, TestAllReduceFewerValuesThanRanks) {
+  this->TestAllReduce(4, 3);
+}
+
+TYPED_TEST(TransportTest, TestAllReduceHalf) {
+  const int size = 4;
+  const int count = 1000;
+  vector<vector<TypeParam> > data(size, vector<TypeParam>(count));
+  for (int rank = 0; rank < size; ++rank) {
+    for (int i = 0; i < count; ++i) {
+      data[rank][i] = (rank + 1) * (i + 0.1) / 3;
+    }
+  }
+  this->RunGroup(size, ALLREDUCE_HALF, &data);
+  for (int rank = 0; rank < size; ++rank) {
+    for (int i = 0; i < count; ++i) {
+      // Rounded at each of the size - 1 hops, and at the end.
+      const TypeParam expected = 10 * (i + 0.1) / 3;
+      EXPECT_NEAR(expected, data[rank][i], size * 1e-3 * expected);
+      // The processes end up with the same values.
+      EXPECT_EQ(data[0][i], data[rank][i]);
+    }
+  }
+}
+
+TYPED_TEST(TransportTest, TestBroadcast) {
+  const int size = 3;
+  const int count = 1000;
+  vector<vector<TypeParam> > data(size, vector<TypeParam>(count));
+  for (int rank = 0; rank < size; ++rank) {
+    for (int i = 0; i < count; ++i) {
+      data[rank][i] = rank * count + i;
+    }
+  }
+  this->RunGroup(size, BROADCAST, &data);
+  for (int rank = 0; rank < size; ++rank) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(i, data[rank][i]);
+    }
+  }
+}
+
+TYPED_TEST(TransportTest, TestAllGather) {
+  const int size = 3;
+  vector<vector<TypeParam> > data(size);
+  this->RunGroup(size, ALLGATHER, &data);
+  for (int rank = 0; rank < size; ++rank) {
+    ASSERT_EQ(6, data[rank].size());
+    int i = 0;
+    for (int r = 0; r < size; ++r) {
+      for (int j = 0; j <= r; ++j) {
+        EXPECT_EQ(r, data[rank][i++]);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
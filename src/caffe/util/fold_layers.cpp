@@ -0,0 +1,120 @@
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/fold_layers.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Whether the layer computes a linear map of its bottom, plus its bias.
+static bool IsLinear(const LayerParameter& layer_param) {
+  const string& type = layer_param.type();
+  return type == "Convolution" || type == "Deconvolution" ||
+      type == "InnerProduct";
+}
+
+// Returns the number of outputs of the linear layer, and whether it has a
+// bias.
+static int NumOutput(const LayerParameter& layer_param, bool* bias_term) {
+  if (layer_param.type() == "InnerProduct") {
+    *bias_term = layer_param.inner_product_param().bias_term();
+    return layer_param.inner_product_param().num_output();
+  }
+  *bias_term = layer_param.convolution_param().bias_term();
+  return layer_param.convolution_param().num_output();
+}
+
+// Scales the outputs of the linear layer, and shifts them.
+static void ScaleShift(float scale, float shift, LayerParameter* layer_param) {
+  bool bias_term;
+  const int num_output = NumOutput(*layer_param, &bias_term);
+  CHECK_GE(layer_param->blobs_size(), bias_term ? 2 : 1)
+      << "Layer " << layer_param->name() << " has no trained weights.";
+  Blob<float> weights;
+  weights.FromProto(layer_param->blobs(0));
+  caffe_scal(weights.count(), scale, weights.mutable_cpu_data());
+  // Blobs are written in single precision, whatever they were in.
+  layer_param->mutable_blobs(0)->Clear();
+  weights.ToProto(layer_param->mutable_blobs(0));
+  Blob<float> bias(vector<int>(1, num_output));
+  if (bias_term) {
+    bias.FromProto(layer_param->blobs(1));
+    caffe_scal(bias.count(), scale, bias.mutable_cpu_data());
+  } else {
+    caffe_set(bias.count(), 0.f, bias.mutable_cpu_data());
+    layer_param->add_blobs();
+    if (layer_param->type() == "InnerProduct") {
+      layer_param->mutable_inner_product_param()->set_bias_term(true);
+    } else {
+      layer_param->mutable_convolution_param()->set_bias_term(true);
+    }
+  }
+  caffe_add_scalar(bias.count(), shift, bias.mutable_cpu_data());
+  layer_param->mutable_blobs(1)->Clear();
+  bias.ToProto(layer_param->mutable_blobs(1));
+}
+
+void FoldAffineLayers(const NetParameter& param, NetParameter* param_folded) {
+  param_folded->CopyFrom(param);
+  for (int i = 0; i < param_folded->layer_size(); ++i) {
+    const LayerParameter& layer_param = param_folded->layer(i);
+    const PowerParameter& power_param = layer_param.power_param();
+    const bool is_dropout = layer_param.type() == "Dropout";
+    const bool is_affine = layer_param.type() == "Power" &&
+        power_param.power() == 1;
+    if (!(is_dropout || is_affine) || layer_param.bottom_size() != 1 ||
+        layer_param.top_size() != 1) {
+      continue;
+    }
+    const string& bottom = layer_param.bottom(0);
+    const string& top = layer_param.top(0);
+    const bool in_place = bottom == top;
+    if (is_dropout && in_place) {
+      LOG(INFO) << "Removing " << layer_param.name();
+      param_folded->mutable_layer()->DeleteSubrange(i--, 1);
+      continue;
+    }
+    // The last layer writing the bottom, whose output must be read by this
+    // layer only, and which must not work in place to be renamed.
+    int producer = -1;
+    for (int j = 0; j < i; ++j) {
+      for (int k = 0; k < param_folded->layer(j).top_size(); ++k) {
+        if (param_folded->layer(j).top(k) == bottom) { producer = j; }
+      }
+    }
+    if (producer < 0) { continue; }
+    const int last_reader = in_place ? i : param_folded->layer_size() - 1;
+    bool shared = false;
+    for (int j = producer; j <= last_reader; ++j) {
+      const LayerParameter& other = param_folded->layer(j);
+      for (int k = 0; j != i && k < other.bottom_size(); ++k) {
+        shared = shared || other.bottom(k) == bottom;
+      }
+    }
+    if (shared) { continue; }
+    LayerParameter* producer_param = param_folded->mutable_layer(producer);
+    if (is_affine) {
+      bool has_shared_params = false;
+      for (int k = 0; k < producer_param->param_size(); ++k) {
+        has_shared_params = has_shared_params ||
+            producer_param->param(k).has_name();
+      }
+      if (!IsLinear(*producer_param) || has_shared_params) { continue; }
+      ScaleShift(power_param.scale(), power_param.shift(), producer_param);
+    }
+    LOG(INFO) << "Folding " << layer_param.name() << " into "
+              << producer_param->name();
+    if (!in_place) {
+      for (int k = 0; k < producer_param->top_size(); ++k) {
+        if (producer_param->top(k) == bottom) {
+          producer_param->set_top(k, top);
+        }
+      }
+    }
+    param_folded->mutable_layer()->DeleteSubrange(i--, 1);
+  }
+}
+
+}  // namespace caffe
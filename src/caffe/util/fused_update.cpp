@@ -0,0 +1,209 @@
+#include <cmath>
+
+#include "caffe/util/fused_update.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_sgd_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype h = momentum * history[i] + rate * terms(diff[i], data[i]);
+    history[i] = h;
+    diff[i] = h;
+    data[i] -= h;
+  }
+}
+
+template void caffe_cpu_sgd_update<float>(const int N,
+    const GradientTerms<float>& terms, const float momentum, const float rate,
+    float* data, float* diff, float* history);
+template void caffe_cpu_sgd_update<double>(const int N,
+    const GradientTerms<double>& terms, const double momentum,
+    const double rate, double* data, double* diff, double* history);
+
+template <typename Dtype>
+void caffe_cpu_nesterov_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype h_prev = history[i];
+    const Dtype h = momentum * h_prev + rate * terms(diff[i], data[i]);
+    const Dtype update = (Dtype(1) + momentum) * h - momentum * h_prev;
+    history[i] = h;
+    diff[i] = update;
+    data[i] -= update;
+  }
+}
+
+template void caffe_cpu_nesterov_update<float>(const int N,
+    const GradientTerms<float>& terms, const float momentum, const float rate,
+    float* data, float* diff, float* history);
+template void caffe_cpu_nesterov_update<double>(const int N,
+    const GradientTerms<double>& terms, const double momentum,
+    const double rate, double* data, double* diff, double* history);
+
+template <typename Dtype>
+void caffe_cpu_adagrad_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype delta, const Dtype rate, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype g = terms(diff[i], data[i]);
+    const Dtype h = history[i] + g * g;
+    const Dtype update = rate * g / (std::sqrt(h) + delta);
+    history[i] = h;
+    diff[i] = update;
+    data[i] -= update;
+  }
+}
+
+template void caffe_cpu_adagrad_update<float>(const int N,
+    const GradientTerms<float>& terms, const float delta, const float rate,
+    float* data, float* diff, float* history);
+template void caffe_cpu_adagrad_update<double>(const int N,
+    const GradientTerms<double>& terms, const double delta, const double rate,
+    double* data, double* diff, double* history);
+
+template <typename Dtype>
+void caffe_cpu_rmsprop_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype rms_decay, const Dtype delta, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* history) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype g = terms(diff[i], data[i]);
+    const Dtype h = rms_decay * history[i] + (Dtype(1) - rms_decay) * g * g;
+    const Dtype update = rate * g / (std::sqrt(h) + delta);
+    history[i] = h;
+    diff[i] = update;
+    data[i] -= update;
+  }
+}
+
+template void caffe_cpu_rmsprop_update<float>(const int N,
+    const GradientTerms<float>& terms, const float rms_decay,
+    const float delta, const float rate, float* data, float* diff,
+    float* history);
+template void caffe_cpu_rmsprop_update<double>(const int N,
+    const GradientTerms<double>& terms, const double rms_decay,
+    const double delta, const double rate, double* data, double* diff,
+    double* history);
+
+template <typename Dtype>
+void caffe_cpu_adadelta_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype delta, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* history, Dtype* update_history) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype g = terms(diff[i], data[i]);
+    const Dtype h = momentum * history[i] + (Dtype(1) - momentum) * g * g;
+    const Dtype u =
+        g * std::sqrt((update_history[i] + delta) / (h + delta));
+    history[i] = h;
+    update_history[i] =
+        momentum * update_history[i] + (Dtype(1) - momentum) * u * u;
+    const Dtype update = rate * u;
+    diff[i] = update;
+    data[i] -= update;
+  }
+}
+
+template void caffe_cpu_adadelta_update<float>(const int N,
+    const GradientTerms<float>& terms, const float momentum,
+    const float delta, const float rate, float* data, float* diff,
+    float* history, float* update_history);
+template void caffe_cpu_adadelta_update<double>(const int N,
+    const GradientTerms<double>& terms, const double momentum,
+    const double delta, const double rate, double* data, double* diff,
+    double* history, double* update_history);
+
+template <typename Dtype>
+void caffe_cpu_adam_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype beta1, const Dtype beta2, const Dtype eps_hat, const Dtype rate,
+    Dtype* data, Dtype* diff, Dtype* m, Dtype* v) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype g = terms(diff[i], data[i]);
+    const Dtype m_i = beta1 * m[i] + (Dtype(1) - beta1) * g;
+    const Dtype v_i = beta2 * v[i] + (Dtype(1) - beta2) * g * g;
+    const Dtype update = rate * m_i / (std::sqrt(v_i) + eps_hat);
+    m[i] = m_i;
+    v[i] = v_i;
+    diff[i] = update;
+    data[i] -= update;
+  }
+}
+
+template void caffe_cpu_adam_update<float>(const int N,
+    const GradientTerms<float>& terms, const float beta1, const float beta2,
+    const float eps_hat, const float rate, float* data, float* diff, float* m,
+    float* v);
+template void caffe_cpu_adam_update<double>(const int N,
+    const GradientTerms<double>& terms, const double beta1,
+    const double beta2, const double eps_hat, const double rate, double* data,
+    double* diff, double* m, double* v);
+
+template <typename Dtype>
+void caffe_cpu_lars_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype momentum, const Dtype eta, const Dtype rate, Dtype* data,
+    Dtype* diff, Dtype* history) {
+  // The norms are accumulated in double to limit the rounding over N values.
+  double data_sumsq = 0;
+  double grad_sumsq = 0;
+  for (int i = 0; i < N; ++i) {
+    const Dtype g = terms(diff[i], data[i]);
+    diff[i] = g;
+    data_sumsq += data[i] * data[i];
+    grad_sumsq += g * g;
+  }
+  const Dtype trust = caffe_trust_ratio(eta, Dtype(std::sqrt(data_sumsq)),
+      Dtype(std::sqrt(grad_sumsq)));
+  // diff now holds g, so the rest is plain SGD.
+  caffe_cpu_sgd_update(N, GradientTerms<Dtype>(), momentum, rate * trust,
+      data, diff, history);
+}
+
+template void caffe_cpu_lars_update<float>(const int N,
+    const GradientTerms<float>& terms, const float momentum, const float eta,
+    const float rate, float* data, float* diff, float* history);
+template void caffe_cpu_lars_update<double>(const int N,
+    const GradientTerms<double>& terms, const double momentum,
+    const double eta, const double rate, double* data, double* diff,
+    double* history);
+
+template <typename Dtype>
+void caffe_cpu_lamb_update(const int N, const GradientTerms<Dtype>& terms,
+    const Dtype beta1, const Dtype beta2, const Dtype bias1, const Dtype bias2,
+    const Dtype eps, const Dtype rate, Dtype* data, Dtype* diff, Dtype* m,
+    Dtype* v) {
+  double data_sumsq = 0;
+  double direction_sumsq = 0;
+  for (int i = 0; i < N; ++i) {
+    const Dtype g = terms.scale * diff[i];
+    const Dtype m_i = beta1 * m[i] + (Dtype(1) - beta1) * g;
+    const Dtype v_i = beta2 * v[i] + (Dtype(1) - beta2) * g * g;
+    const Dtype r = (m_i / bias1) / (std::sqrt(v_i / bias2) + eps) +
+        terms(Dtype(0), data[i]);
+    m[i] = m_i;
+    v[i] = v_i;
+    diff[i] = r;
+    data_sumsq += data[i] * data[i];
+    direction_sumsq += r * r;
+  }
+  const Dtype step = rate * caffe_trust_ratio(Dtype(1),
+      Dtype(std::sqrt(data_sumsq)), Dtype(std::sqrt(direction_sumsq)));
+  for (int i = 0; i < N; ++i) {
+    const Dtype update = step * diff[i];
+    diff[i] = update;
+    data[i] -= update;
+  }
+}
+
+template void caffe_cpu_lamb_update<float>(const int N,
+    const GradientTerms<float>& terms, const float beta1, const float beta2,
+    const float bias1, const float bias2, const float eps, const float rate,
+    float* data, float* diff, float* m, float* v);
+template void caffe_cpu_lamb_update<double>(const int N,
+    const GradientTerms<double>& terms, const double beta1,
+    const double beta2, const double bias1, const double bias2,
+    const double eps, const double rate, double* data, double* diff,
+    double* m, double* v);
+
+}  // namespace caffe
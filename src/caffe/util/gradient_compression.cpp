@@ -0,0 +1,183 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Values per block of ONE_BIT, each block being sent with the means of its
+// positive and negative values.
+static const int kOneBitBlockSize = 256;
+
+// Orders indices by decreasing magnitude of their values.
+template <typename Dtype>
+class LargerMagnitude {
+ public:
+  explicit LargerMagnitude(const Dtype* values) : values_(values) { }
+  bool operator()(int a, int b) const {
+    return std::fabs(values_[a]) > std::fabs(values_[b]);
+  }
+
+ private:
+  const Dtype* values_;
+};
+
+template <typename Dtype>
+GradientCompressor<Dtype>::GradientCompressor(
+    SolverParameter::GradientCompression type, int count, float top_k_ratio)
+    : type_(type),
+      count_(count),
+      top_k_(std::min(count, std::max(1,
+          static_cast<int>(std::ceil(count * top_k_ratio))))) {
+  if (type == SolverParameter::TOP_K) {
+    CHECK_GT(top_k_ratio, 0);
+    CHECK_LE(top_k_ratio, 1);
+  }
+  if (type == SolverParameter::TOP_K || type == SolverParameter::ONE_BIT) {
+    residual_.resize(count, Dtype(0));
+  }
+}
+
+template <typename Dtype>
+void GradientCompressor<Dtype>::Compress(const Dtype* diff,
+    vector<char>* message) {
+  switch (type_) {
+  case SolverParameter::NONE:
+    message->resize(count_ * sizeof(Dtype));
+    memcpy(&(*message)[0], diff, message->size());
+    break;
+  case SolverParameter::FP16:
+  case SolverParameter::BF16:
+    message->resize(count_ * sizeof(uint16_t));
+    caffe_cpu_to_half(count_, diff,
+        type_ == SolverParameter::FP16 ? FP16 : BF16,
+        reinterpret_cast<uint16_t*>(&(*message)[0]));
+    break;
+  case SolverParameter::TOP_K: {
+    // The indices of the top_k_ values, then the values.
+    caffe_axpy(count_, Dtype(1), diff, &residual_[0]);
+    vector<int> order(count_);
+    for (int i = 0; i < count_; ++i) {
+      order[i] = i;
+    }
+    std::nth_element(order.begin(), order.begin() + top_k_ - 1, order.end(),
+        LargerMagnitude<Dtype>(&residual_[0]));
+    message->resize(top_k_ * (sizeof(uint32_t) + sizeof(Dtype)));
+    char* indices = &(*message)[0];
+    char* values = indices + top_k_ * sizeof(uint32_t);
+    for (int i = 0; i < top_k_; ++i) {
+      const uint32_t index = order[i];
+      memcpy(indices + i * sizeof(index), &index, sizeof(index));
+      memcpy(values + i * sizeof(Dtype), &residual_[index], sizeof(Dtype));
+      residual_[index] = 0;
+    }
+    break;
+  }
+  case SolverParameter::ONE_BIT: {
+    // The means of the positive and negative values of each block, then one
+    // bit per value telling its sign.
+    caffe_axpy(count_, Dtype(1), diff, &residual_[0]);
+    const int num_blocks = (count_ + kOneBitBlockSize - 1) / kOneBitBlockSize;
+    message->assign(num_blocks * 2 * sizeof(Dtype) + (count_ + 7) / 8, 0);
+    char* means = &(*message)[0];
+    uint8_t* bits =
+        reinterpret_cast<uint8_t*>(means + num_blocks * 2 * sizeof(Dtype));
+    for (int b = 0; b < num_blocks; ++b) {
+      const int begin = b * kOneBitBlockSize;
+      const int end = std::min(count_, begin + kOneBitBlockSize);
+      Dtype sums[2] = {0, 0};
+      int counts[2] = {0, 0};
+      for (int i = begin; i < end; ++i) {
+        const int positive = residual_[i] >= 0;
+        sums[positive] += residual_[i];
+        ++counts[positive];
+        bits[i / 8] |= positive << (i % 8);
+      }
+      for (int j = 0; j < 2; ++j) {
+        sums[j] = counts[j] ? sums[j] / counts[j] : Dtype(0);
+      }
+      memcpy(means + b * 2 * sizeof(Dtype), sums, sizeof(sums));
+      for (int i = begin; i < end; ++i) {
+        residual_[i] -= sums[residual_[i] >= 0];
+      }
+    }
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown gradient compression " << type_;
+  }
+}
+
+template <typename Dtype>
+void GradientCompressor<Dtype>::DecompressAdd(const vector<char>& message,
+    Dtype* diff) const {
+  switch (type_) {
+  case SolverParameter::NONE: {
+    CHECK_EQ(message.size(), count_ * sizeof(Dtype));
+    vector<Dtype> values(count_);
+    memcpy(&values[0], &message[0], message.size());
+    caffe_axpy(count_, Dtype(1), &values[0], diff);
+    break;
+  }
+  case SolverParameter::FP16:
+  case SolverParameter::BF16: {
+    CHECK_EQ(message.size(), count_ * sizeof(uint16_t));
+    vector<Dtype> values(count_);
+    caffe_cpu_from_half(count_, reinterpret_cast<const uint16_t*>(&message[0]),
+        type_ == SolverParameter::FP16 ? FP16 : BF16, &values[0]);
+    caffe_axpy(count_, Dtype(1), &values[0], diff);
+    break;
+  }
+  case SolverParameter::TOP_K: {
+    CHECK_EQ(message.size(), top_k_ * (sizeof(uint32_t) + sizeof(Dtype)));
+    const char* indices = &message[0];
+    const char* values = indices + top_k_ * sizeof(uint32_t);
+    for (int i = 0; i < top_k_; ++i) {
+      uint32_t index;
+      Dtype value;
+      memcpy(&index, indices + i * sizeof(index), sizeof(index));
+      memcpy(&value, values + i * sizeof(value), sizeof(value));
+      CHECK_LT(index, count_);
+      diff[index] += value;
+    }
+    break;
+  }
+  case SolverParameter::ONE_BIT: {
+    const int num_blocks = (count_ + kOneBitBlockSize - 1) / kOneBitBlockSize;
+    CHECK_EQ(message.size(), num_blocks * 2 * sizeof(Dtype) + (count_ + 7) / 8);
+    const char* means = &message[0];
+    const uint8_t* bits = reinterpret_cast<const uint8_t*>(
+        means + num_blocks * 2 * sizeof(Dtype));
+    for (int b = 0; b < num_blocks; ++b) {
+      Dtype block_means[2];
+      memcpy(block_means, means + b * 2 * sizeof(Dtype), sizeof(block_means));
+      const int end = std::min(count_, (b + 1) * kOneBitBlockSize);
+      for (int i = b * kOneBitBlockSize; i < end; ++i) {
+        diff[i] += block_means[(bits[i / 8] >> (i % 8)) & 1];
+      }
+    }
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown gradient compression " << type_;
+  }
+}
+
+INSTANTIATE_CLASS(GradientCompressor);
+
+bool IsHalfCompression(SolverParameter::GradientCompression type,
+    HalfFormat* format) {
+  if (type != SolverParameter::FP16 && type != SolverParameter::BF16) {
+    return false;
+  }
+  *format = type == SolverParameter::FP16 ? FP16 : BF16;
+  return true;
+}
+
+}  // namespace caffe
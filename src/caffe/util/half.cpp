@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+// The half gemms expand the 16-bit matrix one panel of rows at a time, sized
+// to stay in the L2 cache while it is multiplied, but of at least
+// kHalfPanelMinRows rows, as each panel is multiplied by the whole other
+// matrix.
+static const int kHalfPanelBytes = 1 << 20;
+static const int kHalfPanelMinRows = 64;
+
+// Returns the number of rows of K values in a panel, out of rows.
+template <typename Dtype>
+static int HalfPanelRows(const int rows, const int K) {
+  const int panel_rows = std::max(kHalfPanelMinRows,
+      kHalfPanelBytes / static_cast<int>(std::max(K, 1) * sizeof(Dtype)));
+  return std::max(1, std::min(rows, panel_rows));
+}
+
+uint16_t float_to_fp16(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint32_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x >= 0x7f800000) {
+    // Infinity, or NaN (kept quiet).
+    return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+  }
+  if (x >= 0x477ff000) {
+    // At least 65520, which rounds past the largest fp16 value.
+    return sign | 0x7c00;
+  }
+  if (x < 0x38800000) {
+    // Below the smallest normal fp16 value: round to a multiple of 2^-24.
+    if (x < 0x33000000) {
+      return sign;
+    }
+    const uint32_t shift = 126 - (x >> 23);
+    const uint32_t mantissa = (x & 0x7fffff) | 0x800000;
+    uint32_t h = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1))) {
+      ++h;
+    }
+    return sign | h;
+  }
+  // Rebias the exponent from 127 to 15 and round the mantissa; a carry out
+  // of the mantissa correctly bumps the exponent.
+  uint32_t h = (x >> 13) - (112 << 10);
+  const uint32_t rest = x & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+    ++h;
+  }
+  return sign | h;
+}
+
+float fp16_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t x;
+  if (exponent == 0x1f) {
+    x = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent == 0) {
+    if (mantissa == 0) {
+      x = sign;
+    } else {
+      // Normalize the subnormal value.
+      exponent = 113;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  } else {
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+uint16_t float_to_bf16(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  if ((x & 0x7fffffff) > 0x7f800000) {
+    return (x >> 16) | 0x40;
+  }
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+float bf16_to_float(uint16_t h) {
+  const uint32_t x = static_cast<uint32_t>(h) << 16;
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+template <typename Dtype>
+void caffe_cpu_to_half(const int N, const Dtype* x, const HalfFormat format,
+    uint16_t* y) {
+  if (format == BF16) {
+    for (int i = 0; i < N; ++i) {
+      y[i] = float_to_bf16(static_cast<float>(x[i]));
+    }
+  } else {
+    for (int i = 0; i < N; ++i) {
+      y[i] = float_to_fp16(static_cast<float>(x[i]));
+    }
+  }
+}
+
+template void caffe_cpu_to_half<float>(const int N, const float* x,
+    const HalfFormat format, uint16_t* y);
+template void caffe_cpu_to_half<double>(const int N, const double* x,
+    const HalfFormat format, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int N, const uint16_t* x,
+    const HalfFormat format, Dtype* y) {
+  if (format == BF16) {
+    for (int i = 0; i < N; ++i) {
+      y[i] = bf16_to_float(x[i]);
+    }
+  } else {
+    for (int i = 0; i < N; ++i) {
+      y[i] = fp16_to_float(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_from_half<float>(const int N, const uint16_t* x,
+    const HalfFormat format, float* y);
+template void caffe_cpu_from_half<double>(const int N, const uint16_t* x,
+    const HalfFormat format, double* y);
+
+template <typename Dtype>
+bool caffe_cpu_round_half(const int N, const Dtype scale, const Dtype* x,
+    const HalfFormat format, Dtype* y) {
+  const Dtype inv_scale = Dtype(1) / scale;
+  bool finite = true;
+  for (int i = 0; i < N; ++i) {
+    const float scaled = static_cast<float>(scale * x[i]);
+    const float rounded = format == BF16 ?
+        bf16_to_float(float_to_bf16(scaled)) :
+        fp16_to_float(float_to_fp16(scaled));
+    // Infinity and NaN are the values with all exponent bits set.
+    uint32_t bits;
+    memcpy(&bits, &rounded, sizeof(bits));
+    finite &= (bits & 0x7f800000) != 0x7f800000;
+    y[i] = rounded * inv_scale;
+  }
+  return finite;
+}
+
+template bool caffe_cpu_round_half<float>(const int N, const float scale,
+    const float* x, const HalfFormat format, float* y);
+template bool caffe_cpu_round_half<double>(const int N, const double scale,
+    const double* x, const HalfFormat format, double* y);
+
+// gemm on row-major matrices with explicit leading dimensions, so that the
+// panels can address a slice of the output.
+static inline void gemm_ld(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+static inline void gemm_ld(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm_half_a(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype alpha, const uint16_t* A,
+    const HalfFormat format, const Dtype* B, const Dtype beta, Dtype* C) {
+  const int panel_rows = HalfPanelRows<Dtype>(M, K);
+  std::vector<Dtype> panel(panel_rows * K);
+  const int ldb = (TransB == CblasNoTrans) ? N : K;
+  for (int row = 0; row < M; row += panel_rows) {
+    const int rows = std::min(panel_rows, M - row);
+    caffe_cpu_from_half(rows * K, A + row * K, format, &panel[0]);
+    gemm_ld(CblasNoTrans, TransB, rows, N, K, alpha, &panel[0], K, B, ldb,
+        beta, C + row * N, N);
+  }
+}
+
+template void caffe_cpu_gemm_half_a<float>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const float alpha,
+    const uint16_t* A, const HalfFormat format, const float* B,
+    const float beta, float* C);
+template void caffe_cpu_gemm_half_a<double>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const double alpha,
+    const uint16_t* A, const HalfFormat format, const double* B,
+    const double beta, double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemm_half_bt(const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const uint16_t* B,
+    const HalfFormat format, const Dtype beta, Dtype* C) {
+  const int panel_rows = HalfPanelRows<Dtype>(N, K);
+  std::vector<Dtype> panel(panel_rows * K);
+  for (int col = 0; col < N; col += panel_rows) {
+    const int cols = std::min(panel_rows, N - col);
+    caffe_cpu_from_half(cols * K, B + col * K, format, &panel[0]);
+    gemm_ld(CblasNoTrans, CblasTrans, M, cols, K, alpha, A, K, &panel[0], K,
+        beta, C + col, N);
+  }
+}
+
+template void caffe_cpu_gemm_half_bt<float>(const int M, const int N,
+    const int K, const float alpha, const float* A, const uint16_t* B,
+    const HalfFormat format, const float beta, float* C);
+template void caffe_cpu_gemm_half_bt<double>(const int M, const int N,
+    const int K, const double alpha, const double* A, const uint16_t* B,
+    const HalfFormat format, const double beta, double* C);
+
+}  // namespace caffe
@@ -136,6 +136,22 @@ void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
     << "Failed to save int dataset with name " << dataset_name;
 }
 
+float hdf5_load_float(hid_t loc_id, const string& dataset_name) {
+  float val;
+  herr_t status = H5LTread_dataset_float(loc_id, dataset_name.c_str(), &val);
+  CHECK_GE(status, 0)
+    << "Failed to load float dataset with name " << dataset_name;
+  return val;
+}
+
+void hdf5_save_float(hid_t loc_id, const string& dataset_name, float f) {
+  hsize_t one = 1;
+  herr_t status = \
+    H5LTmake_dataset_float(loc_id, dataset_name.c_str(), 1, &one, &f);
+  CHECK_GE(status, 0)
+    << "Failed to save float dataset with name " << dataset_name;
+}
+
 int hdf5_get_num_links(hid_t loc_id) {
   H5G_info_t info;
   herr_t status = H5Gget_info(loc_id, &info);
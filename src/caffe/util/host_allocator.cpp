@@ -0,0 +1,300 @@
+#include <sys/mman.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <cstdlib>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Each block is preceded by its header, kHostAlignment bytes before the
+// pointer handed out, so that it keeps the alignment.
+struct BlockHeader {
+  size_t size;
+  // -1 for the blocks allocated without pooling.
+  int size_class;
+  // The NUMA node of the thread allocating the block from the system, whose
+  // pool it goes back to. Writing the header only places its own page there:
+  // the other pages go to the node of the thread first writing them, which is
+  // usually the allocating thread, filling the block it asked for.
+  int node;
+};
+
+// Enough classes for any size_t, at four per power of two.
+const int kNumSizeClasses = 256;
+// The most bytes the cache of a thread holds, beyond which freed blocks go to
+// the shared pool.
+const size_t kThreadCacheBytes = 64 << 20;
+
+// Class 0 holds up to kHostAlignment bytes. Above that, the sizes in (p, 2p]
+// for p a power of two are rounded up to a multiple of p / 4, wasting at most
+// a fifth of the block.
+int SizeClass(size_t size) {
+  if (size <= kHostAlignment) {
+    return 0;
+  }
+  size_t p = kHostAlignment;
+  int exponent = 0;
+  while (2 * p < size) {
+    p *= 2;
+    ++exponent;
+  }
+  const size_t step = p / 4;
+  return exponent * 4 + (size - p + step - 1) / step;
+}
+
+size_t ClassSize(int size_class) {
+  if (size_class == 0) {
+    return kHostAlignment;
+  }
+  const size_t p = kHostAlignment << ((size_class - 1) / 4);
+  return p + ((size_class - 1) % 4 + 1) * (p / 4);
+}
+
+class ThreadCache;
+
+struct AllocatorState {
+  AllocatorState()
+      : pooling(true), huge_pages(true), cache_limit(size_t(1) << 30),
+        bytes_in_use(0), peak_bytes_in_use(0), bytes_reserved(0),
+        bytes_cached(0),
+        pools(NumaNodeCount(), vector<vector<void*> >(kNumSizeClasses)),
+        pool_bytes(0) {}
+
+  boost::atomic<bool> pooling;
+  boost::atomic<bool> huge_pages;
+  boost::atomic<size_t> cache_limit;
+
+  boost::atomic<size_t> bytes_in_use;
+  boost::atomic<size_t> peak_bytes_in_use;
+  boost::atomic<size_t> bytes_reserved;
+  boost::atomic<size_t> bytes_cached;
+
+  // The pools shared by the threads, one per NUMA node, so that blocks are
+  // reused on the node of the thread that allocated them, where their pages
+  // usually are.
+  boost::mutex mutex;
+  vector<vector<vector<void*> > > pools;
+  size_t pool_bytes;
+
+  boost::thread_specific_ptr<ThreadCache> thread_caches;
+};
+
+// Never destroyed, as blobs may still be freed during static destruction.
+AllocatorState& State() {
+  static AllocatorState* state = new AllocatorState();
+  return *state;
+}
+
+void* SystemAllocate(size_t bytes, bool huge) {
+  void* base = NULL;
+  const int error = posix_memalign(&base,
+      huge ? kHugePageSize : kHostAlignment, bytes);
+  CHECK_EQ(error, 0) << "host allocation of size " << bytes << " failed";
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    // Only advice: without transparent huge pages, normal pages are used.
+    madvise(base, bytes, MADV_HUGEPAGE);
+  }
+#endif
+  return base;
+}
+
+void SystemFree(void* base, size_t bytes) {
+  free(base);
+  State().bytes_reserved -= bytes;
+}
+
+// Moves the block to the pool of its node, or frees it if the pools are full.
+void PoolOrFree(void* base, int size_class) {
+  AllocatorState& state = State();
+  const size_t bytes = ClassSize(size_class);
+  const int node = static_cast<BlockHeader*>(base)->node;
+  {
+    boost::mutex::scoped_lock lock(state.mutex);
+    if (state.pool_bytes + bytes <= state.cache_limit) {
+      state.pools[node][size_class].push_back(base);
+      state.pool_bytes += bytes;
+      state.bytes_cached += bytes;
+      return;
+    }
+  }
+  SystemFree(base, bytes);
+}
+
+class ThreadCache {
+ public:
+  ThreadCache() : blocks_(kNumSizeClasses), bytes_(0) {}
+  // Hands the blocks over to the shared pool when the thread exits.
+  ~ThreadCache() { Flush(true); }
+
+  void* Take(int size_class) {
+    vector<void*>& blocks = blocks_[size_class];
+    if (blocks.empty()) {
+      return NULL;
+    }
+    void* base = blocks.back();
+    blocks.pop_back();
+    bytes_ -= ClassSize(size_class);
+    State().bytes_cached -= ClassSize(size_class);
+    return base;
+  }
+
+  bool Put(void* base, int size_class) {
+    const size_t bytes = ClassSize(size_class);
+    if (bytes_ + bytes > kThreadCacheBytes) {
+      return false;
+    }
+    blocks_[size_class].push_back(base);
+    bytes_ += bytes;
+    State().bytes_cached += bytes;
+    return true;
+  }
+
+  // Empties the cache into the shared pool, or to the system.
+  void Flush(bool to_pool) {
+    for (int c = 0; c < kNumSizeClasses; ++c) {
+      for (int i = 0; i < blocks_[c].size(); ++i) {
+        State().bytes_cached -= ClassSize(c);
+        if (to_pool) {
+          PoolOrFree(blocks_[c][i], c);
+        } else {
+          SystemFree(blocks_[c][i], ClassSize(c));
+        }
+      }
+      blocks_[c].clear();
+    }
+    bytes_ = 0;
+  }
+
+ private:
+  vector<vector<void*> > blocks_;
+  size_t bytes_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadCache);
+};
+
+ThreadCache* GetThreadCache() {
+  boost::thread_specific_ptr<ThreadCache>& caches = State().thread_caches;
+  if (!caches.get()) {
+    caches.reset(new ThreadCache());
+  }
+  return caches.get();
+}
+
+void* TakeCached(int size_class) {
+  void* base = GetThreadCache()->Take(size_class);
+  if (base) {
+    return base;
+  }
+  AllocatorState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  vector<void*>& blocks = state.pools[CurrentNumaNode()][size_class];
+  if (blocks.empty()) {
+    return NULL;
+  }
+  base = blocks.back();
+  blocks.pop_back();
+  state.pool_bytes -= ClassSize(size_class);
+  state.bytes_cached -= ClassSize(size_class);
+  return base;
+}
+
+}  // namespace
+
+void* HostAllocate(size_t size) {
+  AllocatorState& state = State();
+  int size_class = -1;
+  size_t bytes = size;
+  void* base = NULL;
+  if (state.pooling) {
+    size_class = SizeClass(size);
+    bytes = ClassSize(size_class);
+    base = TakeCached(size_class);
+  }
+  BlockHeader* header;
+  if (base) {
+    header = static_cast<BlockHeader*>(base);
+  } else {
+    base = SystemAllocate(kHostAlignment + bytes,
+        state.huge_pages && bytes >= kHugePageSize);
+    state.bytes_reserved += bytes;
+    header = static_cast<BlockHeader*>(base);
+    header->node = CurrentNumaNode();
+  }
+  header->size = size;
+  header->size_class = size_class;
+  const size_t in_use = state.bytes_in_use += size;
+  size_t peak = state.peak_bytes_in_use;
+  while (in_use > peak &&
+      !state.peak_bytes_in_use.compare_exchange_weak(peak, in_use)) {}
+  return static_cast<char*>(base) + kHostAlignment;
+}
+
+void HostFree(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  AllocatorState& state = State();
+  void* base = static_cast<char*>(ptr) - kHostAlignment;
+  const BlockHeader* header = static_cast<BlockHeader*>(base);
+  const int size_class = header->size_class;
+  state.bytes_in_use -= header->size;
+  if (size_class < 0) {
+    SystemFree(base, header->size);
+  } else if (!state.pooling) {
+    SystemFree(base, ClassSize(size_class));
+  } else if (header->node != CurrentNumaNode() ||
+      !GetThreadCache()->Put(base, size_class)) {
+    // Blocks of other nodes skip the cache of the thread, which would reuse
+    // them here.
+    PoolOrFree(base, size_class);
+  }
+}
+
+HostAllocatorStats GetHostAllocatorStats() {
+  AllocatorState& state = State();
+  HostAllocatorStats stats;
+  stats.bytes_in_use = state.bytes_in_use;
+  stats.peak_bytes_in_use = state.peak_bytes_in_use;
+  stats.bytes_reserved = state.bytes_reserved;
+  stats.bytes_cached = state.bytes_cached;
+  return stats;
+}
+
+void ReleaseHostCache() {
+  GetThreadCache()->Flush(false);
+  AllocatorState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  for (int node = 0; node < state.pools.size(); ++node) {
+    for (int c = 0; c < kNumSizeClasses; ++c) {
+      vector<void*>& blocks = state.pools[node][c];
+      for (int i = 0; i < blocks.size(); ++i) {
+        state.bytes_cached -= ClassSize(c);
+        SystemFree(blocks[i], ClassSize(c));
+      }
+      blocks.clear();
+    }
+  }
+  state.pool_bytes = 0;
+}
+
+void SetHostPooling(bool pooling) {
+  State().pooling = pooling;
+}
+
+void SetHostHugePages(bool huge_pages) {
+  State().huge_pages = huge_pages;
+}
+
+void SetHostCacheLimit(size_t bytes) {
+  State().cache_limit = bytes;
+}
+
+}  // namespace caffe
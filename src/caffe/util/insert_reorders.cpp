@@ -0,0 +1,173 @@
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/insert_reorders.hpp"
+
+namespace caffe {
+
+// Whether the layer runs natively in blocked layouts, given the channel block
+// of each of its bottoms; if so, returns the channel block of its tops.
+static bool RunsBlocked(const LayerParameter& layer_param, const int block,
+    const vector<int>& bottom_blocks, int* top_block) {
+  const string& type = layer_param.type();
+  if (type == "Convolution") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    *top_block = block;
+    return conv_param.group() == 1 && conv_param.num_output() % block == 0 &&
+        layer_param.quantization_param().precision() !=
+        QuantizationParameter_Precision_INT8;
+  }
+  if (bottom_blocks.empty()) {
+    return false;
+  }
+  *top_block = bottom_blocks[0];
+  if (type == "Pooling") {
+    return layer_param.pooling_param().pool() !=
+        PoolingParameter_PoolMethod_STOCHASTIC && layer_param.top_size() == 1;
+  }
+  // Layers computing each output from the same position of their inputs work
+  // in any layout, as long as all the inputs share it.
+  if (type == "Eltwise" || type == "ReLU" || type == "Sigmoid" ||
+      type == "TanH" || type == "AbsVal" || type == "BNLL" ||
+      type == "Dropout" || type == "Exp" || type == "Log" ||
+      type == "Power" || type == "Threshold") {
+    for (int i = 1; i < bottom_blocks.size(); ++i) {
+      if (bottom_blocks[i] != bottom_blocks[0]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+void InsertReorders(const NetParameter& param, NetParameter* param_reorder) {
+  // Initialize by copying from the input NetParameter.
+  param_reorder->CopyFrom(param);
+  const int block = param.channel_block();
+  if (block <= 1) {
+    return;
+  }
+  param_reorder->clear_layer();
+  // For each blob name of the input net: its name in the output net (which
+  // differs after in-place computation on a reordered copy), its channel
+  // block, the name of its reordered NCHW copy if any, and whether it is
+  // used as a bottom blob after it was last written.
+  map<string, string> blob_name_to_current_name;
+  map<string, int> blob_name_to_block;
+  map<string, string> blob_name_to_nchw_name;
+  map<string, int> blob_name_to_reorder_count;
+  map<string, bool> blob_name_to_consumed;
+  for (int i = 0; i < param.input_size(); ++i) {
+    const string& blob_name = param.input(i);
+    blob_name_to_current_name[blob_name] = blob_name;
+    blob_name_to_block[blob_name] = 1;
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    vector<int> bottom_blocks;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      if (blob_name_to_current_name.find(blob_name) ==
+          blob_name_to_current_name.end()) {
+        LOG(FATAL) << "Unknown bottom blob '" << blob_name << "' (layer '"
+                   << layer_param.name() << "', bottom index " << j << ")";
+      }
+      bottom_blocks.push_back(blob_name_to_block[blob_name]);
+    }
+    int top_block = 1;
+    const bool blocked =
+        RunsBlocked(layer_param, block, bottom_blocks, &top_block);
+    if (!blocked) {
+      top_block = 1;
+    }
+    // Add reorders for the blocked bottoms of layers that need NCHW, before
+    // adding the layer itself.
+    vector<string> bottom_names;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      blob_name_to_consumed[blob_name] = true;
+      if (blocked || blob_name_to_block[blob_name] == 1) {
+        bottom_names.push_back(blob_name_to_current_name[blob_name]);
+        continue;
+      }
+      string& nchw_name = blob_name_to_nchw_name[blob_name];
+      if (nchw_name.empty()) {
+        nchw_name = ReorderBlobName(blob_name,
+            blob_name_to_reorder_count[blob_name]++);
+        ConfigureReorderLayer(nchw_name, blob_name_to_current_name[blob_name],
+            nchw_name, 1, param_reorder->add_layer());
+      }
+      bottom_names.push_back(nchw_name);
+    }
+    LayerParameter* new_layer_param = param_reorder->add_layer();
+    new_layer_param->CopyFrom(layer_param);
+    if (blocked && layer_param.type() == "Convolution") {
+      new_layer_param->mutable_convolution_param()->set_channel_block(block);
+    }
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      new_layer_param->set_bottom(j, bottom_names[j]);
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const string& blob_name = layer_param.top(j);
+      if (j < layer_param.bottom_size() && blob_name == layer_param.bottom(j)) {
+        // In-place computation: follow the bottom if it was renamed.
+        new_layer_param->set_top(j, bottom_names[j]);
+        blob_name_to_current_name[blob_name] = bottom_names[j];
+      } else if (top_block > 1) {
+        // Blocked blobs are renamed, so that callers looking up a blob by its
+        // name never read it in a blocked layout.
+        new_layer_param->set_top(j, BlockedBlobName(blob_name));
+        blob_name_to_current_name[blob_name] = BlockedBlobName(blob_name);
+      } else {
+        blob_name_to_current_name[blob_name] = blob_name;
+      }
+      blob_name_to_block[blob_name] = top_block;
+      blob_name_to_nchw_name[blob_name].clear();
+      blob_name_to_consumed[blob_name] = false;
+    }
+  }
+  // Reorder the outputs of the net left in a blocked layout, and the blobs
+  // requested as outputs, back to NCHW under their own names.
+  const set<string> outputs(param.output().begin(), param.output().end());
+  for (map<string, int>::const_iterator it = blob_name_to_block.begin();
+       it != blob_name_to_block.end(); ++it) {
+    const string& blob_name = it->first;
+    if (it->second == 1 ||
+        (blob_name_to_consumed[blob_name] && !outputs.count(blob_name))) {
+      continue;
+    }
+    ConfigureReorderLayer(
+        ReorderBlobName(blob_name, blob_name_to_reorder_count[blob_name]++),
+        blob_name_to_current_name[blob_name], blob_name, 1,
+        param_reorder->add_layer());
+  }
+}
+
+void ConfigureReorderLayer(const string& layer_name, const string& bottom_name,
+    const string& top_name, const int channel_block,
+    LayerParameter* reorder_layer_param) {
+  reorder_layer_param->Clear();
+  reorder_layer_param->set_name(layer_name);
+  reorder_layer_param->set_type("Reorder");
+  reorder_layer_param->add_bottom(bottom_name);
+  reorder_layer_param->add_top(top_name);
+  reorder_layer_param->mutable_reorder_param()->set_channel_block(
+      channel_block);
+}
+
+string ReorderBlobName(const string& blob_name, const int reorder_idx) {
+  ostringstream reorder_blob_name;
+  reorder_blob_name << blob_name << "_reorder_" << reorder_idx;
+  return reorder_blob_name.str();
+}
+
+string BlockedBlobName(const string& blob_name) {
+  return blob_name + "_blocked";
+}
+
+}  // namespace caffe
@@ -0,0 +1,40 @@
+#include "caffe/common.hpp"
+#include "caffe/util/layout.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_change_channel_block(const int num, const int channels,
+    const int spatial_dim, const int from_block, const int to_block,
+    const Dtype* x, Dtype* y) {
+  CHECK_EQ(channels % from_block, 0);
+  CHECK_EQ(channels % to_block, 0);
+  const int dim = channels * spatial_dim;
+  if (from_block == to_block) {
+    caffe_copy(num * dim, x, y);
+    return;
+  }
+  for (int n = 0; n < num; ++n) {
+    const Dtype* x_n = x + n * dim;
+    Dtype* y_n = y + n * dim;
+    // Walk the destination contiguously; each block of to_block channels
+    // gathers from at most a couple of source blocks.
+    for (int c = 0; c < channels; c += to_block) {
+      for (int s = 0; s < spatial_dim; ++s) {
+        for (int b = 0; b < to_block; ++b) {
+          *y_n++ = x_n[channel_block_offset(spatial_dim, from_block, c + b, s)];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_change_channel_block<float>(const int num,
+    const int channels, const int spatial_dim, const int from_block,
+    const int to_block, const float* x, float* y);
+template void caffe_cpu_change_channel_block<double>(const int num,
+    const int channels, const int spatial_dim, const int from_block,
+    const int to_block, const double* x, double* y);
+
+}  // namespace caffe
@@ -230,6 +230,25 @@ unsigned int caffe_rng_rand() {
   return (*caffe_rng())();
 }
 
+int caffe_cpu_blas_threads() {
+#if defined(USE_MKL)
+  return mkl_get_max_threads();
+#elif defined(USE_OPENBLAS)
+  return openblas_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+void caffe_set_cpu_blas_threads(const int num_threads) {
+  CHECK_GT(num_threads, 0);
+#if defined(USE_MKL)
+  mkl_set_num_threads(num_threads);
+#elif defined(USE_OPENBLAS)
+  openblas_set_num_threads(num_threads);
+#endif
+}
+
 template <typename Dtype>
 Dtype caffe_nextafter(const Dtype b) {
   return boost::math::nextafter<Dtype>(
@@ -0,0 +1,126 @@
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+namespace {
+
+struct NumaTopology {
+  vector<vector<int> > node_cpus;
+  // The node of each CPU.
+  vector<int> cpu_nodes;
+};
+
+bool ReadLine(const string& path, string* line) {
+  std::ifstream file(path.c_str());
+  return file && std::getline(file, *line);
+}
+
+NumaTopology* ReadTopology() {
+  NumaTopology* topology = new NumaTopology();
+  const string root = "/sys/devices/system/node/";
+  string online;
+  if (ReadLine(root + "online", &online)) {
+    const vector<int> nodes = ParseCpuList(online);
+    for (int i = 0; i < nodes.size(); ++i) {
+      std::ostringstream path;
+      path << root << "node" << nodes[i] << "/cpulist";
+      string cpus;
+      if (ReadLine(path.str(), &cpus)) {
+        if (topology->node_cpus.size() <= nodes[i]) {
+          topology->node_cpus.resize(nodes[i] + 1);
+        }
+        topology->node_cpus[nodes[i]] = ParseCpuList(cpus);
+      }
+    }
+  }
+  if (topology->node_cpus.empty()) {
+    topology->node_cpus.resize(1);
+    for (int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF); ++cpu) {
+      topology->node_cpus[0].push_back(cpu);
+    }
+  }
+  for (int node = 0; node < topology->node_cpus.size(); ++node) {
+    const vector<int>& cpus = topology->node_cpus[node];
+    for (int i = 0; i < cpus.size(); ++i) {
+      if (topology->cpu_nodes.size() <= cpus[i]) {
+        topology->cpu_nodes.resize(cpus[i] + 1, 0);
+      }
+      topology->cpu_nodes[cpus[i]] = node;
+    }
+  }
+  return topology;
+}
+
+const NumaTopology& Topology() {
+  static NumaTopology* topology = ReadTopology();
+  return *topology;
+}
+
+}  // namespace
+
+int NumaNodeCount() {
+  return Topology().node_cpus.size();
+}
+
+const vector<int>& NumaNodeCpus(int node) {
+  CHECK_GE(node, 0);
+  CHECK_LT(node, NumaNodeCount()) << "No NUMA node " << node;
+  return Topology().node_cpus[node];
+}
+
+int CurrentNumaNode() {
+  const vector<int>& cpu_nodes = Topology().cpu_nodes;
+  const int cpu = sched_getcpu();
+  return cpu >= 0 && cpu < cpu_nodes.size() ? cpu_nodes[cpu] : 0;
+}
+
+void BindThreadToCpus(const vector<int>& cpus) {
+  CHECK(!cpus.empty()) << "Binding a thread to no CPU";
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < cpus.size(); ++i) {
+    CHECK_LT(cpus[i], CPU_SETSIZE);
+    CPU_SET(cpus[i], &set);
+  }
+  const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  CHECK_EQ(error, 0) << "Binding the thread to its CPUs failed";
+}
+
+void BindThreadToNumaNode(int node) {
+  BindThreadToCpus(NumaNodeCpus(node));
+}
+
+vector<int> ParseCpuList(const string& list) {
+  vector<int> cpus;
+  std::istringstream stream(list);
+  string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    int first, last;
+    char dash;
+    std::istringstream range_stream(range);
+    CHECK(range_stream >> first) << "Bad CPU list " << list;
+    last = first;
+    if (range_stream >> dash) {
+      CHECK(dash == '-' && range_stream >> last) << "Bad CPU list " << list;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}  // namespace caffe
@@ -0,0 +1,62 @@
+#include <map>
+#include <set>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/plan_views.hpp"
+
+namespace caffe {
+
+// Layers whose tops share the data of their bottom.
+static bool SharesData(const string& type) {
+  return type == "Split" || type == "Flatten" || type == "Reshape";
+}
+
+// Whether none of the blobs, nor the blobs later sharing their data, is
+// written by a layer after layer_id.
+static bool NotWrittenAfter(const NetParameter& param, int layer_id,
+    set<string> blobs) {
+  for (int i = layer_id + 1; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      if (blobs.count(layer_param.top(j))) {
+        return false;
+      }
+    }
+    if (SharesData(layer_param.type()) && layer_param.bottom_size() &&
+        blobs.count(layer_param.bottom(0))) {
+      blobs.insert(layer_param.top().begin(), layer_param.top().end());
+    }
+  }
+  return true;
+}
+
+void PlanConcatSliceViews(NetParameter* param) {
+  map<string, string> producer_type;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    const string& type = layer_param->type();
+    if (type == "Concat" && layer_param->bottom_size() > 1) {
+      // Bottoms sharing their data with other blobs are left out when the
+      // layer is set up, so only the top needs checking.
+      set<string> blobs(layer_param->top().begin(), layer_param->top().end());
+      if (NotWrittenAfter(*param, i, blobs)) {
+        layer_param->mutable_concat_param()->set_view_bottoms(true);
+      }
+    } else if (type == "Slice" && layer_param->top_size() > 1 &&
+        producer_type[layer_param->bottom(0)] != "Split") {
+      // The bottom is only read by this layer, but writing to the tops would
+      // change it for the layer producing it.
+      set<string> blobs(layer_param->top().begin(), layer_param->top().end());
+      blobs.insert(layer_param->bottom(0));
+      if (NotWrittenAfter(*param, i, blobs)) {
+        layer_param->mutable_slice_param()->set_view_tops(true);
+      }
+    }
+    for (int j = 0; j < layer_param->top_size(); ++j) {
+      producer_type[layer_param->top(j)] = type;
+    }
+  }
+}
+
+}  // namespace caffe
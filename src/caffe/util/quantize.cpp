@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int N, const Dtype* x) {
+  Dtype amax = 0;
+  for (int i = 0; i < N; ++i) {
+    amax = std::max(amax, static_cast<Dtype>(std::fabs(x[i])));
+  }
+  return amax;
+}
+
+template float caffe_cpu_amax<float>(const int N, const float* x);
+template double caffe_cpu_amax<double>(const int N, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int N, const Dtype* x, const Dtype scale,
+    int8_t* y) {
+  CHECK_GT(scale, 0);
+  const Dtype inv_scale = Dtype(1) / scale;
+  for (int i = 0; i < N; ++i) {
+    // Saturate onto the symmetric grid before converting, as converting a
+    // value out of the range of int (or NaN, which the order of the
+    // comparisons maps to -kInt8Max) is undefined, then round half away from
+    // zero.
+    const Dtype v = std::min(Dtype(kInt8Max),
+        std::max(Dtype(-kInt8Max), x[i] * inv_scale));
+    y[i] = static_cast<int8_t>(v >= 0 ? v + Dtype(0.5) : v - Dtype(0.5));
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int N, const float* x,
+    const float scale, int8_t* y);
+template void caffe_cpu_quantize<double>(const int N, const double* x,
+    const double scale, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* x,
+    const bool per_row, Dtype* scales, int8_t* y) {
+  if (per_row) {
+    for (int i = 0; i < rows; ++i) {
+      const Dtype amax = caffe_cpu_amax(cols, x + i * cols);
+      scales[i] = amax > 0 ? amax / kInt8Max : Dtype(1);
+    }
+  } else {
+    const Dtype amax = caffe_cpu_amax(rows * cols, x);
+    std::fill(scales, scales + rows, amax > 0 ? amax / kInt8Max : Dtype(1));
+  }
+  for (int i = 0; i < rows; ++i) {
+    caffe_cpu_quantize(cols, x + i * cols, scales[i], y + i * cols);
+  }
+}
+
+template void caffe_cpu_quantize_rows<float>(const int rows, const int cols,
+    const float* x, const bool per_row, float* scales, int8_t* y);
+template void caffe_cpu_quantize_rows<double>(const int rows, const int cols,
+    const double* x, const bool per_row, double* scales, int8_t* y);
+
+template <typename Dtype>
+void QuantizeWeights(const Blob<Dtype>& weight, const int rows,
+    const bool per_row, const Dtype input_scale,
+    shared_ptr<QuantizedWeights<Dtype> >* quantized) {
+  if (*quantized && (*quantized)->version == weight.data_version()) {
+    return;
+  }
+  const int cols = weight.count() / rows;
+  shared_ptr<QuantizedWeights<Dtype> > result(new QuantizedWeights<Dtype>());
+  result->version = weight.data_version();
+  result->values.resize(rows * cols);
+  result->scales.resize(rows);
+  // The weights may be compacted.
+  vector<Dtype> weights(weight.count());
+  weight.ExpandData(&weights[0]);
+  caffe_cpu_quantize_rows(rows, cols, &weights[0], per_row,
+      &result->scales[0], &result->values[0]);
+  caffe_scal(rows, input_scale, &result->scales[0]);
+  *quantized = result;
+}
+
+template void QuantizeWeights<float>(const Blob<float>& weight,
+    const int rows, const bool per_row, const float input_scale,
+    shared_ptr<QuantizedWeights<float> >* quantized);
+template void QuantizeWeights<double>(const Blob<double>& weight,
+    const int rows, const bool per_row, const double input_scale,
+    shared_ptr<QuantizedWeights<double> >* quantized);
+
+template <typename Dtype>
+void caffe_cpu_dequantize(const int M, const int N, const int32_t* x,
+    const Dtype* scales, const bool scale_rows, Dtype* y) {
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < N; ++j) {
+      y[i * N + j] = x[i * N + j] * scales[scale_rows ? i : j];
+    }
+  }
+}
+
+template void caffe_cpu_dequantize<float>(const int M, const int N,
+    const int32_t* x, const float* scales, const bool scale_rows, float* y);
+template void caffe_cpu_dequantize<double>(const int M, const int N,
+    const int32_t* x, const double* scales, const bool scale_rows, double* y);
+
+// The panels of caffe_cpu_gemm_s8: kS8PanelK values of the shared dimension
+// by kS8PanelN columns of the output keep the panel of B in the L2 cache
+// while every row of A is multiplied by it.
+static const int kS8PanelK = 256;
+static const int kS8PanelN = 1024;
+
+// C_row[0..n) += sum_k A_row[k] * B_rows[k][0..n) over the kc rows of B
+// starting at B, with stride ldb. Four rows are summed at a time, so that
+// the row of C is loaded and stored once per four rows of B.
+static void gemm_s8_row(const int n, const int kc, const int8_t* A_row,
+    const int8_t* B, const int ldb, int32_t* C_row) {
+  int k = 0;
+  for (; k + 4 <= kc; k += 4) {
+    const int32_t a0 = A_row[k];
+    const int32_t a1 = A_row[k + 1];
+    const int32_t a2 = A_row[k + 2];
+    const int32_t a3 = A_row[k + 3];
+    const int8_t* b0 = B + k * ldb;
+    const int8_t* b1 = b0 + ldb;
+    const int8_t* b2 = b1 + ldb;
+    const int8_t* b3 = b2 + ldb;
+    for (int j = 0; j < n; ++j) {
+      C_row[j] += a0 * b0[j] + a1 * b1[j] + a2 * b2[j] + a3 * b3[j];
+    }
+  }
+  for (; k < kc; ++k) {
+    const int32_t a = A_row[k];
+    const int8_t* b = B + k * ldb;
+    for (int j = 0; j < n; ++j) {
+      C_row[j] += a * b[j];
+    }
+  }
+}
+
+// Returns the dot product of the kc values of a and b.
+static inline int32_t dot_s8(const int kc, const int8_t* a, const int8_t* b) {
+  int32_t sum = 0;
+  for (int k = 0; k < kc; ++k) {
+    sum += static_cast<int32_t>(a[k]) * b[k];
+  }
+  return sum;
+}
+
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransB, const int M, const int N,
+    const int K, const int8_t* A, const int8_t* B, int32_t* C) {
+  memset(C, 0, sizeof(int32_t) * M * N);
+  if (TransB == CblasNoTrans) {
+    // B is K x N: accumulate rows of B scaled by A into the rows of C, so the
+    // inner loop runs over contiguous memory in both.
+    for (int k0 = 0; k0 < K; k0 += kS8PanelK) {
+      const int kc = std::min(kS8PanelK, K - k0);
+      for (int j0 = 0; j0 < N; j0 += kS8PanelN) {
+        const int nc = std::min(kS8PanelN, N - j0);
+        for (int i = 0; i < M; ++i) {
+          gemm_s8_row(nc, kc, A + i * K + k0, B + k0 * N + j0, N,
+              C + i * N + j0);
+        }
+      }
+    }
+  } else {
+    // B is N x K: every output is a dot product of two contiguous rows. The
+    // k-panels of four rows of B are reused for all the rows of A.
+    for (int k0 = 0; k0 < K; k0 += kS8PanelK) {
+      const int kc = std::min(kS8PanelK, K - k0);
+      int j = 0;
+      for (; j + 4 <= N; j += 4) {
+        const int8_t* b0 = B + j * K + k0;
+        const int8_t* b1 = b0 + K;
+        const int8_t* b2 = b1 + K;
+        const int8_t* b3 = b2 + K;
+        for (int i = 0; i < M; ++i) {
+          const int8_t* a = A + i * K + k0;
+          int32_t* c = C + i * N + j;
+          int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+          for (int k = 0; k < kc; ++k) {
+            const int32_t v = a[k];
+            s0 += v * b0[k];
+            s1 += v * b1[k];
+            s2 += v * b2[k];
+            s3 += v * b3[k];
+          }
+          c[0] += s0;
+          c[1] += s1;
+          c[2] += s2;
+          c[3] += s3;
+        }
+      }
+      for (; j < N; ++j) {
+        for (int i = 0; i < M; ++i) {
+          C[i * N + j] += dot_s8(kc, A + i * K + k0, B + j * K + k0);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace caffe
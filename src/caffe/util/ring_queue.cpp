@@ -0,0 +1,260 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <cstddef>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/data_layers.hpp"
+#include "caffe/util/ring_queue.hpp"
+
+namespace caffe {
+
+// The attempts of a thread finding the queue empty or full before it sleeps.
+// With a single CPU, the thread it waits for cannot run meanwhile.
+static int SpinCount() {
+  static const int spin_count =
+      boost::thread::hardware_concurrency() > 1 ? 1000 : 0;
+  return spin_count;
+}
+static const int kCacheLineSize = 64;
+
+// The bounded queue of D. Vyukov: the sequence number of a cell tells whether
+// it can be written, when equal to the position of the push, or read, when one
+// past the position of the pop. Pushing and popping are a compare-and-swap on
+// their position, followed by the release of the cell.
+// With a single producer and a single consumer, each position is only changed
+// by one thread, and releasing it publishes the cell, as in a Lamport queue.
+template<typename T>
+class RingQueue<T>::sync {
+ public:
+  sync(size_t capacity, bool single)
+      : single_(single), push_pos_(0), pop_pos_(0) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mask_ = size - 1;
+    cells_ = new Cell[size];
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, boost::memory_order_relaxed);
+    }
+  }
+  ~sync() { delete[] cells_; }
+
+  bool try_push(const T& t) {
+    size_t pos = push_pos_.load(boost::memory_order_relaxed);
+    if (single_) {
+      if (pos - pop_pos_.load(boost::memory_order_acquire) > mask_) {
+        return false;
+      }
+      cells_[pos & mask_].value = t;
+      push_pos_.store(pos + 1, boost::memory_order_release);
+      return true;
+    }
+    for (;;) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t sequence = cell.sequence.load(boost::memory_order_acquire);
+      const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence - pos);
+      if (diff == 0) {
+        if (push_pos_.compare_exchange_weak(pos, pos + 1,
+            boost::memory_order_relaxed)) {
+          cell.value = t;
+          cell.sequence.store(pos + 1, boost::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = push_pos_.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T* t, bool remove) {
+    size_t pos = pop_pos_.load(boost::memory_order_relaxed);
+    if (single_) {
+      if (push_pos_.load(boost::memory_order_acquire) == pos) {
+        return false;
+      }
+      *t = cells_[pos & mask_].value;
+      if (remove) {
+        pop_pos_.store(pos + 1, boost::memory_order_release);
+      }
+      return true;
+    }
+    for (;;) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t sequence = cell.sequence.load(boost::memory_order_acquire);
+      const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence - (pos + 1));
+      if (diff == 0) {
+        if (!remove) {
+          *t = cell.value;
+          return true;
+        }
+        if (pop_pos_.compare_exchange_weak(pos, pos + 1,
+            boost::memory_order_relaxed)) {
+          *t = cell.value;
+          cell.sequence.store(pos + mask_ + 1, boost::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = pop_pos_.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+
+  // The threads sleeping until the queue is not empty, or not full.
+  struct Sleepers {
+    Sleepers() : count(0) {}
+    boost::atomic<int> count;
+    boost::condition_variable condition;
+  };
+
+  // Wakes a sleeping thread after a push (for not_empty_) or a pop (for
+  // not_full_). The fences order the change of the queue before the count of
+  // sleepers here, and the count before the check of the queue in a sleeping
+  // thread, so that either this sees the sleeper or the sleeper sees the
+  // change.
+  void wake(Sleepers* sleepers) {
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (sleepers->count.load(boost::memory_order_relaxed) > 0) {
+      // Taking the lock waits for a sleeper checking the queue to sleep.
+      { boost::mutex::scoped_lock lock(mutex_); }
+      sleepers->condition.notify_one();
+    }
+  }
+
+  // Counts the thread among sleepers while it lives.
+  class Sleeper {
+   public:
+    explicit Sleeper(Sleepers* sleepers) : sleepers_(sleepers) {
+      ++sleepers_->count;
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    }
+    ~Sleeper() { --sleepers_->count; }
+
+   private:
+    Sleepers* sleepers_;
+  };
+
+  struct Cell {
+    boost::atomic<size_t> sequence;
+    T value;
+  };
+
+  const bool single_;
+  Cell* cells_;
+  size_t mask_;
+  // Pads the positions to their own cache lines, as producers and consumers
+  // update them independently.
+  char pad0_[kCacheLineSize];
+  boost::atomic<size_t> push_pos_;
+  char pad1_[kCacheLineSize];
+  boost::atomic<size_t> pop_pos_;
+  char pad2_[kCacheLineSize];
+  boost::mutex mutex_;
+  Sleepers not_empty_;
+  Sleepers not_full_;
+};
+
+template<typename T>
+RingQueue<T>::RingQueue(size_t capacity, bool single_producer_consumer)
+    : sync_(new sync(capacity, single_producer_consumer)) {
+}
+
+template<typename T>
+void RingQueue<T>::push(const T& t) {
+  for (int i = 0; i < SpinCount(); ++i) {
+    if (try_push(t)) {
+      return;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  typename sync::Sleeper sleeper(&sync_->not_full_);
+  while (!sync_->try_push(t)) {
+    sync_->not_full_.condition.wait(lock);
+  }
+  lock.unlock();
+  sync_->wake(&sync_->not_empty_);
+}
+
+template<typename T>
+bool RingQueue<T>::try_push(const T& t) {
+  if (!sync_->try_push(t)) {
+    return false;
+  }
+  sync_->wake(&sync_->not_empty_);
+  return true;
+}
+
+template<typename T>
+bool RingQueue<T>::try_pop(T* t) {
+  if (!sync_->try_pop(t, true)) {
+    return false;
+  }
+  sync_->wake(&sync_->not_full_);
+  return true;
+}
+
+template<typename T>
+T RingQueue<T>::pop(const string& log_on_wait) {
+  T t;
+  for (int i = 0; i < SpinCount(); ++i) {
+    if (try_pop(&t)) {
+      return t;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  typename sync::Sleeper sleeper(&sync_->not_empty_);
+  while (!sync_->try_pop(&t, true)) {
+    if (!log_on_wait.empty()) {
+      LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+    }
+    sync_->not_empty_.condition.wait(lock);
+  }
+  lock.unlock();
+  sync_->wake(&sync_->not_full_);
+  return t;
+}
+
+template<typename T>
+bool RingQueue<T>::try_peek(T* t) {
+  return sync_->try_pop(t, false);
+}
+
+template<typename T>
+T RingQueue<T>::peek() {
+  T t;
+  for (int i = 0; i < SpinCount(); ++i) {
+    if (sync_->try_pop(&t, false)) {
+      return t;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  typename sync::Sleeper sleeper(&sync_->not_empty_);
+  while (!sync_->try_pop(&t, false)) {
+    sync_->not_empty_.condition.wait(lock);
+  }
+  return t;
+}
+
+template<typename T>
+size_t RingQueue<T>::size() const {
+  const size_t pop_pos = sync_->pop_pos_.load(boost::memory_order_acquire);
+  const size_t push_pos = sync_->push_pos_.load(boost::memory_order_acquire);
+  return push_pos > pop_pos ? push_pos - pop_pos : 0;
+}
+
+template<typename T>
+size_t RingQueue<T>::capacity() const {
+  return sync_->mask_ + 1;
+}
+
+template class RingQueue<Batch<float>*>;
+template class RingQueue<Batch<double>*>;
+template class RingQueue<Datum*>;
+template class RingQueue<int>;
+
+}  // namespace caffe
@@ -0,0 +1,118 @@
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+double caffe_cpu_sparsity(const int N, const Dtype* x) {
+  if (N == 0) {
+    return 0;
+  }
+  int zeros = 0;
+  for (int i = 0; i < N; ++i) {
+    zeros += x[i] == 0;
+  }
+  return static_cast<double>(zeros) / N;
+}
+
+template double caffe_cpu_sparsity<float>(const int N, const float* x);
+template double caffe_cpu_sparsity<double>(const int N, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_dense_to_csr(const int rows, const int cols, const Dtype* x,
+    SparseMatrix<Dtype>* y) {
+  y->rows = rows;
+  y->cols = cols;
+  y->row_ptr.resize(rows + 1);
+  y->col_idx.clear();
+  y->values.clear();
+  y->row_ptr[0] = 0;
+  for (int i = 0; i < rows; ++i) {
+    const Dtype* x_row = x + i * cols;
+    for (int j = 0; j < cols; ++j) {
+      if (x_row[j] != 0) {
+        y->col_idx.push_back(j);
+        y->values.push_back(x_row[j]);
+      }
+    }
+    y->row_ptr[i + 1] = y->values.size();
+  }
+}
+
+template void caffe_cpu_dense_to_csr<float>(const int rows, const int cols,
+    const float* x, SparseMatrix<float>* y);
+template void caffe_cpu_dense_to_csr<double>(const int rows, const int cols,
+    const double* x, SparseMatrix<double>* y);
+
+template <typename Dtype>
+void caffe_cpu_csr_to_dense(const SparseMatrix<Dtype>& x, Dtype* y) {
+  caffe_set(x.rows * x.cols, Dtype(0), y);
+  for (int i = 0; i < x.rows; ++i) {
+    for (int k = x.row_ptr[i]; k < x.row_ptr[i + 1]; ++k) {
+      y[i * x.cols + x.col_idx[k]] = x.values[k];
+    }
+  }
+}
+
+template void caffe_cpu_csr_to_dense<float>(const SparseMatrix<float>& x,
+    float* y);
+template void caffe_cpu_csr_to_dense<double>(const SparseMatrix<double>& x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_csrmm(const int row_begin, const int M, const int N,
+    const Dtype alpha, const SparseMatrix<Dtype>& A, const Dtype* B,
+    const Dtype beta, Dtype* C) {
+  CHECK_LE(row_begin + M, A.rows);
+  for (int i = 0; i < M; ++i) {
+    Dtype* C_row = C + i * N;
+    if (beta == 0) {
+      caffe_set(N, Dtype(0), C_row);
+    } else if (beta != 1) {
+      caffe_scal(N, beta, C_row);
+    }
+    // Each nonzero scales a contiguous row of B into the row of C.
+    const int row = row_begin + i;
+    for (int k = A.row_ptr[row]; k < A.row_ptr[row + 1]; ++k) {
+      const Dtype a = alpha * A.values[k];
+      const Dtype* B_row = B + A.col_idx[k] * N;
+      for (int j = 0; j < N; ++j) {
+        C_row[j] += a * B_row[j];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_csrmm<float>(const int row_begin, const int M,
+    const int N, const float alpha, const SparseMatrix<float>& A,
+    const float* B, const float beta, float* C);
+template void caffe_cpu_csrmm<double>(const int row_begin, const int M,
+    const int N, const double alpha, const SparseMatrix<double>& A,
+    const double* B, const double beta, double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemm_csr_bt(const int M, const Dtype alpha, const Dtype* A,
+    const SparseMatrix<Dtype>& B, const Dtype beta, Dtype* C) {
+  const int N = B.rows;
+  const int K = B.cols;
+  for (int i = 0; i < M; ++i) {
+    const Dtype* A_row = A + i * K;
+    Dtype* C_row = C + i * N;
+    for (int j = 0; j < N; ++j) {
+      // Sparse dot product of row j of B with row i of A.
+      Dtype sum = 0;
+      for (int k = B.row_ptr[j]; k < B.row_ptr[j + 1]; ++k) {
+        sum += B.values[k] * A_row[B.col_idx[k]];
+      }
+      C_row[j] = alpha * sum + (beta == 0 ? Dtype(0) : beta * C_row[j]);
+    }
+  }
+}
+
+template void caffe_cpu_gemm_csr_bt<float>(const int M, const float alpha,
+    const float* A, const SparseMatrix<float>& B, const float beta, float* C);
+template void caffe_cpu_gemm_csr_bt<double>(const int M, const double alpha,
+    const double* A, const SparseMatrix<double>& B, const double beta,
+    double* C);
+
+}  // namespace caffe
@@ -0,0 +1,415 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/transport.hpp"
+
+namespace caffe {
+
+// How long to keep trying to connect to a peer that is not listening yet.
+static const int kConnectTimeoutSeconds = 300;
+// Values per message of caffe_ring_broadcast, so that forwarding one piece
+// overlaps receiving the next.
+static const int kBroadcastPieceSize = 1 << 18;
+
+// Fills addr with the address of rank in uri, returning its length.
+static socklen_t ParseAddress(const string& uri, const int rank,
+    const int size, sockaddr_storage* addr) {
+  const size_t scheme_end = uri.find("://");
+  CHECK(scheme_end != string::npos) << "Invalid transport uri " << uri;
+  const string scheme = uri.substr(0, scheme_end);
+  const string rest = uri.substr(scheme_end + 3);
+  memset(addr, 0, sizeof(*addr));
+  if (scheme == "unix") {
+    std::ostringstream path;
+    path << rest << "." << rank;
+    sockaddr_un* addr_un = reinterpret_cast<sockaddr_un*>(addr);
+    CHECK_LT(path.str().size(), sizeof(addr_un->sun_path))
+        << "Socket path too long: " << path.str();
+    addr_un->sun_family = AF_UNIX;
+    strncpy(addr_un->sun_path, path.str().c_str(),
+        sizeof(addr_un->sun_path) - 1);
+    return sizeof(sockaddr_un);
+  }
+  CHECK_EQ(scheme, "tcp") << "Unknown transport " << scheme;
+  vector<string> hosts;
+  std::istringstream stream(rest);
+  string host;
+  while (std::getline(stream, host, ',')) {
+    hosts.push_back(host);
+  }
+  CHECK_EQ(hosts.size(), size) << "Need one address per rank in " << uri;
+  const size_t port_begin = hosts[rank].rfind(':');
+  CHECK(port_begin != string::npos) << "No port in " << hosts[rank];
+  const string name = hosts[rank].substr(0, port_begin);
+  const string port = hosts[rank].substr(port_begin + 1);
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result;
+  const int error = getaddrinfo(name.c_str(), port.c_str(), &hints, &result);
+  CHECK_EQ(error, 0) << "Cannot resolve " << hosts[rank] << ": "
+      << gai_strerror(error);
+  const socklen_t length = result->ai_addrlen;
+  memcpy(addr, result->ai_addr, length);
+  freeaddrinfo(result);
+  return length;
+}
+
+static void SetNoDelay(const int fd, const sockaddr_storage& addr) {
+  if (addr.ss_family == AF_INET) {
+    const int one = 1;
+    CHECK_EQ(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)), 0);
+  }
+}
+
+SocketTransport::SocketTransport(const string& uri, int rank, int size)
+    : Transport(rank, size),
+      sockets_(size, -1),
+      poll_start_(0) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, size);
+  sockaddr_storage addr;
+  socklen_t length = ParseAddress(uri, rank, size, &addr);
+  // Listen first so that peers of higher rank can connect while this one
+  // connects to the lower ones.
+  const int listener = socket(addr.ss_family, SOCK_STREAM, 0);
+  CHECK_GE(listener, 0) << strerror(errno);
+  if (addr.ss_family == AF_UNIX) {
+    unlink(reinterpret_cast<sockaddr_un*>(&addr)->sun_path);
+  } else {
+    const int one = 1;
+    CHECK_EQ(setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one,
+        sizeof(one)), 0);
+  }
+  CHECK_EQ(bind(listener, reinterpret_cast<sockaddr*>(&addr), length), 0)
+      << "Cannot listen on " << uri << " as rank " << rank << ": "
+      << strerror(errno);
+  CHECK_EQ(listen(listener, size), 0) << strerror(errno);
+  for (int peer = 0; peer < rank; ++peer) {
+    sockaddr_storage peer_addr;
+    const socklen_t peer_length = ParseAddress(uri, peer, size, &peer_addr);
+    int fd = -1;
+    for (int attempt = 0; fd < 0; ++attempt) {
+      fd = socket(peer_addr.ss_family, SOCK_STREAM, 0);
+      CHECK_GE(fd, 0) << strerror(errno);
+      if (connect(fd, reinterpret_cast<sockaddr*>(&peer_addr),
+          peer_length) != 0) {
+        CHECK_LT(attempt, kConnectTimeoutSeconds * 10)
+            << "Cannot connect to rank " << peer << ": " << strerror(errno);
+        close(fd);
+        fd = -1;
+        usleep(100000);
+      }
+    }
+    SetNoDelay(fd, peer_addr);
+    sockets_[peer] = fd;
+    Send(peer, &rank_, sizeof(rank_));
+  }
+  for (int i = rank + 1; i < size; ++i) {
+    const int fd = accept(listener, NULL, NULL);
+    CHECK_GE(fd, 0) << strerror(errno);
+    SetNoDelay(fd, addr);
+    // The peer first sends its rank.
+    int peer;
+    size_t received = 0;
+    while (received < sizeof(peer)) {
+      const ssize_t n = recv(fd, reinterpret_cast<char*>(&peer) + received,
+          sizeof(peer) - received, 0);
+      CHECK_GT(n, 0) << "Cannot receive from a new peer: " << strerror(errno);
+      received += n;
+    }
+    CHECK_GT(peer, rank);
+    CHECK_LT(peer, size);
+    CHECK_EQ(sockets_[peer], -1) << "Rank " << peer << " connected twice";
+    sockets_[peer] = fd;
+  }
+  close(listener);
+  if (addr.ss_family == AF_UNIX) {
+    unlink(reinterpret_cast<sockaddr_un*>(&addr)->sun_path);
+  }
+}
+
+SocketTransport::~SocketTransport() {
+  for (int i = 0; i < sockets_.size(); ++i) {
+    if (sockets_[i] >= 0) {
+      close(sockets_[i]);
+    }
+  }
+}
+
+void SocketTransport::SendRecv(int send_peer, const void* send_data,
+    size_t send_size, int recv_peer, void* recv_data, size_t recv_size) {
+  const char* send_ptr = reinterpret_cast<const char*>(send_data);
+  char* recv_ptr = reinterpret_cast<char*>(recv_data);
+  size_t sent = send_peer < 0 ? send_size : 0;
+  size_t received = recv_peer < 0 ? recv_size : 0;
+  while (sent < send_size || received < recv_size) {
+    pollfd fds[2];
+    int num_fds = 0;
+    if (sent < send_size) {
+      fds[num_fds].fd = sockets_[send_peer];
+      fds[num_fds].events = POLLOUT;
+      ++num_fds;
+    }
+    if (received < recv_size) {
+      fds[num_fds].fd = sockets_[recv_peer];
+      fds[num_fds].events = POLLIN;
+      ++num_fds;
+    }
+    const int ready = poll(fds, num_fds, timeout_ > 0 ? timeout_ * 1000 : -1);
+    if (ready < 0) {
+      CHECK_EQ(errno, EINTR) << strerror(errno);
+      continue;
+    }
+    CHECK_GT(ready, 0) << "Timed out after " << timeout_ << " s "
+        << (sent < send_size ? "sending to" : "receiving from") << " rank "
+        << (sent < send_size ? send_peer : recv_peer);
+    for (int i = 0; i < num_fds; ++i) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      if (fds[i].events == POLLOUT) {
+        const ssize_t n = send(fds[i].fd, send_ptr + sent, send_size - sent,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+          sent += n;
+        } else {
+          CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+              << "Cannot send to rank " << send_peer << ": "
+              << strerror(errno);
+        }
+      } else {
+        const ssize_t n = recv(fds[i].fd, recv_ptr + received,
+            recv_size - received, MSG_DONTWAIT);
+        CHECK_NE(n, 0) << "Rank " << recv_peer << " closed the connection, "
+            << "it stopped or failed";
+        if (n > 0) {
+          received += n;
+        } else {
+          CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+              << "Cannot receive from rank " << recv_peer << ": "
+              << strerror(errno);
+        }
+      }
+    }
+  }
+}
+
+int SocketTransport::Poll(const vector<int>& peers) {
+  CHECK_GT(peers.size(), 0);
+  vector<pollfd> fds(peers.size());
+  for (int i = 0; i < peers.size(); ++i) {
+    fds[i].fd = sockets_[peers[i]];
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+  }
+  int ready;
+  while ((ready = poll(&fds[0], fds.size(),
+      timeout_ > 0 ? timeout_ * 1000 : -1)) < 0) {
+    CHECK_EQ(errno, EINTR) << strerror(errno);
+  }
+  CHECK_GT(ready, 0) << "Timed out after " << timeout_
+      << " s waiting for a peer";
+  for (int i = 0; i < fds.size(); ++i) {
+    const int j = (poll_start_ + i) % fds.size();
+    if (fds[j].revents) {
+      poll_start_ = j + 1;
+      return peers[j];
+    }
+  }
+  LOG(FATAL) << "poll returned without ready peers";
+  return -1;
+}
+
+void SocketTransport::Abort() {
+  // Shutting the sockets down, unlike closing them, also wakes up threads of
+  // this process blocked on them.
+  for (int i = 0; i < sockets_.size(); ++i) {
+    if (sockets_[i] >= 0) {
+      shutdown(sockets_[i], SHUT_RDWR);
+    }
+  }
+}
+
+Transport* GetTransport(const string& uri, int rank, int size) {
+  if (uri.compare(0, 6, "tcp://") == 0 || uri.compare(0, 7, "unix://") == 0) {
+    return new SocketTransport(uri, rank, size);
+  } else {
+    LOG(FATAL) << "Unknown transport " << uri;
+  }
+  return NULL;
+}
+
+// Splits count values into one chunk per process, chunk c being
+// [offsets[c], offsets[c + 1]). Returns the size of the largest chunk, at
+// least 1.
+static int RingChunks(const int count, const int size, vector<int>* offsets) {
+  offsets->resize(size + 1);
+  int max_chunk = 1;
+  for (int c = 0; c <= size; ++c) {
+    (*offsets)[c] = static_cast<int>(static_cast<int64_t>(count) * c / size);
+    if (c > 0) {
+      max_chunk = std::max(max_chunk, (*offsets)[c] - (*offsets)[c - 1]);
+    }
+  }
+  return max_chunk;
+}
+
+template <typename Dtype>
+void caffe_ring_allreduce(Transport* transport, const int count, Dtype* data) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  if (size == 1) {
+    return;
+  }
+  const int next = (rank + 1) % size;
+  const int prev = (rank + size - 1) % size;
+  vector<int> offsets;
+  vector<Dtype> buffer(RingChunks(count, size, &offsets));
+  // Reduce-scatter: at step s, add the partial sum of a chunk over s + 1
+  // processes, coming from the previous one, to the local values, and pass
+  // on the result. Each process ends up with the full sum of chunk rank + 1.
+  for (int s = 0; s < size - 1; ++s) {
+    const int send_chunk = (rank - s + size) % size;
+    const int recv_chunk = (rank - s - 1 + size) % size;
+    const int recv_count = offsets[recv_chunk + 1] - offsets[recv_chunk];
+    transport->SendRecv(next, data + offsets[send_chunk],
+        (offsets[send_chunk + 1] - offsets[send_chunk]) * sizeof(Dtype),
+        prev, &buffer[0], recv_count * sizeof(Dtype));
+    caffe_axpy(recv_count, Dtype(1), &buffer[0], data + offsets[recv_chunk]);
+  }
+  // All-gather: pass the summed chunks around the ring.
+  for (int s = 0; s < size - 1; ++s) {
+    const int send_chunk = (rank + 1 - s + size) % size;
+    const int recv_chunk = (rank - s + size) % size;
+    transport->SendRecv(next, data + offsets[send_chunk],
+        (offsets[send_chunk + 1] - offsets[send_chunk]) * sizeof(Dtype),
+        prev, data + offsets[recv_chunk],
+        (offsets[recv_chunk + 1] - offsets[recv_chunk]) * sizeof(Dtype));
+  }
+}
+
+template void caffe_ring_allreduce<float>(Transport* transport,
+    const int count, float* data);
+template void caffe_ring_allreduce<double>(Transport* transport,
+    const int count, double* data);
+
+template <typename Dtype>
+void caffe_ring_allreduce_half(Transport* transport, const int count,
+    const HalfFormat format, Dtype* data) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  if (size == 1) {
+    return;
+  }
+  const int next = (rank + 1) % size;
+  const int prev = (rank + size - 1) % size;
+  vector<int> offsets;
+  vector<Dtype> buffer(RingChunks(count, size, &offsets));
+  // The encoded chunks, at the offsets of their values in data.
+  vector<uint16_t> encoded(std::max(count, 1));
+  uint16_t* half = &encoded[0];
+  // Reduce-scatter, as in caffe_ring_allreduce, re-encoding the partial sum
+  // of a chunk before passing it on.
+  for (int s = 0; s < size - 1; ++s) {
+    const int send_chunk = (rank - s + size) % size;
+    const int recv_chunk = (rank - s - 1 + size) % size;
+    const int send_count = offsets[send_chunk + 1] - offsets[send_chunk];
+    const int recv_count = offsets[recv_chunk + 1] - offsets[recv_chunk];
+    caffe_cpu_to_half(send_count, data + offsets[send_chunk], format,
+        half + offsets[send_chunk]);
+    transport->SendRecv(next, half + offsets[send_chunk],
+        send_count * sizeof(uint16_t), prev, half + offsets[recv_chunk],
+        recv_count * sizeof(uint16_t));
+    caffe_cpu_from_half(recv_count, half + offsets[recv_chunk], format,
+        &buffer[0]);
+    caffe_axpy(recv_count, Dtype(1), &buffer[0], data + offsets[recv_chunk]);
+  }
+  // Round the summed chunk as the other processes will receive it.
+  const int own_chunk = (rank + 1) % size;
+  const int own_count = offsets[own_chunk + 1] - offsets[own_chunk];
+  caffe_cpu_to_half(own_count, data + offsets[own_chunk], format,
+      half + offsets[own_chunk]);
+  caffe_cpu_from_half(own_count, half + offsets[own_chunk], format,
+      data + offsets[own_chunk]);
+  // All-gather the encoded sums.
+  for (int s = 0; s < size - 1; ++s) {
+    const int send_chunk = (rank + 1 - s + size) % size;
+    const int recv_chunk = (rank - s + size) % size;
+    const int recv_count = offsets[recv_chunk + 1] - offsets[recv_chunk];
+    transport->SendRecv(next, half + offsets[send_chunk],
+        (offsets[send_chunk + 1] - offsets[send_chunk]) * sizeof(uint16_t),
+        prev, half + offsets[recv_chunk], recv_count * sizeof(uint16_t));
+    caffe_cpu_from_half(recv_count, half + offsets[recv_chunk], format,
+        data + offsets[recv_chunk]);
+  }
+}
+
+template void caffe_ring_allreduce_half<float>(Transport* transport,
+    const int count, const HalfFormat format, float* data);
+template void caffe_ring_allreduce_half<double>(Transport* transport,
+    const int count, const HalfFormat format, double* data);
+
+void caffe_ring_allgather(Transport* transport, const vector<char>& message,
+    vector<vector<char> >* messages) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  const int next = (rank + 1) % size;
+  const int prev = (rank + size - 1) % size;
+  messages->assign(size, vector<char>());
+  (*messages)[rank] = message;
+  // At step s, pass on the message of rank - s, received at the previous
+  // step.
+  for (int s = 0; s < size - 1; ++s) {
+    const vector<char>& send = (*messages)[(rank - s + size) % size];
+    vector<char>& recv = (*messages)[(rank - s - 1 + size) % size];
+    uint64_t send_size = send.size();
+    uint64_t recv_size;
+    transport->SendRecv(next, &send_size, sizeof(send_size), prev, &recv_size,
+        sizeof(recv_size));
+    recv.resize(recv_size);
+    transport->SendRecv(next, send.empty() ? NULL : &send[0], send.size(),
+        prev, recv.empty() ? NULL : &recv[0], recv.size());
+  }
+}
+
+template <typename Dtype>
+void caffe_ring_broadcast(Transport* transport, const int count,
+    Dtype* data) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  for (int offset = 0; offset < count; offset += kBroadcastPieceSize) {
+    const size_t bytes =
+        std::min(kBroadcastPieceSize, count - offset) * sizeof(Dtype);
+    if (rank > 0) {
+      transport->Recv(rank - 1, data + offset, bytes);
+    }
+    if (rank < size - 1) {
+      transport->Send(rank + 1, data + offset, bytes);
+    }
+  }
+}
+
+template void caffe_ring_broadcast<float>(Transport* transport,
+    const int count, float* data);
+template void caffe_ring_broadcast<double>(Transport* transport,
+    const int count, double* data);
+
+}  // namespace caffe
@@ -5,14 +5,24 @@ namespace bp = boost::python;
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#ifdef WITH_PYTHON_LAYER
+#include "caffe/python_layer.hpp"
+#endif
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/numa.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/upgrade_proto.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -46,6 +56,45 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(dist_uri, "",
+    "Optional; train with several processes, connected through the given "
+    "transport: tcp://host0:port0,host1:port1,... (one address per rank) or "
+    "unix:///path/prefix (processes on this machine).");
+DEFINE_int32(dist_rank, 0,
+    "Optional; the rank of this process when training with dist_uri.");
+DEFINE_int32(dist_size, 1,
+    "Optional; the number of processes training with dist_uri. The "
+    "effective training batch size is multiplied by it.");
+DEFINE_int32(dist_timeout, 1800,
+    "Optional; with dist_uri, fail when a peer sends nothing for this many "
+    "seconds (0 waits forever). It must exceed the time the first process "
+    "spends testing and snapshotting, which the others wait for.");
+DEFINE_string(numa_node, "",
+    "Optional; the NUMA node to run on, binding the threads to its CPUs so "
+    "that the memory is allocated on it too. Use 'auto' for node dist_rank "
+    "modulo the number of nodes, e.g. to train with one process per socket "
+    "with dist_uri=unix://..., reducing the gradients across sockets only "
+    "once per iteration.");
+DEFINE_int32(ps_servers, 0,
+    "Optional; with dist_uri, train asynchronously with this many "
+    "parameter servers, the processes of lowest rank, instead of "
+    "synchronously.");
+DEFINE_int32(ps_staleness, 0,
+    "Optional; the number of iterations a worker may get ahead of the "
+    "slowest one when training with parameter servers.");
+DEFINE_string(output, "",
+    "The destination of the model definition written by quantize.");
+DEFINE_bool(quantize_per_channel, true,
+    "Optional; quantize the weights with one scale per output channel "
+    "instead of one per layer.");
+DEFINE_int32(check_iterations, 0,
+    "Optional; the number of iterations to compare the quantized model "
+    "against the original one for.");
+DEFINE_bool(host_pool, true,
+    "Optional; whether to cache freed host memory for reuse. Without it, "
+    "blobs are allocated from the system as with malloc.");
+DEFINE_bool(huge_pages, true,
+    "Optional; whether to back large host allocations by huge pages.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -188,12 +237,48 @@ int train() {
     Caffe::set_solver_count(gpus.size());
   }
 
+  shared_ptr<caffe::Transport> transport;
+  const caffe::SolverParameter ps_param = solver_param;
+  const bool ps_worker = FLAGS_ps_servers > 0 &&
+      FLAGS_dist_rank >= FLAGS_ps_servers;
+  if (FLAGS_dist_uri.size()) {
+    CHECK_LE(gpus.size(), 1) << "Use one process per GPU with dist_uri.";
+    CHECK(!FLAGS_snapshot.size() || FLAGS_ps_servers == 0)
+        << "Only the weights are saved with parameter servers; resume from "
+        << "them with -weights.";
+    if (FLAGS_ps_servers > 0) {
+      // Workers read disjoint shards of the data, servers none.
+      Caffe::set_process_group(std::max(FLAGS_dist_rank - FLAGS_ps_servers, 0),
+          FLAGS_dist_size - FLAGS_ps_servers);
+    } else {
+      Caffe::set_process_group(FLAGS_dist_rank, FLAGS_dist_size);
+    }
+    if (FLAGS_dist_rank != FLAGS_ps_servers) {
+      // Rank 0, or the first worker, tests and snapshots for the group.
+      solver_param.set_test_interval(0);
+      solver_param.set_test_initialization(false);
+      solver_param.set_snapshot(0);
+      solver_param.set_snapshot_after_train(false);
+    }
+    if (ps_worker) {
+      // ParamServerSync saves the weights, the servers hold the rest of the
+      // state.
+      solver_param.set_snapshot(0);
+      solver_param.set_snapshot_after_train(false);
+    }
+    LOG(INFO) << "Connecting to " << FLAGS_dist_size << " processes";
+    transport.reset(caffe::GetTransport(FLAGS_dist_uri, FLAGS_dist_rank,
+        FLAGS_dist_size));
+    transport->set_timeout(FLAGS_dist_timeout);
+  }
+
   caffe::SignalHandler signal_handler(
         GetRequestedAction(FLAGS_sigint_effect),
         GetRequestedAction(FLAGS_sighup_effect));
 
   shared_ptr<caffe::Solver<float> >
-    solver(caffe::GetSolver<float>(solver_param));
+    solver(ps_worker ? new caffe::WorkerSolver<float>(solver_param) :
+        caffe::GetSolver<float>(solver_param));
 
   solver->SetActionFunction(signal_handler.GetActionFunction());
 
@@ -204,7 +289,14 @@ int train() {
     CopyLayers(solver.get(), FLAGS_weights);
   }
 
-  if (gpus.size() > 1) {
+  if (transport && FLAGS_ps_servers > 0) {
+    caffe::ParamServerSync<float> sync(solver, transport, FLAGS_ps_servers,
+        FLAGS_ps_staleness, ps_param);
+    sync.run();
+  } else if (transport) {
+    caffe::DistSync<float> sync(solver, transport);
+    sync.run();
+  } else if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.run(gpus);
   } else {
@@ -369,11 +461,179 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  const caffe::HostAllocatorStats stats = caffe::GetHostAllocatorStats();
+  LOG(INFO) << "Host memory: " << stats.peak_bytes_in_use / 1048576.
+    << " MB peak in use, " << stats.bytes_reserved / 1048576.
+    << " MB reserved, fragmentation " << stats.fragmentation() << ".";
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Whether a layer has an INT8 inference path.
+static bool is_quantizable(const Layer<float>& layer) {
+  return strcmp(layer.type(), "Convolution") == 0 ||
+      strcmp(layer.type(), "InnerProduct") == 0;
+}
+
+// Compare the outputs of the INT8 model against the original net. The data
+// layers of the INT8 model are replaced by inputs fed from the original net,
+// so that both see exactly the same batches.
+static void check_quantized(Net<float>* net,
+    const caffe::NetParameter& int8_param) {
+  caffe::NetParameter check_param(int8_param);
+  check_param.clear_layer();
+  std::set<string> data_layers;
+  for (int i = 0; i < net->layers().size(); ++i) {
+    if (net->bottom_vecs()[i].size() > 0) {
+      continue;
+    }
+    const caffe::LayerParameter& layer_param = net->layers()[i]->layer_param();
+    data_layers.insert(layer_param.name());
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      check_param.add_input(layer_param.top(j));
+      caffe::BlobShape* shape = check_param.add_input_shape();
+      const vector<int>& dims = net->top_vecs()[i][j]->shape();
+      for (int k = 0; k < dims.size(); ++k) {
+        shape->add_dim(dims[k]);
+      }
+    }
+  }
+  for (int i = 0; i < int8_param.layer_size(); ++i) {
+    if (!data_layers.count(int8_param.layer(i).name())) {
+      check_param.add_layer()->CopyFrom(int8_param.layer(i));
+    }
+  }
+  Net<float> int8_net(check_param);
+  int8_net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  const vector<int>& output_ids = net->output_blob_indices();
+  vector<double> score(output_ids.size(), 0);
+  vector<double> int8_score(output_ids.size(), 0);
+  vector<double> max_diff(output_ids.size(), 0);
+  vector<double> sumsq(output_ids.size(), 0);
+  vector<double> sumsq_diff(output_ids.size(), 0);
+  LOG(INFO) << "Checking accuracy for " << FLAGS_check_iterations
+      << " iterations.";
+  for (int i = 0; i < FLAGS_check_iterations; ++i) {
+    net->ForwardPrefilled();
+    for (int j = 0; j < int8_net.num_inputs(); ++j) {
+      const string& name =
+          int8_net.blob_names()[int8_net.input_blob_indices()[j]];
+      int8_net.input_blobs()[j]->CopyFrom(*net->blob_by_name(name), false,
+          true);
+    }
+    int8_net.ForwardPrefilled();
+    for (int j = 0; j < output_ids.size(); ++j) {
+      const string& name = net->blob_names()[output_ids[j]];
+      const Blob<float>& output = *net->blobs()[output_ids[j]];
+      const Blob<float>& int8_output = *int8_net.blob_by_name(name);
+      CHECK_EQ(output.count(), int8_output.count());
+      for (int k = 0; k < output.count(); ++k) {
+        const double value = output.cpu_data()[k];
+        const double diff = int8_output.cpu_data()[k] - value;
+        score[j] += value / output.count();
+        int8_score[j] += int8_output.cpu_data()[k] / output.count();
+        max_diff[j] = std::max(max_diff[j], std::fabs(diff));
+        sumsq[j] += value * value;
+        sumsq_diff[j] += diff * diff;
+      }
+    }
+  }
+  for (int j = 0; j < output_ids.size(); ++j) {
+    const string& name = net->blob_names()[output_ids[j]];
+    LOG(INFO) << name << " = " << score[j] / FLAGS_check_iterations
+        << " (FP32) vs. " << int8_score[j] / FLAGS_check_iterations
+        << " (INT8); max abs diff " << max_diff[j] << ", relative error "
+        << (sumsq[j] > 0 ? std::sqrt(sumsq_diff[j] / sumsq[j]) : 0);
+  }
+}
+
+// Quantize: calibrate the input ranges of the convolution and inner product
+// layers of a model and write it out for INT8 inference.
+int quantize() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to quantize.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to quantize.";
+  CHECK_GT(FLAGS_output.size(), 0) << "Need an output file for the model.";
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  // Instantiate the caffe net.
+  Net<float> caffe_net(FLAGS_model, caffe::TEST);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  CHECK_EQ(caffe_net.num_inputs(), 0)
+      << "Calibration needs a model that reads its own data.";
+
+  // Run the net layer by layer to record the largest input magnitude of
+  // every quantizable layer before the layer (or an in-place layer after
+  // it) can overwrite its input.
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
+  vector<float> input_range(layers.size(), 0);
+  LOG(INFO) << "Calibrating for " << FLAGS_iterations << " iterations.";
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    for (int i = 0; i < layers.size(); ++i) {
+      if (is_quantizable(*layers[i])) {
+        for (int k = 0; k < bottom_vecs[i].size(); ++k) {
+          input_range[i] = std::max(input_range[i], caffe::caffe_cpu_amax(
+              bottom_vecs[i][k]->count(), bottom_vecs[i][k]->cpu_data()));
+        }
+      }
+      caffe_net.ForwardFromTo(i, i);
+    }
+  }
+
+  // Rewrite the TEST phase of the model with the calibrated ranges.
+  std::map<string, float> ranges;
+  for (int i = 0; i < layers.size(); ++i) {
+    if (!is_quantizable(*layers[i])) {
+      continue;
+    }
+    const string& name = caffe_net.layer_names()[i];
+    if (input_range[i] > 0) {
+      LOG(INFO) << name << " input range: " << input_range[i];
+      ranges[name] = input_range[i];
+    } else {
+      LOG(WARNING) << "Keeping " << name << " in FP32 as its input was "
+          << "zero throughout calibration.";
+    }
+  }
+  caffe::NetParameter net_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  net_param.mutable_state()->set_phase(caffe::TEST);
+  caffe::NetParameter int8_param;
+  Net<float>::FilterNet(net_param, &int8_param);
+  for (int i = 0; i < int8_param.layer_size(); ++i) {
+    caffe::LayerParameter* layer_param = int8_param.mutable_layer(i);
+    if (!ranges.count(layer_param->name())) {
+      continue;
+    }
+    caffe::QuantizationParameter* quantization_param =
+        layer_param->mutable_quantization_param();
+    quantization_param->set_precision(
+        caffe::QuantizationParameter_Precision_INT8);
+    quantization_param->set_input_range(ranges[layer_param->name()]);
+    quantization_param->set_per_channel(FLAGS_quantize_per_channel);
+  }
+  caffe::WriteProtoToTextFile(int8_param, FLAGS_output);
+  LOG(INFO) << "Wrote INT8 model definition to " << FLAGS_output;
+
+  if (FLAGS_check_iterations > 0) {
+    check_quantized(&caffe_net, int8_param);
+  }
+  return 0;
+}
+RegisterBrewFunction(quantize);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -384,9 +644,20 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  quantize        calibrate a model for INT8 inference");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  caffe::SetHostPooling(FLAGS_host_pool);
+  caffe::SetHostHugePages(FLAGS_huge_pages);
+  if (FLAGS_numa_node.size()) {
+    // Bound before any thread starts, for them to inherit it.
+    const int node = FLAGS_numa_node == "auto" ?
+        FLAGS_dist_rank % caffe::NumaNodeCount() :
+        boost::lexical_cast<int>(FLAGS_numa_node);
+    LOG(INFO) << "Binding to NUMA node " << node;
+    caffe::BindThreadToNumaNode(node);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -394,6 +665,7 @@ int main(int argc, char** argv) {
       return GetBrewFunction(caffe::string(argv[1]))();
 #ifdef WITH_PYTHON_LAYER
     } catch (bp::error_already_set) {
+      caffe::PyGILAcquire gil;
       PyErr_Print();
       return 1;
     }
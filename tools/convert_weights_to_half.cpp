@@ -0,0 +1,61 @@
+// This is a script to store the weights of a trained model with 16 bits per
+// value, halving the size of the model on disk and, for layers that support
+// it, in memory.
+// Usage:
+//    convert_weights_to_half net_weights_in net_weights_out [FP16|BF16]
+
+#include <cstring>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3 && argc != 4) {
+    LOG(ERROR) << "Usage: "
+        << "convert_weights_to_half net_weights_in net_weights_out "
+        << "[FP16|BF16]";
+    return 1;
+  }
+  HalfFormat format = FP16;
+  if (argc == 4 && !HalfFormat_Parse(argv[3], &format)) {
+    LOG(ERROR) << "Unknown half format: " << argv[3];
+    return 1;
+  }
+
+  NetParameter net_param;
+  string input_filename(argv[1]);
+  if (!ReadProtoFromBinaryFile(input_filename, &net_param)) {
+    LOG(ERROR) << "Failed to parse input binary file as NetParameter: "
+               << input_filename;
+    return 2;
+  }
+  if (NetNeedsUpgrade(net_param) &&
+      !UpgradeNetAsNeeded(input_filename, &net_param)) {
+    LOG(ERROR) << "Encountered error(s) while upgrading the weights; "
+               << "see details above.";
+    return 2;
+  }
+
+  int num_values = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer_param = net_param.mutable_layer(i);
+    for (int j = 0; j < layer_param->blobs_size(); ++j) {
+      Blob<float> blob;
+      blob.FromProto(layer_param->blobs(j));
+      blob.CompactToHalf(format);
+      blob.ToProto(layer_param->mutable_blobs(j));
+      num_values += blob.count();
+    }
+  }
+
+  WriteProtoToBinaryFile(net_param, argv[2]);
+
+  LOG(ERROR) << "Wrote " << num_values << " weights as "
+             << HalfFormat_Name(format) << " to " << argv[2];
+  return 0;
+}
@@ -0,0 +1,107 @@
+// This is a script to prepare a trained model for deployment, folding the
+// Dropout layers, and the Power layers of power 1 that follow convolution and
+// inner product layers, into the weights of these layers.
+// Usage:
+//    fold_layers deploy_net_in net_weights_in deploy_net_out net_weights_out
+// The outputs of the folded net are checked against the original on random
+// inputs.
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fold_layers.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+// Runs the net on the inputs, with the random seed reset so that data
+// layers drawing random values give the same ones to both nets.
+static void Run(const vector<shared_ptr<Blob<float> > >& inputs,
+    Net<float>* net) {
+  CHECK_EQ(inputs.size(), net->input_blobs().size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    net->input_blobs()[i]->CopyFrom(*inputs[i], false, true);
+  }
+  net->Reshape();
+  Caffe::set_random_seed(1701);
+  net->ForwardPrefilled();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: "
+        << "fold_layers deploy_net_in net_weights_in deploy_net_out "
+        << "net_weights_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &net_param);
+  NetParameter weights;
+  ReadNetParamsFromBinaryFileOrDie(argv[2], &weights);
+  net_param.mutable_state()->set_phase(TEST);
+  map<string, const LayerParameter*> trained_layers;
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    trained_layers[weights.layer(i).name()] = &weights.layer(i);
+  }
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer_param = net_param.mutable_layer(i);
+    if (trained_layers.count(layer_param->name())) {
+      layer_param->mutable_blobs()->CopyFrom(
+          trained_layers[layer_param->name()]->blobs());
+    }
+  }
+
+  NetParameter folded_param;
+  FoldAffineLayers(net_param, &folded_param);
+  LOG(INFO) << "Folded " << net_param.layer_size() -
+      folded_param.layer_size() << " layers.";
+
+  Net<float> net(net_param);
+  Net<float> folded_net(folded_param);
+  vector<shared_ptr<Blob<float> > > inputs;
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  for (int i = 0; i < net.input_blobs().size(); ++i) {
+    inputs.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+    inputs[i]->ReshapeLike(*net.input_blobs()[i]);
+    filler.Fill(inputs[i].get());
+  }
+  Run(inputs, &net);
+  Run(inputs, &folded_net);
+  bool matches = true;
+  for (int i = 0; i < net.output_blobs().size(); ++i) {
+    const string& name = net.blob_names()[net.output_blob_indices()[i]];
+    const Blob<float>& output = *net.output_blobs()[i];
+    const Blob<float>& folded_output = *folded_net.blob_by_name(name);
+    CHECK_EQ(output.count(), folded_output.count());
+    float max_value = 0;
+    float max_diff = 0;
+    for (int j = 0; j < output.count(); ++j) {
+      max_value = std::max(max_value, std::fabs(output.cpu_data()[j]));
+      max_diff = std::max(max_diff,
+          std::fabs(output.cpu_data()[j] - folded_output.cpu_data()[j]));
+    }
+    LOG(INFO) << "Output " << name << ": largest difference " << max_diff;
+    matches = matches && max_diff <= 1e-4 * std::max(1.f, max_value);
+  }
+  if (!matches) {
+    LOG(ERROR) << "The folded net does not compute the same outputs.";
+    return 3;
+  }
+
+  WriteProtoToBinaryFile(folded_param, argv[4]);
+  for (int i = 0; i < folded_param.layer_size(); ++i) {
+    folded_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(folded_param, argv[3]);
+
+  LOG(ERROR) << "Wrote the folded net to " << argv[3] << " and "
+             << argv[4];
+  return 0;
+}
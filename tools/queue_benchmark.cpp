@@ -0,0 +1,101 @@
+// This program compares the throughput of BlockingQueue and RingQueue on the
+// pattern of the data layers: a fixed number of objects cycles between
+// producers, which take them from a free queue and push them to a full one,
+// and consumers, which do the reverse. With one producer and one consumer,
+// the RingQueue for a single producer and consumer is measured too.
+// Usage:
+//    queue_benchmark [FLAGS]
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/ring_queue.hpp"
+
+using caffe::BlockingQueue;
+using caffe::RingQueue;
+using caffe::shared_ptr;
+using caffe::Timer;
+using caffe::vector;
+
+DEFINE_int32(items, 1000000,
+    "The number of objects passed from the producers to the consumers.");
+DEFINE_int32(producers, 1, "The number of producing threads.");
+DEFINE_int32(consumers, 1, "The number of consuming threads.");
+DEFINE_int32(capacity, 16, "The number of objects cycling between them.");
+
+static BlockingQueue<int>* NewBlockingQueue() {
+  return new BlockingQueue<int>();
+}
+
+static RingQueue<int>* NewRingQueue() {
+  return new RingQueue<int>(FLAGS_capacity);
+}
+
+static RingQueue<int>* NewSingleRingQueue() {
+  return new RingQueue<int>(FLAGS_capacity, true);
+}
+
+template <typename Queue>
+static void Move(Queue* from, Queue* to, int count) {
+  for (int i = 0; i < count; ++i) {
+    to->push(from->pop());
+  }
+}
+
+// Returns the objects passed per second.
+template <typename Queue>
+static double Run(Queue* (*new_queue)()) {
+  shared_ptr<Queue> free(new_queue());
+  shared_ptr<Queue> full(new_queue());
+  for (int i = 0; i < FLAGS_capacity; ++i) {
+    free->push(i);
+  }
+  Timer timer;
+  timer.Start();
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < FLAGS_producers; ++i) {
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &Move<Queue>, free.get(), full.get(),
+        FLAGS_items / FLAGS_producers)));
+  }
+  for (int i = 0; i < FLAGS_consumers; ++i) {
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &Move<Queue>, full.get(), free.get(),
+        FLAGS_items / FLAGS_consumers)));
+  }
+  for (int i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+  }
+  return FLAGS_items / timer.Seconds();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Compare the throughput of the queues used between "
+      "threads.\n"
+      "Usage:\n"
+      "    queue_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  // The producers and consumers must pass the same number of objects.
+  CHECK_EQ(FLAGS_items % FLAGS_producers, 0);
+  CHECK_EQ(FLAGS_items % FLAGS_consumers, 0);
+
+  LOG(INFO) << FLAGS_items << " objects, " << FLAGS_producers
+      << " producers, " << FLAGS_consumers << " consumers, capacity "
+      << FLAGS_capacity;
+  const double blocking = Run(&NewBlockingQueue);
+  LOG(INFO) << "BlockingQueue: " << blocking << " objects per second";
+  const double ring = Run(&NewRingQueue);
+  LOG(INFO) << "RingQueue: " << ring << " objects per second ("
+      << ring / blocking << "x)";
+  if (FLAGS_producers == 1 && FLAGS_consumers == 1) {
+    const double single = Run(&NewSingleRingQueue);
+    LOG(INFO) << "RingQueue, single producer and consumer: " << single
+        << " objects per second (" << single / blocking << "x)";
+  }
+  return 0;
+}
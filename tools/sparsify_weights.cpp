@@ -0,0 +1,69 @@
+// This is a script to store the weights of a pruned model in compressed
+// sparse row form, shrinking the model on disk and in memory, and letting
+// convolution and inner product layers skip the zero weights.
+// Usage:
+//    sparsify_weights net_weights_in net_weights_out [min_sparsity]
+// Only weights with at least min_sparsity (default 0.7) of their values zero
+// are converted; below that, the dense gemm is faster.
+
+#include <cstdlib>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/sparse.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3 && argc != 4) {
+    LOG(ERROR) << "Usage: "
+        << "sparsify_weights net_weights_in net_weights_out [min_sparsity]";
+    return 1;
+  }
+  const double min_sparsity = (argc == 4) ? atof(argv[3]) : 0.7;
+
+  NetParameter net_param;
+  string input_filename(argv[1]);
+  if (!ReadProtoFromBinaryFile(input_filename, &net_param)) {
+    LOG(ERROR) << "Failed to parse input binary file as NetParameter: "
+               << input_filename;
+    return 2;
+  }
+  if (NetNeedsUpgrade(net_param) &&
+      !UpgradeNetAsNeeded(input_filename, &net_param)) {
+    LOG(ERROR) << "Encountered error(s) while upgrading the weights; "
+               << "see details above.";
+    return 2;
+  }
+
+  int num_blobs = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer_param = net_param.mutable_layer(i);
+    for (int j = 0; j < layer_param->blobs_size(); ++j) {
+      Blob<float> blob;
+      blob.FromProto(layer_param->blobs(j));
+      blob.Expand();
+      // Biases gain nothing from a sparse form.
+      if (blob.num_axes() < 2) {
+        continue;
+      }
+      const double sparsity = caffe_cpu_sparsity(blob.count(), blob.cpu_data());
+      if (sparsity < min_sparsity) {
+        continue;
+      }
+      LOG(INFO) << layer_param->name() << " blob " << j << ": "
+                << sparsity * 100 << "% zeros";
+      blob.CompactToSparse();
+      blob.ToProto(layer_param->mutable_blobs(j));
+      ++num_blobs;
+    }
+  }
+
+  WriteProtoToBinaryFile(net_param, argv[2]);
+
+  LOG(ERROR) << "Wrote " << num_blobs << " sparse weight blobs to " << argv[2];
+  return 0;
+}